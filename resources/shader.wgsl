@@ -1,8 +1,8 @@
 struct VertexInput {
 	@builtin(instance_index) instanceIdx: u32,
   @builtin(vertex_index) vertexIdx: u32,
-	@location(0) position: vec3f,
-	@location(1) color: vec3f,
+	@location(0) position: vec4f, // float32x3 or unorm16x4
+	@location(1) color: vec4f, // float32x3 or unorm8x4
 };
 
 struct VertexOutput {
@@ -18,7 +18,12 @@ struct Uniforms_t {
 };
 @group(0) @binding(0) var<uniform> uniforms: Uniforms_t;
 @group(0) @binding(1) var<uniform> transformation: mat4x4f;
-@group(0) @binding(2) var<uniform> opacity: f32;
+struct CloudUniforms_t {
+  opacity: f32,
+  quantOffset: vec4f,
+  quantScale: vec4f,
+};
+@group(0) @binding(2) var<uniform> cloud: CloudUniforms_t;
 
 const quadPos = array(
   vec2f(0, 0),
@@ -32,7 +37,9 @@ const quadPos = array(
 @vertex
 fn vs_main(in: VertexInput) -> VertexOutput {
 	var out: VertexOutput;
-  let viewPos = uniforms.viewMatrix * transformation * vec4f(in.position, 1.0);
+  // identity (offset 0, scale 1) for float point buffers
+  let position = cloud.quantOffset.xyz + in.position.xyz * cloud.quantScale.xyz;
+  let viewPos = uniforms.viewMatrix * transformation * vec4f(position, 1.0);
 
   var scale: f32;
   if(viewPos.z >= 0.0){
@@ -43,7 +50,7 @@ fn vs_main(in: VertexInput) -> VertexOutput {
 
   let pos = (quadPos[in.vertexIdx] - 0.5) * scale;
   out.position = uniforms.projectionMatrix * (viewPos + vec4f(pos, 0, 0));
-  out.color = in.color;
+  out.color = in.color.rgb;
 	
 	return out;
 }
@@ -52,5 +59,5 @@ fn vs_main(in: VertexInput) -> VertexOutput {
 
 @fragment
 fn fs_main(in: VertexOutput) -> @location(0) vec4f {
-	return vec4f(in.color, opacity);
+	return vec4f(in.color, cloud.opacity);
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "Application.h"
+#include <algorithm>
 #include <format>
 #include <thread>
 #include <windows.h>
 #include <cstdlib>
+#include <cmath>
 
 #include "utils/k4aimguiextensions.h"
 #include <backends/imgui_impl_wgpu.h>
@@ -16,6 +18,7 @@
 #include "Pointcloud.h"
 #include "Helpers.h"
 #include "Darkmode.h"
+#include "ImageAllocator.h"
 
 Application::Application()
 {
@@ -23,6 +26,9 @@ Application::Application()
 
 bool Application::on_init()
 {	
+	// has to happen before the first k4a image is allocated
+	ImageAllocator::install();
+
 	if (!init_window_and_device())
 		return false;
 
@@ -94,6 +100,65 @@ void Application::on_resize()
 }
 
 void Application::capture()
+{
+	if (m_depth_accumulator.is_active() || !*m_camera.depth_image())
+		return;
+
+	const k4a::image& depth_image = *m_camera.depth_image();
+	if (m_temporal_frames <= 1) {
+		add_capture(depth_image, *m_camera.color_image(), m_camera.orientation());
+		return;
+	}
+
+	// the color and orientation are taken from the first frame, the depth is finished in accumulate_capture
+	m_accumulated_color_image = k4a::image(*m_camera.color_image());
+	m_accumulated_orientation = m_camera.orientation();
+	m_accumulated_frame_index = m_camera.frame_index();
+	m_depth_accumulator.begin(depth_image.get_width_pixels(), depth_image.get_height_pixels(), m_temporal_frames, m_temporal_mode);
+	m_depth_accumulator.add_frame(depth_image);
+}
+
+void Application::accumulate_capture()
+{
+	if (!m_depth_accumulator.is_active() || m_camera.frame_index() == m_accumulated_frame_index)
+		return;
+
+	m_accumulated_frame_index = m_camera.frame_index();
+	if (!m_depth_accumulator.add_frame(*m_camera.depth_image()))
+		return;
+
+	k4a::image depth_image = m_depth_accumulator.result();
+	Logger::log(std::format("Averaged {} depth frames, rejected {} unstable pixels", m_depth_accumulator.frames_added(), m_depth_accumulator.rejected_pixels()));
+
+	add_capture(depth_image, m_accumulated_color_image, m_accumulated_orientation);
+	m_depth_accumulator.reset();
+	m_accumulated_color_image.reset();
+}
+
+void Application::pick_component_seed()
+{
+	glm::vec2 color_pixel;
+	if (!m_camera.pop_clicked_pixel(color_pixel) || !m_camera.depth_image() || !*m_camera.depth_image())
+		return;
+
+	// the preview shows the color camera, the seed lives in the depth image
+	k4a_float2_t source_pixel;
+	source_pixel.xy.x = color_pixel.x;
+	source_pixel.xy.y = color_pixel.y;
+
+	k4a_float2_t depth_pixel;
+	if (!m_camera.calibration().convert_color_2d_to_depth_2d(source_pixel, *m_camera.depth_image(), &depth_pixel)) {
+		Logger::log("No depth at the clicked pixel", LoggingSeverity::Warning);
+		return;
+	}
+
+	const glm::ivec2 seed = { (int)std::lround(depth_pixel.xy.x), (int)std::lround(depth_pixel.xy.y) };
+	m_pipeline.settings().set_component_seed(seed);
+	m_pipeline.settings().set_component_selection(ComponentSelection::Seed);
+	Logger::log(std::format("Component seed set to depth pixel ({}, {})", seed.x, seed.y));
+}
+
+void Application::add_capture(const k4a::image& depth_image, const k4a::image& color_image, const glm::quat& orientation)
 {
 	CameraCapture* capture = new CameraCapture();
 
@@ -104,16 +169,26 @@ void Application::capture()
 	capture->name = capture_name;
 	capture->is_selected = false;
 	capture->calibration = m_camera.calibration();
-	capture->depth_image = k4a::image(*m_camera.depth_image());
-	capture->color_image = k4a::image(*m_camera.color_image());
+	capture->depth_image = k4a::image(depth_image);
+	capture->color_image = k4a::image(color_image);
 	capture->transform = glm::mat4(1.f);
-	capture->camera_orientation = glm::quat(m_camera.orientation());
+	capture->camera_orientation = orientation;
 
 	capture->preview_image = Texture(m_device, m_queue, nullptr, 0, capture->color_image.get_width_pixels(), capture->color_image.get_height_pixels(), wgpu::TextureFormat::BGRA8Unorm);
 	capture->preview_image.update(reinterpret_cast<const BgraPixel*>(capture->color_image.get_buffer()));
 
 	auto pc = new Pointcloud(m_device, m_queue, &capture->transform);
-	pc->load_from_capture(capture->depth_image, capture->color_image, capture->calibration);
+
+	// the support plane of the last capture is a good first guess for this one
+	const auto& captures = m_capture_sequence.captures();
+	auto previous = std::find_if(captures.rbegin(), captures.rend(), [](const CameraCapture* c) { return c->has_support_plane; });
+	if (previous != captures.rend()) {
+		pc->set_plane_prior((*previous)->support_plane);
+	}
+
+	pc->load_from_capture(capture->depth_image, capture->color_image, capture->calibration, m_pipeline);
+	capture->has_support_plane = pc->has_support_plane();
+	capture->support_plane = pc->support_plane();
 	capture->data_pointer = m_renderer.add_pointcloud(pc);
 	
 	m_capture_sequence.add_capture(capture);
@@ -247,7 +322,8 @@ bool Application::init_window_and_device()
 	wgpu::RequiredLimits required_limits = wgpu::Default;
 	required_limits.limits.maxVertexAttributes = 4;
 	required_limits.limits.maxVertexBuffers = 1;
-	required_limits.limits.maxBufferSize = 150000 * sizeof(PointAttributes);
+	// unbinned depth and color space clouds reach millions of points, so take what the adapter supports
+	required_limits.limits.maxBufferSize = supported_limits.limits.maxBufferSize;
 	required_limits.limits.maxVertexBufferArrayStride = sizeof(PointAttributes);
 	required_limits.limits.minStorageBufferOffsetAlignment = supported_limits.limits.minStorageBufferOffsetAlignment;
 	required_limits.limits.minUniformBufferOffsetAlignment = supported_limits.limits.minUniformBufferOffsetAlignment;
@@ -255,9 +331,9 @@ bool Application::init_window_and_device()
 	required_limits.limits.maxBindGroups = 2;
 	required_limits.limits.maxUniformBuffersPerShaderStage = 1;
 	required_limits.limits.maxUniformBufferBindingSize = 16 * 4 * sizeof(float);
-	// Allow textures up to 2K
-	required_limits.limits.maxTextureDimension1D = 2048;
-	required_limits.limits.maxTextureDimension2D = 2048;
+	// color textures go up to 4096x3072
+	required_limits.limits.maxTextureDimension1D = supported_limits.limits.maxTextureDimension1D;
+	required_limits.limits.maxTextureDimension2D = supported_limits.limits.maxTextureDimension2D;
 	required_limits.limits.maxTextureArrayLayers = 1;
 	required_limits.limits.maxSampledTexturesPerShaderStage = 1;
 	required_limits.limits.maxSamplersPerShaderStage = 1;
@@ -274,6 +350,7 @@ bool Application::init_window_and_device()
 		return false;
 	}
 	Logger::log(std::format("Got device: {}", (void*)m_device));
+	Logger::log(std::format("Device limits: {} MB buffers, {} px textures", required_limits.limits.maxBufferSize >> 20, required_limits.limits.maxTextureDimension2D));
 
 	// error callback for more debug info
 	m_uncaptured_error_callback = m_device.setUncapturedErrorCallback([](wgpu::ErrorType type, char const* message) {
@@ -486,6 +563,7 @@ void Application::render()
 	render_console();
 	render_debug();
 	render_edit_menu();
+	render_align_all_menu();
 }
 
 
@@ -550,15 +628,67 @@ void Application::render_capture_menu()
 	m_load_dialog.Display();
 
 	if (m_load_dialog.HasSelected()) {
-		auto paths = m_load_dialog.GetMultiSelected();
+		std::vector<std::filesystem::path> paths;
+		for (auto& path : m_load_dialog.GetMultiSelected()) {
+			if (path.extension() != POINTCLOUD_COMPACT_FILE_EXTENSION) {
+				paths.push_back(path);
+				continue;
+			}
+
+			// saved point clouds come without images, like the COLMAP cloud
+			auto capture = new CameraCapture();
+			capture->id = m_capture_sequence.get_next_id();
+			capture->name = path.stem().string();
+			capture->is_selected = true;
+			capture->has_images = false;
+			capture->transform = glm::mat4(1.f);
+			capture->camera_orientation = glm::quat();
+
+			auto pc = new Pointcloud(m_device, m_queue, &capture->transform);
+			if (!pc->load_from_compact(path)) {
+				delete pc;
+				delete capture;
+				continue;
+			}
+
+			pc->m_loaded = true;
+			capture->data_pointer = m_renderer.add_pointcloud(pc);
+			m_capture_sequence.add_capture(capture);
+			CameraCaptureSequence::s_capturelist_updated = true;
+			m_app_state = AppState::Pointcloud;
+		}
+
 		if (m_capture_sequence.load_sequence(paths)) {
 			Logger::log("Successfully loaded captures");
+
+			// only build clouds for the newly loaded captures, all of them in one pipeline run
+			std::vector<CameraCapture*> new_captures;
+			std::vector<Pointcloud*> new_pointclouds;
 			for (auto& capture : m_capture_sequence.captures()) {
+				if (!capture->has_images || capture->data_pointer)
+					continue;
+
 				capture->preview_image = Texture(m_device, m_queue, nullptr, 0, capture->color_image.get_width_pixels(), capture->color_image.get_height_pixels(), wgpu::TextureFormat::BGRA8Unorm);
 				capture->preview_image.update(reinterpret_cast<const BgraPixel*>(capture->color_image.get_buffer()));
 
 				auto pc = new Pointcloud(m_device, m_queue, &capture->transform);
-				pc->load_from_capture(capture->depth_image, capture->color_image, capture->calibration);
+				if (capture->has_support_plane) {
+					pc->set_plane_prior(capture->support_plane);
+				}
+				pc->set_capture(capture->depth_image, capture->color_image, capture->calibration);
+				new_captures.push_back(capture);
+				new_pointclouds.push_back(pc);
+			}
+
+			m_pipeline.run(new_pointclouds);
+
+			for (size_t i = 0; i < new_captures.size(); i++) {
+				CameraCapture* capture = new_captures[i];
+				Pointcloud* pc = new_pointclouds[i];
+				if (pc->has_support_plane()) {
+					capture->has_support_plane = true;
+					capture->support_plane = pc->support_plane();
+				}
 				pc->m_loaded = capture->is_selected;
 				capture->data_pointer = m_renderer.add_pointcloud(pc);
 			}
@@ -644,14 +774,14 @@ void Application::render_capture_menu()
 		ImGui::SameLine();
 
 		{
-			if (capture->is_colmap)
+			if (!capture->has_images)
 				ImGui::BeginDisabled();
 
 			if (ImGui::Button("Show image")) {
 				ImGui::OpenPopup("Image preview");
 			}
 
-			if (capture->is_colmap)
+			if (!capture->has_images)
 				ImGui::EndDisabled();
 		}
 
@@ -700,7 +830,15 @@ void Application::render_capture_menu()
 	ImGui::Separator();
 
 	if (m_app_state == AppState::Capture && m_camera.is_initialized()) {
-		if (ImGui::Button("Capture [space]", ImVec2(ImGui::GetContentRegionAvail().x, 40)) || ImGui::IsKeyPressed(ImGuiKey_Space)) {
+		const bool accumulating = m_depth_accumulator.is_active();
+		const std::string capture_label = accumulating
+			? std::format("Capturing {}/{}###capture", m_depth_accumulator.frames_added(), m_depth_accumulator.frame_count())
+			: "Capture [space]###capture";
+
+		if (accumulating)
+			ImGui::BeginDisabled();
+
+		if (ImGui::Button(capture_label.c_str(), ImVec2(ImGui::GetContentRegionAvail().x, 40)) || (!accumulating && ImGui::IsKeyPressed(ImGuiKey_Space))) {
 			capture();
 		}
 
@@ -710,6 +848,98 @@ void Application::render_capture_menu()
 			m_camera.calibrate_sensors();
 		}
 
+		// the median keeps every frame in memory, its window is smaller
+		const int max_temporal_frames = m_temporal_mode == DepthAccumulationMode::Median ? CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES : CAPTURE_TEMPORAL_MAX_FRAMES;
+		ImGui::SliderInt("Temporal Frames", &m_temporal_frames, 1, max_temporal_frames);
+		int temporal_mode = (int)m_temporal_mode;
+		if (ImGui::Combo("Temporal Filter", &temporal_mode, "Mean\0Median\0")) {
+			m_temporal_mode = (DepthAccumulationMode)temporal_mode;
+			if (m_temporal_mode == DepthAccumulationMode::Median) {
+				m_temporal_frames = std::min(m_temporal_frames, CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES);
+			}
+		}
+
+		ImGui::Separator();
+		ImGui::Text("Generation");
+
+		int generation_space = (int)m_pipeline.settings().generation_space();
+		if (ImGui::Combo("Space", &generation_space, "Depth Camera\0Color Camera\0")) {
+			m_pipeline.settings().set_generation_space((GenerationSpace)generation_space);
+		}
+		if (m_pipeline.settings().generation_space() == GenerationSpace::Color) {
+			// strides 1, 2 and 4
+			int stride_idx = m_pipeline.settings().color_stride() >= 4 ? 2 : m_pipeline.settings().color_stride() - 1;
+			if (ImGui::Combo("Pixel Stride", &stride_idx, "1\0" "2\0" "4\0")) {
+				m_pipeline.settings().set_color_stride(1 << stride_idx);
+			}
+		}
+
+		bool triangulate = m_pipeline.settings().triangulate();
+		if (ImGui::Checkbox("Triangulate", &triangulate)) {
+			m_pipeline.settings().set_triangulate(triangulate);
+		}
+
+		ImGui::Separator();
+		ImGui::Text("Clipping");
+
+		DepthClipSettings clip = m_pipeline.settings().clip_settings();
+		const k4a::calibration calibration = m_camera.calibration();
+		const int depth_width = calibration.depth_camera_calibration.resolution_width;
+		const int depth_height = calibration.depth_camera_calibration.resolution_height;
+
+		ImGui::Checkbox("Enabled##clip", &clip.enabled);
+		ImGui::DragFloatRange2("Distance [m]", &clip.min_distance, &clip.max_distance, .01f, 0.f, 10.f);
+
+		ImGui::Checkbox("Pixel ROI", &clip.use_roi);
+		if (clip.use_roi) {
+			if (clip.roi_max == glm::ivec2(0)) {
+				clip.roi_max = { depth_width, depth_height };
+			}
+			ImGui::DragIntRange2("ROI x", &clip.roi_min.x, &clip.roi_max.x, 1.f, 0, depth_width);
+			ImGui::DragIntRange2("ROI y", &clip.roi_min.y, &clip.roi_max.y, 1.f, 0, depth_height);
+		}
+
+		ImGui::Checkbox("Crop Box", &clip.use_crop_box);
+		if (clip.use_crop_box) {
+			ImGui::DragFloat3("Box Min [m]", &clip.crop_min.x, .01f, -10.f, 10.f);
+			ImGui::DragFloat3("Box Max [m]", &clip.crop_max.x, .01f, -10.f, 10.f);
+		}
+
+		if (!(clip == m_pipeline.settings().clip_settings())) {
+			m_pipeline.settings().set_clip_settings(clip);
+		}
+
+		ImGui::Separator();
+		ImGui::Text("Support Plane");
+
+		int plane_mode = (int)m_pipeline.settings().plane_mode();
+		if (ImGui::Combo("Plane", &plane_mode, "Off\0Detect\0Remove Plane\0Keep Above\0")) {
+			m_pipeline.settings().set_plane_mode((PlaneSegmentationMode)plane_mode);
+		}
+
+		float plane_threshold = m_pipeline.settings().plane_threshold();
+		if (ImGui::SliderFloat("Plane Distance [m]", &plane_threshold, .001f, .05f)) {
+			m_pipeline.settings().set_plane_threshold(plane_threshold);
+		}
+
+		ImGui::Separator();
+		ImGui::Text("Component");
+
+		int component_selection = (int)m_pipeline.settings().component_selection();
+		if (ImGui::Combo("Keep", &component_selection, "Off\0Largest\0Clicked Pixel\0")) {
+			m_pipeline.settings().set_component_selection((ComponentSelection)component_selection);
+		}
+		if (m_pipeline.settings().component_selection() == ComponentSelection::Seed) {
+			const glm::ivec2 seed = m_pipeline.settings().component_seed();
+			if (seed.x < 0)
+				ImGui::TextDisabled("Click the camera image to pick the object");
+			else
+				ImGui::Text("Seed: %d, %d", seed.x, seed.y);
+		}
+
+		if (accumulating)
+			ImGui::EndDisabled();
+
 		
 		
 	}
@@ -725,8 +955,14 @@ void Application::render_capture_menu()
 
 		if (!m_camera.is_initialized())
 			ImGui::EndDisabled();
+
+		if (ImGui::Button("Align all", ImVec2(ImGui::GetContentRegionAvail().x, 0))) {
+			m_align_all_open = true;
+		}
 	}
 
+	render_pipeline_menu();
+
 	{
 		if (m_capture_sequence.captures().size() < 1)
 			ImGui::BeginDisabled();
@@ -743,6 +979,7 @@ void Application::render_capture_menu()
 			capture->name = "COLMAP Pointcloud";
 			capture->is_selected = true;
 			capture->is_colmap = true;
+			capture->has_images = false;
 			capture->transform = glm::mat4(1.f);
 			capture->camera_orientation = glm::quat();
 			m_capture_sequence.add_capture(capture);
@@ -750,17 +987,109 @@ void Application::render_capture_menu()
 
 			auto pc = new Pointcloud(m_device, m_queue, &capture->transform);
 			pc->set_is_colmap(true);
-			pc->load_from_points3D(TMP_DIR "/colmap/sparse/0/points3D.bin");
+			pc->load_from_points3D(TMP_DIR "/colmap/sparse/0/points3D.bin", m_colmap_voxel_size);
 			m_renderer.add_pointcloud(pc);
 
 			m_app_state = AppState::Pointcloud;
 		}
 
+		ImGui::SliderFloat("COLMAP Voxel Size", &m_colmap_voxel_size, 0.f, 1.f);
+
 		if (m_capture_sequence.captures().size() < 1)
 			ImGui::EndDisabled();
 	}
 }
 
+void Application::render_camera_mode()
+{
+	static const std::vector<std::pair<k4a_depth_mode_t, std::string>> depth_modes = {
+		{ K4A_DEPTH_MODE_NFOV_2X2BINNED, "NFOV Binned (320x288)" },
+		{ K4A_DEPTH_MODE_NFOV_UNBINNED, "NFOV Unbinned (640x576)" },
+		{ K4A_DEPTH_MODE_WFOV_2X2BINNED, "WFOV Binned (512x512)" },
+		{ K4A_DEPTH_MODE_WFOV_UNBINNED, "WFOV Unbinned (1024x1024)" }
+	};
+	static const std::vector<std::pair<k4a_color_resolution_t, std::string>> color_resolutions = {
+		{ K4A_COLOR_RESOLUTION_720P, "720p" },
+		{ K4A_COLOR_RESOLUTION_1080P, "1080p" },
+		{ K4A_COLOR_RESOLUTION_1440P, "1440p" },
+		{ K4A_COLOR_RESOLUTION_1536P, "1536p (4:3)" },
+		{ K4A_COLOR_RESOLUTION_2160P, "2160p" },
+		{ K4A_COLOR_RESOLUTION_3072P, "3072p (4:3)" }
+	};
+	static const std::vector<std::pair<k4a_fps_t, std::string>> frame_rates = {
+		{ K4A_FRAMES_PER_SECOND_5, "5 fps" },
+		{ K4A_FRAMES_PER_SECOND_15, "15 fps" },
+		{ K4A_FRAMES_PER_SECOND_30, "30 fps" }
+	};
+
+	ImGuiExtensions::K4AComboBox("Depth Mode", "", ImGuiComboFlags_None, depth_modes, &m_camera_mode.depth_mode);
+	ImGuiExtensions::K4AComboBox("Color Resolution", "", ImGuiComboFlags_None, color_resolutions, &m_camera_mode.color_resolution);
+	ImGuiExtensions::K4AComboBox("Frame Rate", "", ImGuiComboFlags_None, frame_rates, &m_camera_mode.fps);
+
+	if (Camera::max_fps(m_camera_mode) != m_camera_mode.fps) {
+		ImGui::TextDisabled("Limited to 15 fps in this mode");
+	}
+
+	// an open device restarts its cameras, captures in progress are dropped
+	if (m_camera.is_initialized() && !(m_camera_mode == m_camera.mode())) {
+		if (ImGui::Button("Apply Mode")) {
+			m_depth_accumulator.reset();
+			m_accumulated_color_image.reset();
+			m_camera.set_mode(m_camera_mode);
+			m_camera_mode = m_camera.mode();
+		}
+	}
+}
+
+void Application::render_pipeline_menu()
+{
+	ImGui::Separator();
+	ImGui::Text("Pipeline");
+
+	for (size_t s = 0; s < (size_t)PipelineStage::Count; s++) {
+		const PipelineStage stage = (PipelineStage)s;
+		if (!PointcloudPipeline::stage_optional(stage))
+			continue;
+
+		bool enabled = m_pipeline.stage_enabled(stage);
+		if (ImGui::Checkbox(std::format("{}##pipeline", PointcloudPipeline::stage_name(stage)).c_str(), &enabled)) {
+			m_pipeline.set_stage_enabled(stage, enabled);
+		}
+	}
+
+	if (ImGui::Button("Rebuild All")) {
+		std::vector<CameraCapture*> captures;
+		std::vector<Pointcloud*> pointclouds;
+		for (auto& capture : m_capture_sequence.captures()) {
+			if (!capture->has_images || !capture->data_pointer || !capture->data_pointer->has_capture())
+				continue;
+
+			captures.push_back(capture);
+			pointclouds.push_back(capture->data_pointer);
+		}
+
+		m_pipeline.run(pointclouds);
+
+		for (CameraCapture* capture : captures) {
+			if (capture->data_pointer->has_support_plane()) {
+				capture->has_support_plane = true;
+				capture->support_plane = capture->data_pointer->support_plane();
+			}
+		}
+	}
+
+	if (m_pipeline.last_cloud_count() > 0) {
+		ImGui::Text("Last run: %zu cloud(s), %.1f ms", m_pipeline.last_cloud_count(), m_pipeline.last_run_milliseconds());
+		const PipelineStats& stats = m_pipeline.last_stats();
+		for (size_t s = 0; s < stats.size(); s++) {
+			if (stats[s].skipped)
+				continue;
+
+			ImGui::Text("%-16s %7.1f ms  %zu -> %zu", PointcloudPipeline::stage_name((PipelineStage)s), stats[s].milliseconds, stats[s].count_in, stats[s].count_out);
+		}
+	}
+}
+
 void Application::render_debug()
 {
 	ImGui::Begin("Debug", nullptr, ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoTitleBar);
@@ -772,7 +1101,12 @@ void Application::render_debug()
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
 		ImGui::Text("Number of captures: %d", m_capture_sequence.captures().size());
 		ImGui::Text("Number of pointclouds: %d", m_renderer.get_num_pointclouds());
-		ImGui::Text("Number of points: %d", m_renderer.get_num_vertices());
+		ImGui::Text("Number of points: %d (%.1f MB)", m_renderer.get_num_vertices(), m_renderer.get_point_memory_usage() / 1048576.f);
+		ImGui::Text(std::format("XY table cache: {} hits, {} disk hits, {} misses", XYTableCache::hits(), XYTableCache::disk_hits(), XYTableCache::misses()).c_str());
+
+		auto pool_stats = ImageAllocator::stats();
+		float pool_hit_rate = pool_stats.pool_hits + pool_stats.pool_misses > 0 ? 100.f * pool_stats.pool_hits / (pool_stats.pool_hits + pool_stats.pool_misses) : 0.f;
+		ImGui::Text("Image pool: %.1f%% hit rate, %.1f MB in use (peak %.1f MB), %.1f MB cached", pool_hit_rate, pool_stats.bytes_in_use / 1048576.f, pool_stats.bytes_in_use_high_water / 1048576.f, pool_stats.bytes_cached / 1048576.f);
 
 		if (ImGui::Button("Reload Shader")) {
 			m_renderer.reload_renderpipeline();
@@ -795,11 +1129,20 @@ void Application::render_console()
 
 	ImGui::BeginChild("ScrollingRegion", ImVec2(0, 0), false, ImGuiWindowFlags_HorizontalScrollbar);
 
-	ImGui::TextUnformatted(Logger::s_buffer.str().c_str());
+	// pool workers (pipeline, registration jobs) log concurrently
+	std::string log_text;
+	bool log_updated = false;
+	{
+		std::lock_guard<std::mutex> lock(Logger::s_mutex);
+		log_text = Logger::s_buffer.str();
+		log_updated = Logger::s_updated;
+		Logger::s_updated = false;
+	}
+
+	ImGui::TextUnformatted(log_text.c_str());
 
-	if (Logger::s_updated) {
+	if (log_updated) {
 		ImGui::SetScrollHereY(1.0);
-		Logger::s_updated = false;
 	}
 
 	ImGui::EndChild();
@@ -812,6 +1155,8 @@ void Application::render_content()
 	switch (m_app_state) {
 		case AppState::Capture:
 			m_camera.on_frame();
+			accumulate_capture();
+			pick_component_seed();
 			break;
 
 		case AppState::Pointcloud:
@@ -862,7 +1207,8 @@ void Application::render_menu()
 		{
 			ImGuiExtensions::ButtonColorChanger button_color_changer(ImGuiExtensions::ButtonColor::Green, can_open);
 			if (ImGuiExtensions::K4AButton("Open device", can_open)) {
-				m_camera.on_init(m_device, m_queue, *m_k4a_device_selector.selected_device(), m_window_width - GUI_MENU_WIDTH, m_window_height - GUI_CONSOLE_HEIGHT);
+				m_camera.on_init(m_device, m_queue, *m_k4a_device_selector.selected_device(), m_window_width - GUI_MENU_WIDTH, m_window_height - GUI_CONSOLE_HEIGHT, m_camera_mode);
+				m_camera_mode = m_camera.mode();
 				/*if(m_camera.is_initialized())
 					m_app_state = AppState::Capture;*/
 			}
@@ -880,6 +1226,8 @@ void Application::render_menu()
 		}
 	}
 
+	render_camera_mode();
+
 	ImGui::Separator();
 	ImGui::NewLine();
 	
@@ -994,12 +1342,88 @@ void Application::render_edit_menu()
 		capture->transform = glm::mat4(1.f);
 	}
 
+	ImGui::SameLine();
+
+	if (ImGui::Button("Save points") && capture->data_pointer) {
+		std::filesystem::create_directories(EXPORT_DIR);
+		std::filesystem::path points_path = std::format("{}/{}{}", EXPORT_DIR, capture->name, POINTCLOUD_COMPACT_FILE_EXTENSION);
+		if (capture->data_pointer->save_compact(points_path)) {
+			Logger::log(std::format("Saved {} points to {}", capture->data_pointer->pointcount(), points_path.string()));
+		}
+		else {
+			Logger::log(std::format("Failed to save points to {}", points_path.string()), LoggingSeverity::Error);
+		}
+	}
+
+	if (capture->data_pointer && !capture->data_pointer->triangles().empty()) {
+		ImGui::SameLine();
+
+		if (ImGui::Button("Save mesh")) {
+			std::filesystem::create_directories(EXPORT_DIR);
+			std::filesystem::path mesh_path = std::format("{}/{}.ply", EXPORT_DIR, capture->name);
+			if (capture->data_pointer->save_mesh_ply(mesh_path)) {
+				Logger::log(std::format("Saved {} triangles to {}", capture->data_pointer->triangles().size() / 3, mesh_path.string()));
+			}
+			else {
+				Logger::log(std::format("Failed to save mesh to {}", mesh_path.string()), LoggingSeverity::Error);
+			}
+		}
+	}
+
+	if (capture->data_pointer) {
+		ImGui::Separator();
+		ImGui::Text("Downsampling");
+
+		float voxel_size = capture->data_pointer->voxel_size();
+		if (ImGui::SliderFloat("Voxel Size", &voxel_size, 0.f, 1.f)) {
+			capture->data_pointer->set_voxel_size(voxel_size);
+		}
+
+		ImGui::SameLine();
+
+		if (ImGui::Button("Apply##voxel")) {
+			if (capture->data_pointer->has_capture()) {
+				capture->data_pointer->rebuild(m_pipeline);
+				if (capture->data_pointer->has_support_plane()) {
+					capture->has_support_plane = true;
+					capture->support_plane = capture->data_pointer->support_plane();
+				}
+			}
+			else {
+				// loaded clouds can only be made coarser
+				capture->data_pointer->downsample(voxel_size);
+			}
+		}
+	}
+
+	if (capture->data_pointer) {
+		ImGui::Separator();
+		ImGui::Text("Outlier Removal");
+
+		Pointcloud* pointcloud = capture->data_pointer;
+		bool outlier_removal = pointcloud->outlier_removal();
+		if (ImGui::Checkbox("On Rebuild", &outlier_removal)) {
+			pointcloud->set_outlier_removal(outlier_removal);
+		}
+
+		int outlier_neighbors = pointcloud->outlier_neighbors();
+		if (ImGui::SliderInt("Neighbors", &outlier_neighbors, 2, 64)) {
+			pointcloud->set_outlier_neighbors(outlier_neighbors);
+		}
+
+		float outlier_stddev_mul = pointcloud->outlier_stddev_mul();
+		if (ImGui::SliderFloat("Std. Dev. Multiplier", &outlier_stddev_mul, .1f, 5.f)) {
+			pointcloud->set_outlier_stddev_mul(outlier_stddev_mul);
+		}
+
+		if (ImGui::Button("Apply##outliers")) {
+			pointcloud->remove_outliers();
+		}
+	}
+
 	ImGui::Separator();
 	ImGui::Text("ICP settings");
-	static int icp_max_iter = 50;
-	static float icp_max_corr_dist = 1.f;
-	ImGui::SliderInt("Max. Iterations", &icp_max_iter, 1, 500);
-	ImGui::SliderFloat("Max. Correspondence Distance", &icp_max_corr_dist, 0.01, 5.0);
+	render_registration_settings();
 
 	std::vector<std::string> items = m_capture_sequence.get_capturenames();
 	
@@ -1025,7 +1449,8 @@ void Application::render_edit_menu()
 		ImGui::EndCombo();
 	}
 
-	bool button_align_disabled = m_align_target_idx == -1;
+	const RegistrationJob* alignment = m_renderer.alignment_job();
+	bool button_align_disabled = m_align_target_idx == -1 || m_renderer.is_aligning();
 	{
 		if (button_align_disabled)
 			ImGui::BeginDisabled();
@@ -1033,7 +1458,7 @@ void Application::render_edit_menu()
 		if (ImGui::Button("Align")) {
 			auto target_capture = m_capture_sequence.capture_at_idx(m_align_target_idx);
 			Logger::log(std::format("source: {} -> target: {}", capture->name, target_capture->name));
-			m_renderer.align_pointclouds(icp_max_iter, icp_max_corr_dist, capture->data_pointer, target_capture->data_pointer);
+			m_renderer.start_alignment(m_registration_settings, capture->data_pointer, target_capture->data_pointer);
 			m_align_target_idx = -1;
 		}
 
@@ -1042,10 +1467,152 @@ void Application::render_edit_menu()
 	}
 
 	if (button_align_disabled && ImGui::BeginItemTooltip()) {
-		ImGui::Text("Select a target first");
+		ImGui::Text(m_renderer.is_aligning() ? "An alignment is running" : "Select a target first");
 		ImGui::EndTooltip();
 	}
 
+	// the job runs on the thread pool, this only shows what it has published so far
+	if (alignment) {
+		const RegistrationProgress& progress = alignment->progress();
+		const int level = progress.level;
+		const int first_level = alignment->settings().coarse_to_fine ? 0 : POINTCLOUD_ICP_PYRAMID_LEVELS;
+		const float voxel_size = RegistrationPyramid::voxel_size(level);
+
+		ImGui::Text(std::format("Aligning ({:.1f} s)", alignment->elapsed_ms() / 1000.).c_str());
+		ImGui::ProgressBar((float)(level - first_level) / (float)(POINTCLOUD_ICP_PYRAMID_LEVELS + 1 - first_level), ImVec2(-FLT_MIN, 0.f),
+			(voxel_size > 0.f ? std::format("{:.1f} cm grid", voxel_size * 10.f) : std::string("Full resolution")).c_str());
+		ImGui::Text(std::format("Iterations: {}, Fitness: {:.5f}", progress.iterations.load(), progress.fitness.load()).c_str());
+
+		if (alignment->is_cancelled())
+			ImGui::BeginDisabled();
+		if (ImGui::Button("Cancel")) {
+			m_renderer.cancel_alignment();
+		}
+		if (alignment->is_cancelled())
+			ImGui::EndDisabled();
+	}
+
 	ImGui::End();
 }
 
+void Application::render_registration_settings()
+{
+	int method = (int)m_registration_settings.method;
+	if (ImGui::Combo("Method", &method, "Point to Point\0Point to Plane\0Generalized\0")) {
+		m_registration_settings.method = (RegistrationMethod)method;
+	}
+	ImGui::SliderInt("Max. Iterations", &m_registration_settings.max_iterations, 1, 500);
+	ImGui::SliderFloat("Max. Correspondence Distance", &m_registration_settings.max_correspondence_distance, 0.01, 5.0);
+	ImGui::Checkbox("Coarse to Fine", &m_registration_settings.coarse_to_fine);
+	ImGui::SetItemTooltip("Aligns 4, 2 and 1 cm voxel grids before the full clouds, halving the correspondence distance per level");
+}
+
+void Application::render_align_all_menu()
+{
+	if (!m_align_all_open || m_app_state != AppState::Pointcloud)
+		return;
+
+	ImGui::Begin(
+		"Align All",
+		&m_align_all_open,
+		ImGuiWindowFlags_NoMove |
+		ImGuiWindowFlags_NoResize |
+		ImGuiWindowFlags_AlwaysAutoResize
+	);
+	ImGui::SetWindowPos({ (float)m_window_width - ImGui::GetWindowWidth(), 0.f });
+
+	// the visible clouds in list order, the sparse COLMAP reconstruction lives in its own frame
+	std::vector<Pointcloud*> clouds;
+	std::vector<std::string> names;
+	for (auto capture : m_capture_sequence.captures()) {
+		if (!capture->is_selected || !capture->data_pointer || capture->data_pointer->is_colmap())
+			continue;
+
+		clouds.push_back(capture->data_pointer);
+		names.push_back(capture->name);
+	}
+
+	int mode = (int)m_align_all_mode;
+	if (ImGui::Combo("Reference", &mode, "Predecessor\0Merged Model\0")) {
+		m_align_all_mode = (BatchAlignmentMode)mode;
+	}
+	ImGui::SetItemTooltip("Predecessor aligns all pairs in parallel, Merged Model aligns one capture after the other onto all before it");
+	render_registration_settings();
+
+	const bool button_align_disabled = m_renderer.is_aligning() || clouds.size() < 2;
+	{
+		if (button_align_disabled)
+			ImGui::BeginDisabled();
+
+		if (ImGui::Button(std::format("Align {} captures", clouds.size()).c_str())) {
+			m_renderer.start_batch_alignment(m_registration_settings, m_align_all_mode, clouds, names);
+		}
+
+		if (button_align_disabled)
+			ImGui::EndDisabled();
+	}
+
+	if (button_align_disabled && ImGui::BeginItemTooltip()) {
+		ImGui::Text(m_renderer.is_aligning() ? "An alignment is running" : "Needs at least two visible captures");
+		ImGui::EndTooltip();
+	}
+
+	const RegistrationBatch* batch = m_renderer.alignment_batch();
+	if (!batch) {
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Separator();
+
+	const size_t pair_count = batch->pairs().size();
+	if (!batch->is_applied()) {
+		const size_t finished = batch->finished_pairs();
+		ImGui::ProgressBar((float)finished / (float)pair_count, ImVec2(-FLT_MIN, 0.f), std::format("{}/{} pairs, {:.1f} s", finished, pair_count, batch->elapsed_ms() / 1000.).c_str());
+
+		if (batch->is_cancelled())
+			ImGui::BeginDisabled();
+		if (ImGui::Button("Cancel")) {
+			m_renderer.cancel_alignment();
+		}
+		if (batch->is_cancelled())
+			ImGui::EndDisabled();
+	}
+	else {
+		ImGui::Text(std::format("{} ({}) {} after {:.2f} s", RegistrationBatch::mode_name(batch->mode()), pair_count, batch->is_cancelled() ? "cancelled, nothing applied," : "applied", batch->elapsed_ms() / 1000.).c_str());
+	}
+
+	// running pairs show their live progress, finished ones their result
+	const float row_height = ImGui::GetTextLineHeightWithSpacing();
+	const ImGuiTableFlags table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingFixedFit;
+	if (ImGui::BeginTable("Pairs", 5, table_flags, ImVec2(0.f, row_height * (float)(std::min<size_t>(pair_count, 12) + 1) + 4.f))) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Pair");
+		ImGui::TableSetupColumn("Status");
+		ImGui::TableSetupColumn("Iterations");
+		ImGui::TableSetupColumn("Fitness");
+		ImGui::TableSetupColumn("Time [ms]");
+		ImGui::TableHeadersRow();
+
+		for (const auto& pair : batch->pairs()) {
+			const bool finished = pair->finished;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(pair->name.c_str());
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(RegistrationBatch::pair_status(*pair));
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", finished ? pair->result.iterations : pair->progress.iterations.load());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.6f", finished ? pair->result.fitness : pair->progress.fitness.load());
+			ImGui::TableNextColumn();
+			if (finished)
+				ImGui::Text("%.2f", pair->time_ms);
+			else
+				ImGui::TextDisabled("-");
+		}
+		ImGui::EndTable();
+	}
+
+	ImGui::End();
+}
@@ -11,6 +11,8 @@
 #include "PointcloudRenderer.h"
 #include "CameraCaptureSequence.h"
 #include "K4ADeviceSelector.h"
+#include "DepthAccumulator.h"
+#include "PointcloudPipeline.h"
 
 
 #pragma once
@@ -38,6 +40,10 @@ private:
 	bool init_gui();
 	void terminate_gui();
 
+	void add_capture(const k4a::image& depth_image, const k4a::image& color_image, const glm::quat& orientation);
+	void accumulate_capture();
+	void pick_component_seed();
+
 	void before_frame();
 	void after_frame();
 	void render();
@@ -47,7 +53,11 @@ private:
 	void render_console();
 	void render_content();
 	void render_menu();
+	void render_pipeline_menu();
+	void render_camera_mode();
 	void render_edit_menu();
+	void render_registration_settings();
+	void render_align_all_menu();
 	
 
 private:
@@ -60,14 +70,31 @@ private:
 	int m_selected_edit_idx = -1;
 	int m_align_target_idx = -1;
 	bool m_render_menu_open = false;
+	// leaf size the COLMAP cloud is downsampled to on import
+	float m_colmap_voxel_size = POINTCLOUD_DEFAULT_VOXEL_SIZE;
+
+	// ICP settings, shared by the edit menu and the batch alignment
+	RegistrationSettings m_registration_settings;
+	bool m_align_all_open = false;
+	BatchAlignmentMode m_align_all_mode = BatchAlignmentMode::Predecessor;
 
 	PointcloudRenderer m_renderer;
+	PointcloudPipeline m_pipeline;
 	CameraCaptureSequence m_capture_sequence;
 
 	GLFWwindow* m_window = nullptr;
 
 	Camera m_camera;
+	CameraMode m_camera_mode;
 	K4ADeviceSelector m_k4a_device_selector;
+
+	// temporal capture, averages the depth of several consecutive frames
+	int m_temporal_frames = CAPTURE_TEMPORAL_DEFAULT_FRAMES;
+	DepthAccumulationMode m_temporal_mode = DepthAccumulationMode::Mean;
+	DepthAccumulator m_depth_accumulator;
+	uint64_t m_accumulated_frame_index = 0;
+	k4a::image m_accumulated_color_image;
+	glm::quat m_accumulated_orientation = glm::quat(1, 0, 0, 0);
 	
 	// ImGui file dialogs
 	ImGui::FileBrowser m_save_dialog;
@@ -2,6 +2,7 @@
 
 #include "Helpers.h"
 #include "Structs.h"
+#include "ImageAllocator.h"
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -27,12 +28,13 @@ Camera::~Camera()
 	on_terminate();
 }
 
-bool Camera::on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx, int width, int height)
+bool Camera::on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx, int width, int height, const CameraMode& mode)
 {
 	m_device = device;
 	m_queue = queue;
 	m_width = width;
 	m_height = height;
+	m_mode = mode;
 	
 	const uint32_t device_count = k4a::device::get_installed_count();
 	if (device_count < 1)
@@ -41,13 +43,6 @@ bool Camera::on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx,
 		return false;
 	}
 
-	k4a_device_configuration_t config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
-	config.camera_fps = K4A_FRAMES_PER_SECOND_30;
-	config.depth_mode = POINTCLOUD_DEPTH_MODE;
-	config.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32;
-	config.color_resolution = POINTCLOUD_COLOR_RESOLUTION;
-	config.synchronized_images_only = true;
-
 	Logger::log("Started opening k4a device...");
 
 	m_k4a_device = k4a::device::open(k4a_device_idx);
@@ -56,38 +51,95 @@ bool Camera::on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx,
 		return false;
 	}
 	Logger::log(std::format("Got k4a device: {}", (void*)&m_k4a_device));
-	m_k4a_device.start_cameras(&config);
+	if (!start_cameras()) {
+		m_k4a_device.close();
+		return false;
+	}
 	m_k4a_device.start_imu();
 	m_k4a_serial_number = m_k4a_device.get_serialnum();
 
-	m_calibration = m_k4a_device.get_calibration(config.depth_mode, config.color_resolution);
-
 	Logger::log("Finished opening k4a device.");
 
-	glm::uvec2 color_texture_dims;
-	switch (config.color_resolution) {
-		case K4A_COLOR_RESOLUTION_720P:
-			color_texture_dims = { 1280, 720 };
-			break;
-		case K4A_COLOR_RESOLUTION_1080P:
-			color_texture_dims = { 1920, 1080 };
-			break;
-		case K4A_COLOR_RESOLUTION_1440P:
-			color_texture_dims = { 2560, 1440 };
-			break;
-		case K4A_COLOR_RESOLUTION_1536P:
-			color_texture_dims = { 2048, 1536 };
-			break;
-		case K4A_COLOR_RESOLUTION_2160P:
-			color_texture_dims = { 3840, 2160 };
-			break;
-		case K4A_COLOR_RESOLUTION_3072P:
-			color_texture_dims = { 4096, 3072 };
-			break;
-		default:
-			break;
+	if (!create_buffers())
+		return false;
+
+	m_initialized = true;
+	
+	return true;
+}
+
+bool Camera::set_mode(const CameraMode& mode)
+{
+	if (!m_initialized) {
+		m_mode = mode;
+		return true;
 	}
 
+	if (mode == m_mode)
+		return true;
+
+	m_k4a_device.stop_cameras();
+	m_mode = mode;
+
+	// frames of the old mode do not match the new calibration
+	m_color_image.reset();
+	m_depth_image.reset();
+	m_has_clicked_pixel = false;
+
+	// the cached blocks are sized for the old mode, captured frames keep theirs until they are freed
+	ImageAllocator::release_cached();
+
+	if (!start_cameras() || !create_buffers()) {
+		on_terminate();
+		return false;
+	}
+	return true;
+}
+
+bool Camera::start_cameras()
+{
+	const k4a_fps_t fps = max_fps(m_mode);
+	if (m_mode.fps == K4A_FRAMES_PER_SECOND_30 && fps != K4A_FRAMES_PER_SECOND_30) {
+		Logger::log("The selected sensor mode only supports up to 15 fps.", LoggingSeverity::Warning);
+		m_mode.fps = fps;
+	}
+
+	k4a_device_configuration_t config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
+	config.camera_fps = m_mode.fps;
+	config.depth_mode = m_mode.depth_mode;
+	config.color_format = K4A_IMAGE_FORMAT_COLOR_BGRA32;
+	config.color_resolution = m_mode.color_resolution;
+	config.synchronized_images_only = true;
+
+	try {
+		m_k4a_device.start_cameras(&config);
+	}
+	catch (const k4a::error& e) {
+		Logger::log(std::format("Could not start cameras: {}", e.what()), LoggingSeverity::Error);
+		return false;
+	}
+
+	m_calibration = m_k4a_device.get_calibration(config.depth_mode, config.color_resolution);
+
+	const glm::uvec2 color_dims = color_resolution_dims(m_mode.color_resolution);
+	const glm::uvec2 depth_dims = depth_mode_dims(m_mode.depth_mode);
+	Logger::log(std::format("Started cameras: depth {}x{}, color {}x{}", depth_dims.x, depth_dims.y, color_dims.x, color_dims.y));
+	return true;
+}
+
+bool Camera::create_buffers()
+{
+	release_buffers();
+
+	const glm::uvec2 color_texture_dims = color_resolution_dims(m_mode.color_resolution);
+	const glm::uvec2 depth_texture_dims = depth_mode_dims(m_mode.depth_mode);
+
+	wgpu::SupportedLimits limits;
+	m_device.getLimits(&limits);
+	if (color_texture_dims.x > limits.limits.maxTextureDimension2D || color_texture_dims.y > limits.limits.maxTextureDimension2D) {
+		Logger::log(std::format("Color resolution {}x{} exceeds the device texture limit of {}", color_texture_dims.x, color_texture_dims.y, limits.limits.maxTextureDimension2D), LoggingSeverity::Error);
+		return false;
+	}
 
 	wgpu::BufferDescriptor pixelbuffer_desc = {};
 	pixelbuffer_desc.mappedAtCreation = false;
@@ -99,29 +151,6 @@ bool Camera::on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx,
 	m_color_texture = Texture(m_device, m_queue, &m_pixelbuffer, pixelbuffer_desc.size, color_texture_dims.x, color_texture_dims.y, wgpu::TextureFormat::BGRA8Unorm);
 	Logger::log(std::format("Camera color texture: {}", (void*)&m_color_texture));
 
-
-	glm::uvec2 depth_texture_dims;
-	switch (config.depth_mode) {
-		case K4A_DEPTH_MODE_NFOV_2X2BINNED:
-			depth_texture_dims = { 320, 288 };
-			break;
-		case K4A_DEPTH_MODE_NFOV_UNBINNED:
-			depth_texture_dims = { 640, 576 };
-			break;
-		case K4A_DEPTH_MODE_WFOV_2X2BINNED:
-			depth_texture_dims = { 512, 512 };
-			break;
-		case K4A_DEPTH_MODE_WFOV_UNBINNED:
-			depth_texture_dims = { 1024, 1024 };
-			break;
-		case K4A_DEPTH_MODE_PASSIVE_IR:
-			depth_texture_dims = { 1024, 1024 };
-			break;
-		case K4A_DEPTH_MODE_OFF:
-		default:
-			break;
-	}
-
 	wgpu::BufferDescriptor depthbuffer_desc = {};
 	depthbuffer_desc.mappedAtCreation = false;
 	depthbuffer_desc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
@@ -133,11 +162,69 @@ bool Camera::on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx,
 	}
 	Logger::log(std::format("Save image depth buffer: {}", (void*)&m_depthbuffer));
 
-	m_initialized = true;
-	
 	return true;
 }
 
+void Camera::release_buffers()
+{
+	if (m_pixelbuffer) {
+		m_pixelbuffer.destroy();
+		m_pixelbuffer.release();
+		m_pixelbuffer = nullptr;
+	}
+	if (m_depthbuffer) {
+		m_depthbuffer.destroy();
+		m_depthbuffer.release();
+		m_depthbuffer = nullptr;
+	}
+}
+
+k4a_fps_t Camera::max_fps(const CameraMode& mode)
+{
+	if (mode.depth_mode == K4A_DEPTH_MODE_WFOV_UNBINNED || mode.color_resolution == K4A_COLOR_RESOLUTION_3072P)
+		return mode.fps == K4A_FRAMES_PER_SECOND_30 ? K4A_FRAMES_PER_SECOND_15 : mode.fps;
+
+	return mode.fps;
+}
+
+glm::uvec2 Camera::color_resolution_dims(k4a_color_resolution_t color_resolution)
+{
+	switch (color_resolution) {
+		case K4A_COLOR_RESOLUTION_720P:
+			return { 1280, 720 };
+		case K4A_COLOR_RESOLUTION_1080P:
+			return { 1920, 1080 };
+		case K4A_COLOR_RESOLUTION_1440P:
+			return { 2560, 1440 };
+		case K4A_COLOR_RESOLUTION_1536P:
+			return { 2048, 1536 };
+		case K4A_COLOR_RESOLUTION_2160P:
+			return { 3840, 2160 };
+		case K4A_COLOR_RESOLUTION_3072P:
+			return { 4096, 3072 };
+		default:
+			return { 0, 0 };
+	}
+}
+
+glm::uvec2 Camera::depth_mode_dims(k4a_depth_mode_t depth_mode)
+{
+	switch (depth_mode) {
+		case K4A_DEPTH_MODE_NFOV_2X2BINNED:
+			return { 320, 288 };
+		case K4A_DEPTH_MODE_NFOV_UNBINNED:
+			return { 640, 576 };
+		case K4A_DEPTH_MODE_WFOV_2X2BINNED:
+			return { 512, 512 };
+		case K4A_DEPTH_MODE_WFOV_UNBINNED:
+		case K4A_DEPTH_MODE_PASSIVE_IR:
+			return { 1024, 1024 };
+		case K4A_DEPTH_MODE_OFF:
+		default:
+			return { 0, 0 };
+	}
+}
+
 void Camera::on_frame()
 {
 	if (!m_initialized)
@@ -147,6 +234,7 @@ void Camera::on_frame()
 	if (m_k4a_device.get_capture(&capture, std::chrono::milliseconds(0))) {
 		m_color_image = capture.get_color_image();
 		m_depth_image = capture.get_depth_image();
+		m_frame_index++;
 
 		m_color_texture.update(reinterpret_cast<const BgraPixel*>(m_color_image.get_buffer()));
 
@@ -174,11 +262,31 @@ void Camera::on_frame()
 	ImGui::SetCursorPos({ (viewport_dims.x - image_dims.x) * .5f + 7, (viewport_dims.y - image_dims.y) * .5f + 7 });
 	ImGui::Image((ImTextureID)(intptr_t)m_color_texture.view(), image_dims);
 
+	if (ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+		ImVec2 image_min = ImGui::GetItemRectMin();
+		ImVec2 mouse_pos = ImGui::GetMousePos();
+		m_clicked_pixel = {
+			(mouse_pos.x - image_min.x) / image_dims.x * m_color_texture.width(),
+			(mouse_pos.y - image_min.y) / image_dims.y * m_color_texture.height()
+		};
+		m_has_clicked_pixel = true;
+	}
+
 	// draw_gizmos();
 
 	ImGui::End();
 }
 
+bool Camera::pop_clicked_pixel(glm::vec2& pixel)
+{
+	if (!m_has_clicked_pixel)
+		return false;
+
+	pixel = m_clicked_pixel;
+	m_has_clicked_pixel = false;
+	return true;
+}
+
 void Camera::on_terminate()
 {
 	if (m_k4a_device) {
@@ -187,6 +295,7 @@ void Camera::on_terminate()
 		m_k4a_device.close();
 	}
 	m_initialized = false;
+	ImageAllocator::release_cached();
 }
 
 bool Camera::is_initialized()
@@ -1,15 +1,26 @@
 #include <k4a/k4a.hpp>
 #include <webgpu/webgpu.hpp>
+#include <glm/glm.hpp>
 
 #include "Texture.h"
+#include "Structs.h"
 
 #pragma once
+
+struct CameraMode {
+	k4a_depth_mode_t depth_mode = CAMERA_DEFAULT_DEPTH_MODE;
+	k4a_color_resolution_t color_resolution = CAMERA_DEFAULT_COLOR_RESOLUTION;
+	k4a_fps_t fps = CAMERA_DEFAULT_FPS;
+
+	bool operator==(const CameraMode&) const = default;
+};
+
 class Camera
 {
 public:
 	Camera();
 	~Camera();
-	bool on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx, int width, int height);
+	bool on_init(wgpu::Device device, wgpu::Queue queue, int k4a_device_idx, int width, int height, const CameraMode& mode = CameraMode());
 	void on_frame();
 	void on_terminate();
 	bool is_initialized();
@@ -41,8 +52,33 @@ public:
 		return m_k4a_serial_number;
 	}
 
+	// increases whenever on_frame received a new capture
+	inline uint64_t frame_index() {
+		return m_frame_index;
+	}
+
+	// last click on the camera image in color image pixels, returns false if there was none since the last call
+	bool pop_clicked_pixel(glm::vec2& pixel);
+
+	// restarts the cameras of an open device in the new mode and resizes the buffers and textures
+	bool set_mode(const CameraMode& mode);
+
+	inline const CameraMode& mode() {
+		return m_mode;
+	}
+
+	// the sensor only supports 30 fps if neither wfov unbinned nor 3072p is used
+	static k4a_fps_t max_fps(const CameraMode& mode);
+	static glm::uvec2 color_resolution_dims(k4a_color_resolution_t color_resolution);
+	static glm::uvec2 depth_mode_dims(k4a_depth_mode_t depth_mode);
+
 private:
+	bool start_cameras();
+	bool create_buffers();
+	void release_buffers();
+
 	bool m_initialized = false;
+	CameraMode m_mode;
 	int m_width;
 	int m_height;
 
@@ -58,6 +94,9 @@ private:
 	k4a::image m_depth_image;
 	k4a::image m_color_image;
 	k4a::calibration m_calibration;
+	uint64_t m_frame_index = 0;
+	bool m_has_clicked_pixel = false;
+	glm::vec2 m_clicked_pixel = glm::vec2(0.f);
 	glm::mat4 m_delta_transform = glm::mat4(1.f);
 	glm::quat m_orientation = glm::quat(1, 0, 0, 0);
 	glm::vec3 m_position = glm::vec3(0.f);
@@ -65,7 +65,7 @@ void CameraCaptureSequence::save_images(std::filesystem::path images_dir_path, b
 	
 	int i = 0;
 	for (auto& capture : m_captures) {
-		if (capture->is_colmap)
+		if (!capture->has_images)
 			continue;
 
 		std::string path = std::format("{}/{}.png", images_dir_path.string(), capture->name);
@@ -105,7 +105,7 @@ void CameraCaptureSequence::save_cameras_extrinsics(std::filesystem::path path)
 	}
 
 	for (const auto& capture : m_captures) {
-		if (capture->is_colmap) {
+		if (!capture->has_images) {
 			continue;
 		}
 
@@ -168,7 +168,7 @@ void CameraCaptureSequence::remove_capture(CameraCapture* capture)
 bool CameraCaptureSequence::save_sequence(const std::filesystem::path path)
 {
 	for (auto const &capture : m_captures) {
-		if (capture->is_colmap) {
+		if (!capture->has_images) {
 			continue;
 		}
 
@@ -208,6 +208,9 @@ bool CameraCaptureSequence::save_sequence(const std::filesystem::path path)
 
 		Helper::write_binary(ofs, capture->camera_orientation);
 
+		Helper::write_binary(ofs, capture->has_support_plane);
+		Helper::write_binary(ofs, capture->support_plane);
+
 		ofs.close();
 	}
 
@@ -237,15 +240,20 @@ bool CameraCaptureSequence::load_sequence(const std::vector<std::filesystem::pat
 		Helper::read_binary(ifs, depth_width);
 		Helper::read_binary(ifs, depth_height);
 		Helper::read_binary(ifs, depth_size);
-		std::vector<uint8_t> depth_buffer(depth_size);
-		ifs.read(reinterpret_cast<char*>(depth_buffer.data()), depth_size);
+		// the images are written without padding, anything else is a corrupt or foreign file
+		if (!ifs || depth_width <= 0 || depth_height <= 0 || (size_t)depth_size != (size_t)depth_width * depth_height * sizeof(uint16_t)) {
+			Logger::log(std::format("Skipped {}, its depth image size does not match.", path.string()), LoggingSeverity::Error);
+			delete capture;
+			continue;
+		}
 		capture->depth_image = k4a::image::create(
 			K4A_IMAGE_FORMAT_DEPTH16,
 			depth_width,
 			depth_height,
 			depth_width * sizeof(uint16_t)
 		);
-		memcpy(capture->depth_image.get_buffer(), depth_buffer.data(), depth_buffer.size());
+		// read straight into the (pooled) image buffer
+		ifs.read(reinterpret_cast<char*>(capture->depth_image.get_buffer()), depth_size);
 
 		// color image
 		int color_width;
@@ -254,23 +262,41 @@ bool CameraCaptureSequence::load_sequence(const std::vector<std::filesystem::pat
 		Helper::read_binary(ifs, color_width);
 		Helper::read_binary(ifs, color_height);
 		Helper::read_binary(ifs, color_size);
-		std::vector<uint8_t> color_buffer(color_size);
-		ifs.read(reinterpret_cast<char*>(color_buffer.data()), color_size);
+		if (!ifs || color_width <= 0 || color_height <= 0 || (size_t)color_size != (size_t)color_width * color_height * 4) {
+			Logger::log(std::format("Skipped {}, its color image size does not match.", path.string()), LoggingSeverity::Error);
+			delete capture;
+			continue;
+		}
 		capture->color_image = k4a::image::create(
 			K4A_IMAGE_FORMAT_COLOR_BGRA32,
 			color_width,
 			color_height,
 			color_width * 4
 		);
-		memcpy(capture->color_image.get_buffer(), color_buffer.data(), color_buffer.size());
+		ifs.read(reinterpret_cast<char*>(capture->color_image.get_buffer()), color_size);
 
 		k4a_calibration_t calibration;
 		Helper::read_binary(ifs, calibration);
+		if (!ifs) {
+			Logger::log(std::format("Skipped {}, the file is truncated.", path.string()), LoggingSeverity::Error);
+			delete capture;
+			continue;
+		}
 		capture->calibration = k4a::calibration(calibration);
 
 		Helper::read_binary(ifs, capture->transform);
 		Helper::read_binary(ifs, capture->camera_orientation);
 
+		// optional, older captures end here
+		bool has_support_plane = false;
+		glm::vec4 support_plane;
+		Helper::read_binary(ifs, has_support_plane);
+		Helper::read_binary(ifs, support_plane);
+		if (ifs && has_support_plane) {
+			capture->has_support_plane = true;
+			capture->support_plane = support_plane;
+		}
+
 		capture->data_pointer = nullptr;
 
 		ifs.close();
@@ -17,13 +17,18 @@ public:
 	std::string name;
 	bool is_selected = false;
 	bool is_colmap = false;
+	// false for clouds imported without a capture (COLMAP, saved point clouds), they have no images
+	bool has_images = true;
 	bool is_expanded = false;
 	k4a::image depth_image;
 	k4a::image color_image;
 	k4a::calibration calibration;
 	glm::mat4 transform;
 	glm::quat camera_orientation;
-	Pointcloud* data_pointer;
+	// support plane of the point cloud, reused as RANSAC prior when the cloud is rebuilt
+	bool has_support_plane = false;
+	glm::vec4 support_plane = glm::vec4(0.f);
+	Pointcloud* data_pointer = nullptr;
 	Texture preview_image;
 };
 
@@ -0,0 +1,238 @@
+#include "DepthAccumulator.h"
+
+#include "Helpers.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <format>
+
+#if defined(__AVX2__)
+#define DEPTH_ACCUMULATOR_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DEPTH_ACCUMULATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+void DepthAccumulator::begin(int width, int height, int frame_count, DepthAccumulationMode mode)
+{
+	const size_t pixel_count = (size_t)width * height;
+
+	m_active = true;
+	m_width = width;
+	m_height = height;
+	const int max_frames = mode == DepthAccumulationMode::Median ? CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES : CAPTURE_TEMPORAL_MAX_FRAMES;
+	m_frame_count = std::clamp(frame_count, 1, max_frames);
+	if (m_frame_count < frame_count) {
+		Logger::log(std::format("Temporal filter limited to {} frames.", m_frame_count), LoggingSeverity::Warning);
+	}
+	m_frames_added = 0;
+	m_mode = mode;
+	m_rejected_pixels = 0;
+
+	// sized once per capture, add_frame does not allocate
+	m_reference.assign(pixel_count, 0);
+	m_sum.assign(pixel_count, 0.f);
+	m_sum_sq.assign(pixel_count, 0.f);
+	m_count.assign(pixel_count, 0);
+	if (m_mode == DepthAccumulationMode::Median) {
+		m_frames.resize(pixel_count * m_frame_count);
+	}
+	else {
+		m_frames.clear();
+		m_frames.shrink_to_fit();
+	}
+}
+
+void DepthAccumulator::reset()
+{
+	m_active = false;
+	m_frames_added = 0;
+}
+
+bool DepthAccumulator::add_frame(const uint16_t* depth_data, int width, int height, int stride_bytes)
+{
+	if (!m_active || is_complete())
+		return is_complete();
+
+	if (width != m_width || height != m_height) {
+		Logger::log(std::format("Depth frame size changed during accumulation ({}x{} -> {}x{}).", m_width, m_height, width, height), LoggingSeverity::Error);
+		reset();
+		return false;
+	}
+
+	const size_t row_stride = stride_bytes > 0 ? stride_bytes / sizeof(uint16_t) : (size_t)width;
+	const size_t pixel_count = (size_t)width * height;
+
+	for (int y = 0; y < height; y++) {
+		accumulate_row(depth_data + y * row_stride, (size_t)y * width);
+	}
+
+	if (m_mode == DepthAccumulationMode::Median) {
+		uint16_t* frame = m_frames.data() + pixel_count * m_frames_added;
+		for (int y = 0; y < height; y++) {
+			std::memcpy(frame + (size_t)y * width, depth_data + y * row_stride, width * sizeof(uint16_t));
+		}
+	}
+
+	m_frames_added++;
+	return is_complete();
+}
+
+bool DepthAccumulator::add_frame(const k4a::image& depth_image)
+{
+	if (!depth_image || depth_image.get_format() != K4A_IMAGE_FORMAT_DEPTH16) {
+		Logger::log("Tried to accumulate an invalid depth image.", LoggingSeverity::Error);
+		return false;
+	}
+
+	return add_frame(
+		reinterpret_cast<const uint16_t*>(depth_image.get_buffer()),
+		depth_image.get_width_pixels(),
+		depth_image.get_height_pixels(),
+		depth_image.get_stride_bytes()
+	);
+}
+
+void DepthAccumulator::accumulate_row(const uint16_t* depth_row, size_t pixel_begin)
+{
+	// the first valid sample of a pixel becomes its reference, a pixel that is 0 in the first frame
+	// would otherwise accumulate full depths and lose the float precision
+	uint16_t* reference = m_reference.data() + pixel_begin;
+	float* sum = m_sum.data() + pixel_begin;
+	float* sum_sq = m_sum_sq.data() + pixel_begin;
+	int32_t* count = m_count.data() + pixel_begin;
+
+	size_t x = 0;
+#if defined(DEPTH_ACCUMULATOR_AVX2)
+	const __m256i zero = _mm256_setzero_si256();
+	for (; x + 8 <= (size_t)m_width; x += 8) {
+		const __m256i depth = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(depth_row + x)));
+		const __m256i old_count = _mm256_loadu_si256((const __m256i*)(count + x));
+		__m256i ref = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(reference + x)));
+		const __m256i valid = _mm256_cmpgt_epi32(depth, zero);
+		const __m256i first = _mm256_and_si256(valid, _mm256_cmpeq_epi32(old_count, zero));
+		if (!_mm256_testz_si256(first, first)) {
+			ref = _mm256_blendv_epi8(ref, depth, first);
+			// the packs work per 128 bit lane, the permute joins the two low halves
+			const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(ref, ref), 0x08);
+			_mm_storeu_si128((__m128i*)(reference + x), _mm256_castsi256_si128(packed));
+		}
+		const __m256 delta = _mm256_and_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(depth, ref)), _mm256_castsi256_ps(valid));
+
+		_mm256_storeu_ps(sum + x, _mm256_add_ps(_mm256_loadu_ps(sum + x), delta));
+		_mm256_storeu_ps(sum_sq + x, _mm256_add_ps(_mm256_loadu_ps(sum_sq + x), _mm256_mul_ps(delta, delta)));
+		// valid lanes are -1
+		_mm256_storeu_si256((__m256i*)(count + x), _mm256_sub_epi32(old_count, valid));
+	}
+#elif defined(DEPTH_ACCUMULATOR_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; x + 4 <= (size_t)m_width; x += 4) {
+		const __m128i depth = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(depth_row + x)), zero);
+		const __m128i old_count = _mm_loadu_si128((const __m128i*)(count + x));
+		__m128i ref = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(reference + x)), zero);
+		const __m128i valid = _mm_cmpgt_epi32(depth, zero);
+		const __m128i first = _mm_and_si128(valid, _mm_cmpeq_epi32(old_count, zero));
+		if (_mm_movemask_epi8(first) != 0) {
+			ref = _mm_or_si128(_mm_and_si128(first, depth), _mm_andnot_si128(first, ref));
+			// SSE2 only packs signed, so the values are moved into the int16 range and back
+			const __m128i bias = _mm_set1_epi32(32768);
+			const __m128i packed = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(ref, bias), _mm_sub_epi32(ref, bias)), _mm_set1_epi16((short)0x8000));
+			_mm_storel_epi64((__m128i*)(reference + x), packed);
+		}
+		const __m128 delta = _mm_and_ps(_mm_cvtepi32_ps(_mm_sub_epi32(depth, ref)), _mm_castsi128_ps(valid));
+
+		_mm_storeu_ps(sum + x, _mm_add_ps(_mm_loadu_ps(sum + x), delta));
+		_mm_storeu_ps(sum_sq + x, _mm_add_ps(_mm_loadu_ps(sum_sq + x), _mm_mul_ps(delta, delta)));
+		_mm_storeu_si128((__m128i*)(count + x), _mm_sub_epi32(old_count, valid));
+	}
+#endif
+
+	for (; x < (size_t)m_width; x++) {
+		if (depth_row[x] == 0)
+			continue;
+
+		if (count[x] == 0) {
+			reference[x] = depth_row[x];
+		}
+		const float delta = (float)((int32_t)depth_row[x] - (int32_t)reference[x]);
+		sum[x] += delta;
+		sum_sq[x] += delta * delta;
+		count[x]++;
+	}
+}
+
+uint16_t DepthAccumulator::resolve_pixel(size_t i, int min_count)
+{
+	const int32_t count = m_count[i];
+	if (count < min_count)
+		return 0;
+
+	const float mean_delta = m_sum[i] / count;
+	const float variance = std::max(m_sum_sq[i] / count - mean_delta * mean_delta, 0.f);
+	const float mean = m_reference[i] + mean_delta;
+
+	const float max_stddev = CAPTURE_TEMPORAL_MAX_STDDEV_MM + CAPTURE_TEMPORAL_MAX_STDDEV_RELATIVE * mean;
+	if (variance > max_stddev * max_stddev)
+		return 0;
+
+	if (m_mode == DepthAccumulationMode::Mean)
+		return (uint16_t)std::clamp<long>(std::lround(mean), 1, 65535);
+
+	// median of the valid samples
+	const size_t pixel_count = (size_t)m_width * m_height;
+	std::array<uint16_t, CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES> samples;
+	int n = 0;
+	for (int f = 0; f < m_frames_added; f++) {
+		const uint16_t depth = m_frames[pixel_count * f + i];
+		if (depth != 0) {
+			samples[n++] = depth;
+		}
+	}
+
+	std::nth_element(samples.begin(), samples.begin() + n / 2, samples.begin() + n);
+	return samples[n / 2];
+}
+
+k4a::image DepthAccumulator::result()
+{
+	if (!is_complete()) {
+		Logger::log("Tried to resolve an incomplete depth accumulation.", LoggingSeverity::Error);
+		return k4a::image();
+	}
+
+	k4a::image image = k4a::image::create(
+		K4A_IMAGE_FORMAT_DEPTH16,
+		m_width,
+		m_height,
+		m_width * sizeof(uint16_t)
+	);
+	uint16_t* out = reinterpret_cast<uint16_t*>(image.get_buffer());
+
+	const int min_count = std::max(1, (int)std::ceil(m_frames_added * CAPTURE_TEMPORAL_MIN_VALID_FRACTION));
+	const size_t tile_count = (m_height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<size_t> tile_rejected(tile_count, 0);
+
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t row_begin = tile * POINTCLOUD_TILE_ROWS;
+		const size_t row_end = std::min<size_t>(row_begin + POINTCLOUD_TILE_ROWS, m_height);
+
+		size_t rejected = 0;
+		for (size_t i = row_begin * m_width; i < row_end * m_width; i++) {
+			out[i] = resolve_pixel(i, min_count);
+			// only count pixels that had any depth to begin with
+			rejected += out[i] == 0 && m_count[i] > 0;
+		}
+		tile_rejected[tile] = rejected;
+	});
+
+	m_rejected_pixels = 0;
+	for (size_t rejected : tile_rejected) {
+		m_rejected_pixels += rejected;
+	}
+
+	return image;
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include <k4a/k4a.hpp>
+
+#include "Structs.h"
+
+#pragma once
+
+// Averages N consecutive DEPTH16 frames into one denoised frame. Per pixel it keeps the
+// running sum and sum of squares of the valid samples (relative to the first valid sample of
+// the pixel, so the float accumulators stay exact), and optionally the whole frame stack for
+// the median.
+// Pixels that were valid in too few frames or whose temporal standard deviation is too high
+// are set to 0. Frames come in as raw buffers, so recorded frames can be replayed as well.
+// The median stores the whole stack, so its window is capped at CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES.
+class DepthAccumulator {
+public:
+	// `frame_count` is clamped to the maximum window of the mode
+	void begin(int width, int height, int frame_count, DepthAccumulationMode mode);
+	void reset();
+
+	// returns true once `frame_count` frames have been added
+	bool add_frame(const uint16_t* depth_data, int width, int height, int stride_bytes = 0);
+	bool add_frame(const k4a::image& depth_image);
+
+	// denoised DEPTH16 image, only valid after all frames were added
+	k4a::image result();
+
+	inline bool is_active() const {
+		return m_active;
+	}
+
+	inline bool is_complete() const {
+		return m_active && m_frames_added >= m_frame_count;
+	}
+
+	inline int frames_added() const {
+		return m_frames_added;
+	}
+
+	inline int frame_count() const {
+		return m_frame_count;
+	}
+
+	// pixels dropped by the last result() because of variance or missing samples
+	inline size_t rejected_pixels() const {
+		return m_rejected_pixels;
+	}
+
+private:
+	void accumulate_row(const uint16_t* depth_row, size_t pixel_begin);
+	uint16_t resolve_pixel(size_t i, int min_count);
+
+	bool m_active = false;
+	int m_width = 0;
+	int m_height = 0;
+	int m_frame_count = 0;
+	int m_frames_added = 0;
+	DepthAccumulationMode m_mode = DepthAccumulationMode::Mean;
+	size_t m_rejected_pixels = 0;
+
+	std::vector<uint16_t> m_reference;
+	std::vector<float> m_sum;
+	std::vector<float> m_sum_sq;
+	std::vector<int32_t> m_count;
+	std::vector<uint16_t> m_frames; // median only, frame after frame
+};
@@ -8,7 +8,7 @@ void Logger::log(std::string message, LoggingSeverity severity)
 	return;
 #endif
 
-	
+	std::lock_guard<std::mutex> lock(s_mutex);
 
 	switch (severity) {
 		case LoggingSeverity::Info:
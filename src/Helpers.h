@@ -7,6 +7,7 @@
 
 #include <format>
 #include <thread>
+#include <mutex>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
@@ -27,6 +28,7 @@ public:
 	static void log(std::string message, LoggingSeverity severity = LoggingSeverity::Info);
 	inline static std::stringstream s_buffer;
 	inline static bool s_updated = false;
+	inline static std::mutex s_mutex; // pipeline workers log concurrently
 };
 
 class Helper {
@@ -134,6 +136,16 @@ public:
 		return rgba_image;
 	}
 
+	// FNV-1a, pass the previous result as seed to hash several fields
+	inline static uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull) {
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++) {
+			seed ^= bytes[i];
+			seed *= 1099511628211ull;
+		}
+		return seed;
+	}
+
 	template<typename T>
 	inline static void write_binary(std::ofstream& ofs, const T& value) {
 		ofs.write(reinterpret_cast<const char*>(&value), sizeof(T));
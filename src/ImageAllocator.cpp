@@ -0,0 +1,113 @@
+#include "ImageAllocator.h"
+
+#include "Structs.h"
+#include "Helpers.h"
+
+#include <k4a/k4a.hpp>
+
+#include <algorithm>
+#include <new>
+
+bool ImageAllocator::install()
+{
+	if (k4a_set_allocator(&ImageAllocator::allocate, &ImageAllocator::deallocate) != K4A_RESULT_SUCCEEDED) {
+		Logger::log("Could not install k4a image allocator.", LoggingSeverity::Warning);
+		return false;
+	}
+
+	Logger::log("Installed pooled k4a image allocator.");
+	return true;
+}
+
+ImageAllocatorStats ImageAllocator::stats()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	return s_stats;
+}
+
+void ImageAllocator::release_cached()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	for (auto& [block_size, blocks] : s_free_blocks) {
+		for (auto block : blocks) {
+			::operator delete(block, std::align_val_t(IMAGE_POOL_ALIGNMENT));
+		}
+		blocks.clear();
+	}
+	s_stats.bytes_cached = 0;
+}
+
+size_t ImageAllocator::size_class(size_t size)
+{
+	// small buffers (e.g. imu/custom images) are not worth pooling
+	if (size < IMAGE_POOL_MIN_BLOCK_SIZE)
+		return 0;
+
+	return (size + IMAGE_POOL_GRANULARITY - 1) / IMAGE_POOL_GRANULARITY * IMAGE_POOL_GRANULARITY;
+}
+
+// both callbacks are called from inside the k4a C library, nothing may throw out of them. A failed
+// allocation returns nullptr, which k4a reports as a failed image creation.
+uint8_t* ImageAllocator::allocate(int size, void** context)
+{
+	const size_t block_size = size_class(static_cast<size_t>(size));
+	// the size class is handed back to free() through the context
+	*context = reinterpret_cast<void*>(block_size);
+
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_stats.allocations++;
+
+	if (block_size == 0) {
+		s_stats.unpooled++;
+		return static_cast<uint8_t*>(::operator new(static_cast<size_t>(size), std::align_val_t(IMAGE_POOL_ALIGNMENT), std::nothrow));
+	}
+
+	uint8_t* block = nullptr;
+	auto blocks = s_free_blocks.find(block_size);
+	if (blocks != s_free_blocks.end() && !blocks->second.empty()) {
+		block = blocks->second.back();
+		blocks->second.pop_back();
+		s_stats.bytes_cached -= block_size;
+		s_stats.pool_hits++;
+	}
+	else {
+		block = static_cast<uint8_t*>(::operator new(block_size, std::align_val_t(IMAGE_POOL_ALIGNMENT), std::nothrow));
+		if (!block)
+			return nullptr;
+		s_stats.pool_misses++;
+	}
+
+	s_stats.bytes_in_use += block_size;
+	s_stats.bytes_in_use_high_water = std::max(s_stats.bytes_in_use_high_water, s_stats.bytes_in_use);
+
+	return block;
+}
+
+void ImageAllocator::deallocate(void* buffer, void* context)
+{
+	if (!buffer)
+		return;
+
+	const size_t block_size = reinterpret_cast<size_t>(context);
+	if (block_size == 0) {
+		::operator delete(buffer, std::align_val_t(IMAGE_POOL_ALIGNMENT));
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_stats.bytes_in_use -= block_size;
+
+	try {
+		auto& blocks = s_free_blocks[block_size];
+		if (blocks.size() < IMAGE_POOL_MAX_FREE_BLOCKS) {
+			blocks.push_back(static_cast<uint8_t*>(buffer));
+			s_stats.bytes_cached += block_size;
+			return;
+		}
+	}
+	catch (const std::bad_alloc&) {
+		// no room to pool it, it goes back to the heap below
+	}
+
+	::operator delete(buffer, std::align_val_t(IMAGE_POOL_ALIGNMENT));
+}
@@ -0,0 +1,41 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+struct ImageAllocatorStats {
+	uint64_t allocations = 0;
+	uint64_t pool_hits = 0;
+	uint64_t pool_misses = 0;
+	uint64_t unpooled = 0;
+	size_t bytes_in_use = 0;
+	size_t bytes_in_use_high_water = 0;
+	size_t bytes_cached = 0;
+};
+
+// Size-class pool for Azure Kinect image payloads, registered through k4a_set_allocator.
+// Frame-sized blocks (depth16, BGRA32, ...) are recycled instead of going back to the heap,
+// so steady-state capturing and loading does not call malloc for image buffers.
+class ImageAllocator {
+public:
+	// must be called before any k4a image is created
+	static bool install();
+
+	static ImageAllocatorStats stats();
+	// frees the cached blocks, blocks in use are not touched. Called when the camera stops or changes
+	// its mode, after which the cached size classes may never be asked for again.
+	static void release_cached();
+
+private:
+	static uint8_t* allocate(int size, void** context);
+	static void deallocate(void* buffer, void* context);
+
+	static size_t size_class(size_t size);
+
+	inline static std::mutex s_mutex;
+	inline static std::unordered_map<size_t, std::vector<uint8_t*>> s_free_blocks;
+	inline static ImageAllocatorStats s_stats;
+};
@@ -0,0 +1,141 @@
+#include "KdTree.h"
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+void KdTree::build(std::span<const glm::vec3> positions)
+{
+	clear();
+
+	m_entries.reserve(positions.size());
+	for (size_t i = 0; i < positions.size(); i++) {
+		const glm::vec3& p = positions[i];
+		if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z)) {
+			m_entries.push_back({ p, (uint32_t)i });
+		}
+	}
+
+	// all ranges on one level differ by at most one point, so the first level where the larger
+	// half fits into a leaf is the leaf level for every node
+	m_depth = 0;
+	while (((m_entries.size() + ((size_t)1 << m_depth) - 1) >> m_depth) > POINTCLOUD_KDTREE_LEAF_SIZE) {
+		m_depth++;
+	}
+
+	const size_t internal_nodes = ((size_t)1 << m_depth) - 1;
+	m_splits.resize(internal_nodes);
+	m_axes.resize(internal_nodes);
+
+	if (m_depth > 0) {
+		glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+		glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+		for (const Entry& entry : m_entries) {
+			min = glm::min(min, entry.position);
+			max = glm::max(max, entry.position);
+		}
+		build_node(0, 0, m_entries.size(), 0, min, max);
+	}
+}
+
+void KdTree::clear()
+{
+	m_entries.clear();
+	m_splits.clear();
+	m_axes.clear();
+	m_depth = 0;
+}
+
+void KdTree::build_node(size_t node, size_t begin, size_t end, int depth, glm::vec3 min, glm::vec3 max)
+{
+	// the cell bounds only shrink along the split axes, which is close enough to pick the next axis
+	const glm::vec3 extent = max - min;
+	const uint8_t axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+	const size_t mid = begin + (end - begin) / 2;
+
+	std::nth_element(m_entries.begin() + begin, m_entries.begin() + mid, m_entries.begin() + end, [axis](const Entry& a, const Entry& b) {
+		return a.position[axis] < b.position[axis];
+	});
+
+	m_splits[node] = m_entries[mid].position[axis];
+	m_axes[node] = axis;
+
+	if (depth + 1 == m_depth)
+		return;
+
+	glm::vec3 left_max = max;
+	glm::vec3 right_min = min;
+	left_max[axis] = m_splits[node];
+	right_min[axis] = m_splits[node];
+
+	// children work on disjoint ranges and nodes, large ones in parallel
+	if (end - begin >= POINTCLOUD_KDTREE_PARALLEL_BUILD_SIZE) {
+		ThreadPool::global().parallel_for(2, [&](size_t child) {
+			if (child == 0)
+				build_node(2 * node + 1, begin, mid, depth + 1, min, left_max);
+			else
+				build_node(2 * node + 2, mid, end, depth + 1, right_min, max);
+		});
+	}
+	else {
+		build_node(2 * node + 1, begin, mid, depth + 1, min, left_max);
+		build_node(2 * node + 2, mid, end, depth + 1, right_min, max);
+	}
+}
+
+size_t KdTree::knn(const glm::vec3& query, size_t k, uint32_t* indices, float* distances_sq) const
+{
+	if (k == 0 || m_entries.empty())
+		return 0;
+
+	Neighbors neighbors = { indices, distances_sq, k, 0 };
+	search(0, 0, m_entries.size(), 0, query, glm::vec3(0.f), 0.f, neighbors);
+	return neighbors.count;
+}
+
+void KdTree::search(size_t node, size_t begin, size_t end, int depth, const glm::vec3& query, glm::vec3 offsets, float cell_distance_sq, Neighbors& neighbors) const
+{
+	if (depth == m_depth) {
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3 d = m_entries[i].position - query;
+			const float distance_sq = glm::dot(d, d);
+			if (neighbors.count == neighbors.k && distance_sq >= neighbors.distances_sq[neighbors.count - 1])
+				continue;
+
+			// sorted insert, k is small
+			size_t j = std::min(neighbors.count, neighbors.k - 1);
+			while (j > 0 && neighbors.distances_sq[j - 1] > distance_sq) {
+				neighbors.distances_sq[j] = neighbors.distances_sq[j - 1];
+				neighbors.indices[j] = neighbors.indices[j - 1];
+				j--;
+			}
+			neighbors.distances_sq[j] = distance_sq;
+			neighbors.indices[j] = m_entries[i].index;
+			neighbors.count = std::min(neighbors.count + 1, neighbors.k);
+		}
+		return;
+	}
+
+	const size_t mid = begin + (end - begin) / 2;
+	const uint8_t axis = m_axes[node];
+	const float diff = query[axis] - m_splits[node];
+	const size_t near_node = diff < 0.f ? 2 * node + 1 : 2 * node + 2;
+	const size_t far_node = diff < 0.f ? 2 * node + 2 : 2 * node + 1;
+
+	search(near_node, diff < 0.f ? begin : mid, diff < 0.f ? mid : end, depth + 1, query, offsets, cell_distance_sq, neighbors);
+
+	// lower bound of the distance to the far cell, updated incrementally along the split axis.
+	// it is only visited if it can still contain a closer point than the current worst neighbor.
+	const float far_distance_sq = cell_distance_sq - offsets[axis] * offsets[axis] + diff * diff;
+	if (neighbors.count < neighbors.k || far_distance_sq < neighbors.distances_sq[neighbors.count - 1]) {
+		offsets[axis] = diff;
+		search(far_node, diff < 0.f ? mid : begin, diff < 0.f ? end : mid, depth + 1, query, offsets, far_distance_sq, neighbors);
+	}
+}
+
+size_t KdTree::memory_usage() const
+{
+	return m_entries.capacity() * sizeof(Entry) + m_splits.capacity() * sizeof(float) + m_axes.capacity();
+}
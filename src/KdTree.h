@@ -0,0 +1,67 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+
+#pragma once
+
+// Static kd-tree over a set of positions for nearest neighbor queries. The tree is implicit:
+// every node splits its range at the median of the axis with the largest extent, so node i has
+// the children 2i + 1 and 2i + 2 and all leaves hold at most POINTCLOUD_KDTREE_LEAF_SIZE points
+// on the same level. The points are stored in tree order next to their original index, which
+// keeps leaf scans linear in memory. Queries are const and can run from many threads at once.
+class KdTree {
+public:
+	// non-finite positions are skipped, the large top levels are built on the global thread pool
+	void build(std::span<const glm::vec3> positions);
+	void clear();
+
+	inline size_t size() const {
+		return m_entries.size();
+	}
+
+	inline bool empty() const {
+		return m_entries.empty();
+	}
+
+	// up to `k` nearest neighbors of `query`, sorted by distance. writes the original point
+	// indices and squared distances, returns the number of neighbors found.
+	size_t knn(const glm::vec3& query, size_t k, uint32_t* indices, float* distances_sq) const;
+
+	// original index of the i-th point in tree order, iterating in this order keeps
+	// consecutive queries spatially close
+	inline uint32_t index_at(size_t i) const {
+		return m_entries[i].index;
+	}
+
+	inline const glm::vec3& position_at(size_t i) const {
+		return m_entries[i].position;
+	}
+
+	size_t memory_usage() const;
+
+private:
+	struct Entry {
+		glm::vec3 position;
+		uint32_t index;
+	};
+
+	struct Neighbors {
+		uint32_t* indices;
+		float* distances_sq;
+		size_t k;
+		size_t count;
+	};
+
+	void build_node(size_t node, size_t begin, size_t end, int depth, glm::vec3 min, glm::vec3 max);
+	void search(size_t node, size_t begin, size_t end, int depth, const glm::vec3& query, glm::vec3 offsets, float cell_distance_sq, Neighbors& neighbors) const;
+
+	std::vector<Entry> m_entries;
+	std::vector<float> m_splits;
+	std::vector<uint8_t> m_axes;
+	int m_depth = 0;
+};
@@ -0,0 +1,77 @@
+#include "PointBuffer.h"
+
+void PointBuffer::resize(size_t count)
+{
+	m_positions.resize(count);
+	m_colors.resize(count);
+	if (m_has_normals) {
+		m_normals.resize(count);
+	}
+}
+
+void PointBuffer::reserve(size_t count)
+{
+	m_positions.reserve(count);
+	m_colors.reserve(count);
+	if (m_has_normals) {
+		m_normals.reserve(count);
+	}
+}
+
+void PointBuffer::clear()
+{
+	m_positions.clear();
+	m_colors.clear();
+	m_normals.clear();
+}
+
+void PointBuffer::shrink_to_fit()
+{
+	m_positions.shrink_to_fit();
+	m_colors.shrink_to_fit();
+	m_normals.shrink_to_fit();
+}
+
+void PointBuffer::set_has_normals(bool has_normals)
+{
+	m_has_normals = has_normals;
+	if (m_has_normals) {
+		m_normals.resize(m_positions.size(), glm::vec3(0.f));
+	}
+	else {
+		m_normals.clear();
+		m_normals.shrink_to_fit();
+	}
+}
+
+void PointBuffer::push_back(const glm::vec3& position, const RgbaPixel& color)
+{
+	m_positions.push_back(position);
+	m_colors.push_back(color);
+	if (m_has_normals) {
+		m_normals.push_back(glm::vec3(0.f));
+	}
+}
+
+PointStreams PointBuffer::streams()
+{
+	return {
+		m_positions.data(),
+		m_colors.data(),
+		m_has_normals ? m_normals.data() : nullptr
+	};
+}
+
+void PointBuffer::interleave(std::vector<PointAttributes>& out) const
+{
+	out.resize(size());
+	for (size_t i = 0; i < size(); i++) {
+		out[i].position = m_positions[i];
+		out[i].color = color_at(i);
+	}
+}
+
+size_t PointBuffer::memory_usage() const
+{
+	return m_positions.capacity() * sizeof(glm::vec3) + m_colors.capacity() * sizeof(RgbaPixel) + m_normals.capacity() * sizeof(glm::vec3);
+}
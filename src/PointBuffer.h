@@ -0,0 +1,93 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+
+#pragma once
+
+// raw stream pointers handed to the generation kernels
+struct PointStreams {
+	glm::vec3* positions = nullptr;
+	RgbaPixel* colors = nullptr;
+	glm::vec3* normals = nullptr;
+
+	inline PointStreams offset(size_t index) const {
+		return {
+			positions + index,
+			colors + index,
+			normals ? normals + index : nullptr
+		};
+	}
+};
+
+// Structure-of-arrays point storage: positions, rgba8 colors and optional normals live in
+// separate streams. Consumers read them through spans, the interleaved layout is only
+// built for GPU upload.
+class PointBuffer {
+public:
+	inline size_t size() const {
+		return m_positions.size();
+	}
+
+	inline bool empty() const {
+		return m_positions.empty();
+	}
+
+	inline bool has_normals() const {
+		return m_has_normals;
+	}
+
+	void resize(size_t count);
+	void reserve(size_t count);
+	void clear();
+	void shrink_to_fit();
+	void set_has_normals(bool has_normals);
+
+	void push_back(const glm::vec3& position, const RgbaPixel& color);
+
+	inline std::span<glm::vec3> positions() {
+		return m_positions;
+	}
+
+	inline std::span<const glm::vec3> positions() const {
+		return m_positions;
+	}
+
+	inline std::span<RgbaPixel> colors() {
+		return m_colors;
+	}
+
+	inline std::span<const RgbaPixel> colors() const {
+		return m_colors;
+	}
+
+	// empty if the buffer has no normals
+	inline std::span<glm::vec3> normals() {
+		return m_normals;
+	}
+
+	inline std::span<const glm::vec3> normals() const {
+		return m_normals;
+	}
+
+	inline glm::vec3 color_at(size_t i) const {
+		return glm::vec3(m_colors[i].r, m_colors[i].g, m_colors[i].b) / 255.f;
+	}
+
+	PointStreams streams();
+
+	// float position + color layout, only used for uploading uncompressed vertex buffers
+	void interleave(std::vector<PointAttributes>& out) const;
+
+	size_t memory_usage() const;
+
+private:
+	bool m_has_normals = false;
+	std::vector<glm::vec3> m_positions;
+	std::vector<RgbaPixel> m_colors;
+	std::vector<glm::vec3> m_normals;
+};
@@ -2,6 +2,9 @@
 
 #include "ResourceManager.h"
 #include "Helpers.h"
+#include "PointcloudKernels.h"
+#include "PointcloudFilters.h"
+#include "PointcloudPipeline.h"
 
 #include <imgui.h>
 #include <glm/glm.hpp>
@@ -18,11 +21,28 @@
 #include <iostream>
 #include <sstream>
 #include <format>
+#include <chrono>
+#include <limits>
 
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+namespace {
+	// centroid of the loaded clouds, which keep their own coordinates
+	glm::vec3 mean_position(std::span<const glm::vec3> positions)
+	{
+		if (positions.empty())
+			return glm::vec3(0.f);
+
+		glm::dvec3 sum(0.);
+		for (const glm::vec3& position : positions) {
+			sum += glm::dvec3(position);
+		}
+		return glm::vec3(sum / (double)positions.size());
+	}
+}
+
 Pointcloud::Pointcloud(wgpu::Device device, wgpu::Queue queue, glm::mat4* transform_ptr) {
 	m_device = device;
 	m_queue = queue;
@@ -36,16 +56,20 @@ Pointcloud::~Pointcloud()
 	m_points.clear();
 }
 
-void Pointcloud::load_from_capture(k4a::image depth_image, k4a::image color_image, k4a::calibration calibration)
+void Pointcloud::load_from_capture(k4a::image depth_image, k4a::image color_image, k4a::calibration calibration, PointcloudPipeline& pipeline)
+{
+	set_capture(depth_image, color_image, calibration);
+	pipeline.run(*this);
+}
+
+void Pointcloud::set_capture(k4a::image depth_image, k4a::image color_image, k4a::calibration calibration)
 {
 	m_depth_image = depth_image;
 	m_color_image = color_image;
 	m_calibration = calibration;
-
-	capture_point_cloud();
 }
 
-void Pointcloud::load_from_ply(const std::filesystem::path path, glm::mat4 initial_transform)
+void Pointcloud::load_from_ply(const std::filesystem::path path, glm::mat4 initial_transform, float voxel_size)
 {
 	using namespace tinyply;
 
@@ -66,45 +90,28 @@ void Pointcloud::load_from_ply(const std::filesystem::path path, glm::mat4 initi
 
 	file.read(filestream);
 
-	std::vector<glm::vec3> points(points_ptr->count);
-	std::memcpy(points.data(), points_ptr->buffer.get(), points_ptr->buffer.size_bytes());
-
 	m_points.clear();
-	for (int i = 0; i < points.size(); i++) {
-
-		PointAttributes point;
-
-		glm::vec4 transformed = initial_transform * glm::vec4(
-			-points[i].x,
-			points[i].z,
-			-points[i].y,
-			1.f
-		);
-
-		/*point.position.x = (float)-points[i].x;
-		point.position.y = (float)points[i].z;
-		point.position.z = (float)-points[i].y;*/
-
-		point.position.x = transformed.x;
-		point.position.y = transformed.y;
-		point.position.z = transformed.z;
-
-		point.color.r = m_color.r;
-		point.color.g = m_color.g;
-		point.color.b = m_color.b;
-
-		m_points.push_back(point);
-
-		auto len = glm::length(glm::vec3(point.position.x, point.position.y, point.position.z));
-		if (len > m_furthest_point) {
-			m_furthest_point = len;
-		}
-	}
-
+	m_triangles.clear();
+	m_points.resize(points_ptr->count);
+	invalidate_spatial_data();
+
+	// the ply axes (x, y, z) map to (-x, z, -y)
+	const glm::mat4 ply_transform = initial_transform * PointcloudKernels::axis_remap({ 0, 2, 1 }, { -1.f, 1.f, -1.f });
+	const auto positions = m_points.positions();
+	PointcloudKernels::transform_points(reinterpret_cast<const glm::vec3*>(points_ptr->buffer.get()), positions.size(), ply_transform, positions.data());
+
+	const glm::vec3 color = glm::clamp(m_color * 255.f + .5f, glm::vec3(0.f), glm::vec3(255.f));
+	const RgbaPixel ply_color = { (uint8_t)color.r, (uint8_t)color.g, (uint8_t)color.b, 255 };
+	std::fill(m_points.colors().begin(), m_points.colors().end(), ply_color);
+
+	m_voxel_size = voxel_size;
+	downsample_points();
+	m_centroid = mean_position(m_points.positions());
+	update_extent();
 	write_point_cloud_to_buffer();
 }
 
-void Pointcloud::load_from_points3D(const std::filesystem::path path)
+void Pointcloud::load_from_points3D(const std::filesystem::path path, float voxel_size)
 {
 	std::ifstream reader(path, std::ios::binary);
 	if (!reader.is_open()) {
@@ -117,6 +124,8 @@ void Pointcloud::load_from_points3D(const std::filesystem::path path)
 	std::cout << num_points << std::endl;
 
 	m_points.clear();
+	m_triangles.clear();
+	invalidate_spatial_data();
 
 	for (auto i = 0; i < num_points; i++) {
 		int64_t point_id;
@@ -146,166 +155,346 @@ void Pointcloud::load_from_points3D(const std::filesystem::path path)
 		reader.read(reinterpret_cast<char*>(image_ids.data()), track_length * sizeof(int32_t));
 		reader.read(reinterpret_cast<char*>(point2D_indices.data()), track_length * sizeof(int32_t));
 
-		PointAttributes point;
+		glm::vec3 position = { x, y, z };
+		m_points.push_back(position, { rgb[0], rgb[1], rgb[2], 255 });
+	}
 
-		point.position = { x, y, z };
-		point.color = { rgb[0] / 255.f, rgb[1] / 255.f, rgb[2] / 255.f };
+	m_voxel_size = voxel_size;
+	downsample_points();
+	m_centroid = mean_position(m_points.positions());
+	update_extent();
+	write_point_cloud_to_buffer();
+}
 
-		m_points.push_back(point);
+bool Pointcloud::load_from_compact(const std::filesystem::path path)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) {
+		Logger::log(std::format("Failed to open point file: {}", path.string()), LoggingSeverity::Error);
+		return false;
+	}
 
-		auto len = glm::length(glm::vec3(point.position.x, point.position.y, point.position.z));
-		if (len > m_furthest_point) {
-			m_furthest_point = len;
-		}
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	Helper::read_binary(ifs, magic);
+	Helper::read_binary(ifs, version);
+	if (magic != POINTCLOUD_COMPACT_FILE_MAGIC || version != POINTCLOUD_COMPACT_FILE_VERSION) {
+		Logger::log(std::format("{} is not a compatible point file.", path.string()), LoggingSeverity::Error);
+		return false;
 	}
 
+	uint64_t count = 0;
+	glm::vec3 centroid, offset, extent;
+	float furthest_point = 0.f;
+	Helper::read_binary(ifs, count);
+	Helper::read_binary(ifs, centroid);
+	Helper::read_binary(ifs, furthest_point);
+	Helper::read_binary(ifs, offset);
+	Helper::read_binary(ifs, extent);
+
+	// the count is checked against the file before it sizes an allocation
+	const auto data_begin = ifs.tellg();
+	ifs.seekg(0, std::ios::end);
+	const auto data_end = ifs.tellg();
+	ifs.seekg(data_begin);
+	if (!ifs || count > (uint64_t)(data_end - data_begin) / sizeof(CompactPointAttributes)) {
+		Logger::log(std::format("{} is truncated.", path.string()), LoggingSeverity::Error);
+		return false;
+	}
+
+	std::vector<CompactPointAttributes> compact_points(count);
+	ifs.read(reinterpret_cast<char*>(compact_points.data()), count * sizeof(CompactPointAttributes));
+	if (!ifs) {
+		Logger::log(std::format("{} is truncated.", path.string()), LoggingSeverity::Error);
+		return false;
+	}
+
+	PointcloudKernels::dequantize_points(compact_points.data(), count, offset, extent, m_points);
+	m_triangles.clear();
+	invalidate_spatial_data();
+	m_centroid = centroid;
+	m_furthest_point = furthest_point;
+	m_bounds_min = offset;
+	m_bounds_max = offset + extent;
+
 	write_point_cloud_to_buffer();
+
+	return true;
 }
 
-void Pointcloud::capture_point_cloud()
+bool Pointcloud::save_compact(const std::filesystem::path path)
 {
-	if (!m_depth_image)
-	{
-		Logger::log("Tried to capture empty depth image.", LoggingSeverity::Error);
-		return;
+	std::ofstream ofs(path, std::ios::binary);
+	if (!ofs) {
+		return false;
 	}
 
-	k4a::image transformed_color_image = k4a::image::create(K4A_IMAGE_FORMAT_COLOR_BGRA32,
-															m_calibration.depth_camera_calibration.resolution_width,
-															m_calibration.depth_camera_calibration.resolution_height,
-															m_calibration.depth_camera_calibration.resolution_width * 4);
-	
-	k4a::image xy_table = k4a::image::create(K4A_IMAGE_FORMAT_CUSTOM,
-											 m_calibration.depth_camera_calibration.resolution_width,
-											 m_calibration.depth_camera_calibration.resolution_height,
-											 m_calibration.depth_camera_calibration.resolution_width * (int)sizeof(k4a_float2_t));
+	glm::vec3 offset, extent;
+	compute_quantization(offset, extent);
 
-	k4a::transformation transformation(m_calibration);
-	transformation.color_image_to_depth_camera(m_depth_image, m_color_image, &transformed_color_image);
+	std::vector<CompactPointAttributes> compact_points(m_points.size());
+	PointcloudKernels::quantize_points(m_points, offset, extent, compact_points.data());
 
+	Helper::write_binary(ofs, (uint32_t)POINTCLOUD_COMPACT_FILE_MAGIC);
+	Helper::write_binary(ofs, (uint32_t)POINTCLOUD_COMPACT_FILE_VERSION);
+	Helper::write_binary(ofs, (uint64_t)compact_points.size());
+	Helper::write_binary(ofs, m_centroid);
+	Helper::write_binary(ofs, m_furthest_point);
+	Helper::write_binary(ofs, offset);
+	Helper::write_binary(ofs, extent);
+	ofs.write(reinterpret_cast<const char*>(compact_points.data()), compact_points.size() * sizeof(CompactPointAttributes));
 
-	create_xy_table(&m_calibration, xy_table);
+	return (bool)ofs;
+}
 
-	k4a::image point_cloud = k4a::image::create(K4A_IMAGE_FORMAT_CUSTOM,
-												m_calibration.depth_camera_calibration.resolution_width,
-												m_calibration.depth_camera_calibration.resolution_height,
-												m_calibration.depth_camera_calibration.resolution_width * (int)sizeof(k4a_float3_t));
+bool Pointcloud::save_mesh_ply(const std::filesystem::path path)
+{
+	std::ofstream ofs(path, std::ios::binary);
+	if (!ofs) {
+		return false;
+	}
 
+	const size_t triangle_count = m_triangles.size() / 3;
+	ofs << "ply\n"
+		<< "format binary_little_endian 1.0\n"
+		<< "element vertex " << m_points.size() << "\n"
+		<< "property float x\n"
+		<< "property float y\n"
+		<< "property float z\n"
+		<< "property uchar red\n"
+		<< "property uchar green\n"
+		<< "property uchar blue\n"
+		<< "element face " << triangle_count << "\n"
+		<< "property list uchar uint vertex_indices\n"
+		<< "end_header\n";
+
+	const auto positions = m_points.positions();
+	const auto colors = m_points.colors();
+	for (size_t i = 0; i < m_points.size(); i++) {
+		Helper::write_binary(ofs, positions[i]);
+		Helper::write_binary(ofs, colors[i].r);
+		Helper::write_binary(ofs, colors[i].g);
+		Helper::write_binary(ofs, colors[i].b);
+	}
 
+	for (size_t t = 0; t < triangle_count; t++) {
+		Helper::write_binary(ofs, (uint8_t)3);
+		ofs.write(reinterpret_cast<const char*>(m_triangles.data() + t * 3), 3 * sizeof(uint32_t));
+	}
 
-	int point_count;
-	generate_point_cloud(xy_table, point_cloud, transformed_color_image, &point_count);
-	write_point_cloud_to_buffer();
+	return (bool)ofs;
 }
 
-void Pointcloud::create_xy_table(const k4a::calibration* calibration, k4a::image xy_table)
+void Pointcloud::compute_quantization(glm::vec3& offset, glm::vec3& extent)
 {
-	k4a_float2_t* table_data = (k4a_float2_t*)xy_table.get_buffer();
-
-	const int width = calibration->depth_camera_calibration.resolution_width;
-	const int height = calibration->depth_camera_calibration.resolution_height;
-
-	k4a_float2_t p;
-	k4a_float3_t ray;
-	int valid;
-
-	for (int y = 0, idx = 0; y < height; y++) {
-		p.xy.y = (float)y;
-		for (int x = 0; x < width; x++, idx++) {
-			p.xy.x = (float)x;
-
-			if (calibration->convert_2d_to_3d(p, 1.f, K4A_CALIBRATION_TYPE_DEPTH, K4A_CALIBRATION_TYPE_DEPTH, &ray)) {
-				table_data[idx].xy.x = ray.xyz.x;
-				table_data[idx].xy.y = ray.xyz.y;
-			}
-			else {
-				table_data[idx].xy.x = nanf("");
-				table_data[idx].xy.y = nanf("");
-			}
-		}
+	glm::vec3 min(std::numeric_limits<float>::max());
+	glm::vec3 max(std::numeric_limits<float>::lowest());
+	for (const auto& p : m_points.positions()) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	if (m_points.empty()) {
+		min = max = glm::vec3(0.f);
 	}
+
+	offset = min;
+	extent = glm::max(max - min, glm::vec3(POINTCLOUD_COMPACT_MIN_EXTENT));
 }
 
-void Pointcloud::generate_point_cloud(const k4a::image xy_table, k4a::image point_cloud, const k4a::image transformed_color_image, int* point_count)
+void Pointcloud::apply_build_result(const PointcloudBuildResult& result)
 {
-	const int width = m_depth_image.get_width_pixels();
-	const int height = m_depth_image.get_height_pixels();
-
-	uint16_t* depth_data = (uint16_t*)m_depth_image.get_buffer();
-	uint8_t* color_data = (uint8_t*)transformed_color_image.get_buffer();
-	k4a_float2_t* xy_table_data = (k4a_float2_t*)xy_table.get_buffer();
-	k4a_float3_t* point_cloud_data = (k4a_float3_t*)point_cloud.get_buffer();
-
-	*point_count = 0;
-	
-	for (int i = 0; i < width * height; i++) {
-		if (depth_data[i] != 0 && !isnan(xy_table_data[i].xy.x) && !isnan(xy_table_data[i].xy.y)) {
-			point_cloud_data[i].xyz.x = xy_table_data[i].xy.x * (float)depth_data[i];
-			point_cloud_data[i].xyz.y = xy_table_data[i].xy.y * (float)depth_data[i];
-			point_cloud_data[i].xyz.z = (float)depth_data[i];
-			(*point_count)++;
-
-			auto len = glm::length(glm::vec3(point_cloud_data[i].xyz.x, point_cloud_data[i].xyz.y, point_cloud_data[i].xyz.z));
-			if (len > m_furthest_point) {
-				m_furthest_point = len;
-			}
-		}
-		else {
-			point_cloud_data[i].xyz.x = nanf("");
-			point_cloud_data[i].xyz.y = nanf("");
-			point_cloud_data[i].xyz.z = nanf("");
-		}
+	invalidate_spatial_data();
+
+	if (result.count == 0) {
+		Logger::log("Capture did not produce any points.", LoggingSeverity::Warning);
+	}
+	if (result.flying_pixels > 0) {
+		Logger::log(std::format("Rejected {} flying pixels", result.flying_pixels));
+	}
+	if (result.clipped_pixels > 0) {
+		Logger::log(std::format("Clipped {} pixels outside the depth range / crop region", result.clipped_pixels));
+	}
+	if (result.component_pixels > 0) {
+		Logger::log(std::format("Removed {} pixels outside the selected component", result.component_pixels));
+	}
+	if (result.triangles > 0) {
+		Logger::log(std::format("Triangulated the depth grid into {} triangles", result.triangles));
+	}
+	if (result.has_plane) {
+		Logger::log(std::format("Support plane ({:.3f}, {:.3f}, {:.3f}, {:.3f}), removed {} points", result.plane.x, result.plane.y, result.plane.z, result.plane.w, result.plane_points));
+		m_has_support_plane = true;
+		m_support_plane = result.plane;
 	}
 
-	m_points.clear();
-	glm::vec3 sum(0.f);
-	for (int i = 0; i < width * height; i++) {
+	m_centroid = result.centroid;
+	m_bounds_min = result.bounds_min;
+	m_bounds_max = result.bounds_max;
+	m_furthest_point = std::max(m_furthest_point, result.furthest_point);
+}
+
+bool Pointcloud::rebuild(PointcloudPipeline& pipeline)
+{
+	if (!m_depth_image) {
+		return false;
+	}
+
+	pipeline.run(*this);
+	return true;
+}
+
+void Pointcloud::downsample(float voxel_size)
+{
+	m_voxel_size = voxel_size;
+	if (m_voxel_size <= 0.f) {
+		return;
+	}
+
+	downsample_points();
+	update_extent();
+	write_point_cloud_to_buffer();
+}
+
+void Pointcloud::update_extent()
+{
+	if (m_points.empty()) {
+		m_bounds_min = glm::vec3(0.f);
+		m_bounds_max = glm::vec3(0.f);
+		m_furthest_point = 1.f;
+		return;
+	}
+
+	glm::vec3 bounds_min(std::numeric_limits<float>::infinity());
+	glm::vec3 bounds_max(-std::numeric_limits<float>::infinity());
+	float furthest_sq = 0.f;
+	for (const glm::vec3& position : m_points.positions()) {
+		bounds_min = glm::min(bounds_min, position);
+		bounds_max = glm::max(bounds_max, position);
+		furthest_sq = std::max(furthest_sq, glm::dot(position, position));
+	}
+
+	m_bounds_min = bounds_min;
+	m_bounds_max = bounds_max;
+	m_furthest_point = std::sqrt(furthest_sq);
+}
+
+void Pointcloud::downsample_points()
+{
+	if (m_voxel_size <= 0.f) {
+		return;
+	}
 
-		if (std::isnan(point_cloud_data[i].xyz.x) || 
-			std::isnan(point_cloud_data[i].xyz.y) || 
-			std::isnan(point_cloud_data[i].xyz.z))
-			continue;
+	auto start = std::chrono::steady_clock::now();
 
-		uint8_t b = color_data[i * 4 + 0];
-		uint8_t g = color_data[i * 4 + 1];
-		uint8_t r = color_data[i * 4 + 2];
-		uint8_t a = color_data[i * 4 + 3];
+	PointBuffer downsampled;
+	size_t count_before = m_points.size();
+	PointcloudFilters::voxel_downsample(m_points, m_voxel_size, downsampled);
+	m_points = std::move(downsampled);
+	invalidate_spatial_data();
 
-		// skip points, we don't have a color for
-		// (fov of depth image is wider that the color image)
-		if (r == 0 && g == 0 && b == 0)
-			continue;
+	// the voxel averages are not vertices of the grid mesh anymore
+	m_triangles.clear();
 
-		PointAttributes point;
-		static float scale = 1.f / 100.f;
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	Logger::log(std::format("Voxel grid ({}): {} -> {} points in {:.2f} ms", m_voxel_size, count_before, m_points.size(), elapsed));
+}
 
-		/*point.position.x = (float)-point_cloud_data[i].xyz.x * scale;
-		point.position.y = (float)point_cloud_data[i].xyz.z * scale;
-		point.position.z = (float)-point_cloud_data[i].xyz.y * scale;*/
-		point.position.x = (float)-point_cloud_data[i].xyz.x * scale;
-		point.position.y = (float)point_cloud_data[i].xyz.y * scale;
-		point.position.z = (float)point_cloud_data[i].xyz.z * scale;
+size_t Pointcloud::remove_outliers()
+{
+	size_t removed = filter_outliers();
+	if (removed > 0) {
+		write_point_cloud_to_buffer();
+	}
+	return removed;
+}
 
-		point.color.r = r / 255.f;
-		point.color.g = g / 255.f;
-		point.color.b = b / 255.f;
+const KdTree& Pointcloud::spatial_index()
+{
+	if (!m_spatial_index_valid) {
+		m_spatial_index.build(m_points.positions());
+		m_spatial_index_valid = true;
+	}
+	return m_spatial_index;
+}
 
-		sum += point.position;
+void Pointcloud::invalidate_spatial_data()
+{
+	m_spatial_index_valid = false;
+	m_registration_pyramid.reset();
+}
 
-		m_points.push_back(point);
+std::shared_ptr<RegistrationPyramid> Pointcloud::registration_pyramid()
+{
+	std::shared_ptr<RegistrationPyramid> pyramid = m_registration_pyramid.lock();
+	if (!pyramid) {
+		pyramid = std::make_shared<RegistrationPyramid>(m_points);
+		m_registration_pyramid = pyramid;
 	}
+	return pyramid;
+}
+
+size_t Pointcloud::registration_memory_usage() const
+{
+	std::shared_ptr<RegistrationPyramid> pyramid = m_registration_pyramid.lock();
+	return pyramid ? pyramid->memory_usage() : 0;
+}
+
+size_t Pointcloud::filter_outliers()
+{
+	auto start = std::chrono::steady_clock::now();
 
-	m_centroid = sum / static_cast<float>(m_points.size());
+	PointBuffer filtered;
+	std::vector<uint32_t> remap(m_triangles.empty() ? 0 : m_points.size());
+	size_t removed = PointcloudFilters::remove_statistical_outliers(m_points, spatial_index(), m_outlier_neighbors, m_outlier_stddev_mul, filtered, remap.empty() ? nullptr : remap.data());
+	if (removed > 0) {
+		m_points = std::move(filtered);
+		invalidate_spatial_data();
 
-	for (auto& pt : m_points) {
-		pt.position -= m_centroid;
+		if (!remap.empty()) {
+			PointcloudKernels::remap_triangles(m_triangles, remap.data());
+		}
+
+		// the camera is fit to the furthest point, which is often one of the removed outliers
+		update_extent();
 	}
+
+	auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	Logger::log(std::format("Outlier removal: {} of {} points removed in {:.2f} ms", removed, m_points.size() + removed, elapsed));
+	return removed;
 }
 
 void Pointcloud::write_point_cloud_to_buffer()
 {
+	// only the upload, the kd-tree and the registration snapshot stay valid. changes of m_points drop
+	// them where they happen.
+	if (m_gpu_buffer) {
+		m_gpu_buffer.destroy();
+		m_gpu_buffer.release();
+		m_gpu_buffer = nullptr;
+	}
+
+#if POINTCLOUD_COMPACT_FORMAT
+	// the shader maps the unorm16 positions back with offset + value * scale
+	compute_quantization(m_quant_offset, m_quant_scale);
+
+	std::vector<CompactPointAttributes> compact_points(m_points.size());
+	PointcloudKernels::quantize_points(m_points, m_quant_offset, m_quant_scale, compact_points.data());
+
+	const void* data = compact_points.data();
+	const size_t point_size = sizeof(CompactPointAttributes);
+#else
+	m_quant_offset = glm::vec3(0.f);
+	m_quant_scale = glm::vec3(1.f);
+
+	std::vector<PointAttributes> interleaved_points;
+	m_points.interleave(interleaved_points);
+
+	const void* data = interleaved_points.data();
+	const size_t point_size = sizeof(PointAttributes);
+#endif
+
 	wgpu::BufferDescriptor bufferDesc{};
-	bufferDesc.size = m_points.size() * sizeof(PointAttributes);
+	bufferDesc.size = m_points.size() * point_size;
 	bufferDesc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex;
 	bufferDesc.mappedAtCreation = false;
 
@@ -313,7 +502,7 @@ void Pointcloud::write_point_cloud_to_buffer()
 	if (!m_gpu_buffer) {
 		Logger::log("Could not create point buffer!", LoggingSeverity::Error);
 	}
-	m_queue.writeBuffer(m_gpu_buffer, 0, m_points.data(), bufferDesc.size);
+	m_queue.writeBuffer(m_gpu_buffer, 0, data, bufferDesc.size);
 
 	Logger::log(std::format("Point buffer: {}", (void*)m_gpu_buffer));
 	Logger::log(std::format("Point count: {}", m_points.size()));
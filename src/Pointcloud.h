@@ -1,20 +1,60 @@
 #include <filesystem>
+#include <memory>
 
 #include <webgpu/webgpu.hpp>
 #include <k4a/k4a.hpp>
 
 #include "Structs.h"
+#include "PointBuffer.h"
+#include "PointcloudBuilder.h"
+#include "KdTree.h"
+#include "PointcloudRegistration.h"
 
 #pragma once
 
+class PointcloudPipeline;
+
 class Pointcloud {
+	friend class PointcloudPipeline;
+
 public:
 	Pointcloud(wgpu::Device device, wgpu::Queue queue, glm::mat4* transform_ptr);
 	~Pointcloud();
 
-	void load_from_capture(k4a::image depth_image, k4a::image color_image, k4a::calibration calibration);
-	void load_from_ply(const std::filesystem::path path, glm::mat4 initial_transform);
-	void load_from_points3D(const std::filesystem::path path);
+	void load_from_capture(k4a::image depth_image, k4a::image color_image, k4a::calibration calibration, PointcloudPipeline& pipeline);
+	// only stores the images, for building several clouds in one pipeline run
+	void set_capture(k4a::image depth_image, k4a::image color_image, k4a::calibration calibration);
+	// imported clouds have no capture to rebuild from, they are put through a voxel grid of `voxel_size` once
+	void load_from_ply(const std::filesystem::path path, glm::mat4 initial_transform, float voxel_size = POINTCLOUD_DEFAULT_VOXEL_SIZE);
+	void load_from_points3D(const std::filesystem::path path, float voxel_size = POINTCLOUD_DEFAULT_VOXEL_SIZE);
+	bool load_from_compact(const std::filesystem::path path);
+	bool save_compact(const std::filesystem::path path);
+	// binary ply with the points as vertices and the grid triangles as faces
+	bool save_mesh_ply(const std::filesystem::path path);
+
+	// regenerates the points from the stored capture images, e.g. after changing the voxel size
+	bool rebuild(PointcloudPipeline& pipeline);
+
+	// voxel grid over the current points, for clouds without a capture. It can only make them coarser.
+	void downsample(float voxel_size);
+
+	inline bool has_capture() {
+		return (bool)m_depth_image;
+	}
+
+	// statistical outlier removal on the current points, also runs after every capture if enabled
+	size_t remove_outliers();
+
+	// kd-tree over the current points, built on first use and kept until the points change
+	const KdTree& spatial_index();
+
+	// snapshot of the current points for registration jobs. The cloud only holds it weakly: jobs that
+	// start while one is alive share it, it is freed with the last job that holds it and made again
+	// on the next request. The cloud is free to change meanwhile.
+	std::shared_ptr<RegistrationPyramid> registration_pyramid();
+
+	// bytes held by the snapshot, 0 if no job holds one
+	size_t registration_memory_usage() const;
 
 	inline wgpu::Buffer pointbuffer() {
 		return m_gpu_buffer;
@@ -24,10 +64,16 @@ public:
 		return m_points.size();
 	}
 
-	inline std::vector<PointAttributes> points() {
+	inline const PointBuffer& points() const {
 		return m_points;
 	}
 
+	// grid mesh over the points, three indices per triangle. only captures built with triangulation
+	// have one, it is dropped by the voxel grid and follows the outlier removal.
+	inline const std::vector<uint32_t>& triangles() const {
+		return m_triangles;
+	}
+
 	inline glm::mat4* get_transform_ptr() {
 		return m_transform;
 	}
@@ -56,15 +102,88 @@ public:
 		return m_centroid;
 	}
 
+	inline glm::vec3 bounds_min() {
+		return m_bounds_min;
+	}
+
+	inline glm::vec3 bounds_max() {
+		return m_bounds_max;
+	}
+
 	inline k4a::calibration calibration() {
 		return m_calibration;
 	}
 
+	// leaf size of the voxel grid applied when loading, 0 keeps every point
+	inline float voxel_size() {
+		return m_voxel_size;
+	}
+
+	inline void set_voxel_size(float voxel_size) {
+		m_voxel_size = voxel_size;
+	}
+
+	inline bool outlier_removal() {
+		return m_outlier_removal;
+	}
+
+	inline void set_outlier_removal(bool outlier_removal) {
+		m_outlier_removal = outlier_removal;
+	}
+
+	// neighbors per point and the allowed standard deviations above the mean neighbor distance
+	inline int outlier_neighbors() {
+		return m_outlier_neighbors;
+	}
+
+	inline void set_outlier_neighbors(int outlier_neighbors) {
+		m_outlier_neighbors = outlier_neighbors;
+	}
+
+	inline float outlier_stddev_mul() {
+		return m_outlier_stddev_mul;
+	}
+
+	inline void set_outlier_stddev_mul(float outlier_stddev_mul) {
+		m_outlier_stddev_mul = outlier_stddev_mul;
+	}
+
+	// support plane found by the builder, in camera space before centering (see PointcloudBuildResult)
+	inline bool has_support_plane() {
+		return m_has_support_plane;
+	}
+
+	inline glm::vec4 support_plane() {
+		return m_support_plane;
+	}
+
+	// plane the next build starts from, e.g. the one stored on the capture
+	inline void set_plane_prior(const glm::vec4& plane) {
+		m_plane_prior = plane;
+		m_has_plane_prior = true;
+	}
+
+	// maps the unorm16 positions in the point buffer back to cloud space
+	inline glm::vec3 quant_offset() {
+		return m_quant_offset;
+	}
+
+	inline glm::vec3 quant_scale() {
+		return m_quant_scale;
+	}
+
 private:
-	void capture_point_cloud();
-	void create_xy_table(const k4a::calibration* calibration, k4a::image xy_table);
-	void generate_point_cloud(const k4a::image xy_table, k4a::image point_cloud, const k4a::image transformed_color_image, int* point_count);
+	void apply_build_result(const PointcloudBuildResult& result);
 	void write_point_cloud_to_buffer();
+	void compute_quantization(glm::vec3& offset, glm::vec3& extent);
+	void downsample_points();
+	// bounds and furthest point of the current points. The centroid is left alone: a capture keeps the
+	// camera space centroid its points were centered on, the loaders set theirs
+	void update_extent();
+	size_t filter_outliers();
+	// drops the index and the registration snapshot, after every change of m_points. The GPU upload
+	// does not touch them, so a kd-tree built for the outlier removal survives it.
+	void invalidate_spatial_data();
 
 public:
 	bool m_is_initialized = false;
@@ -82,9 +201,25 @@ public:
 	glm::quat m_cam_orientation = glm::quat();
 	float m_furthest_point = 1.f;
 	glm::vec3 m_centroid = glm::vec3(0.f);
+	glm::vec3 m_bounds_min = glm::vec3(0.f);
+	glm::vec3 m_bounds_max = glm::vec3(0.f);
+	glm::vec3 m_quant_offset = glm::vec3(0.f);
+	glm::vec3 m_quant_scale = glm::vec3(1.f);
+	float m_voxel_size = POINTCLOUD_DEFAULT_VOXEL_SIZE;
+	bool m_outlier_removal = POINTCLOUD_OUTLIER_REMOVAL;
+	int m_outlier_neighbors = POINTCLOUD_OUTLIER_NEIGHBORS;
+	float m_outlier_stddev_mul = POINTCLOUD_OUTLIER_STDDEV_MUL;
+	bool m_has_support_plane = false;
+	glm::vec4 m_support_plane = glm::vec4(0.f);
+	bool m_has_plane_prior = false;
+	glm::vec4 m_plane_prior = glm::vec4(0.f);
 
 	// points
-	std::vector<PointAttributes> m_points;
+	PointBuffer m_points;
+	std::vector<uint32_t> m_triangles;
 	wgpu::Buffer m_gpu_buffer = nullptr;
+	KdTree m_spatial_index;
+	bool m_spatial_index_valid = false;
+	std::weak_ptr<RegistrationPyramid> m_registration_pyramid;
 };
 
@@ -0,0 +1,344 @@
+#include "PointcloudBuilder.h"
+
+#include "PointcloudKernels.h"
+#include "PointcloudFilters.h"
+#include "ThreadPool.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <format>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	// compacts the first `count` scratch points in place, keeping the points off the plane (or only
+	// the ones in front of it), and recomputes the kernel result for the survivors. `remap` (if set)
+	// receives the new index of every point, UINT32_MAX for removed ones.
+	PointcloudKernelResult remove_plane_points(PointBuffer& scratch, size_t count, const glm::vec4& plane, float threshold, bool keep_above, uint32_t* remap)
+	{
+		PointcloudKernelResult result;
+		const auto positions = scratch.positions();
+		const auto colors = scratch.colors();
+		const auto normals = scratch.normals();
+		const bool has_normals = scratch.has_normals();
+
+		for (size_t i = 0; i < count; i++) {
+			const glm::vec3 p = positions[i];
+			const float distance = glm::dot(glm::vec3(plane), p) + plane.w;
+			if (keep_above ? distance <= threshold : std::abs(distance) <= threshold) {
+				if (remap)
+					remap[i] = UINT32_MAX;
+				continue;
+			}
+
+			const size_t o = result.count++;
+			if (remap)
+				remap[i] = (uint32_t)o;
+			positions[o] = p;
+			colors[o] = colors[i];
+			if (has_normals) {
+				normals[o] = normals[i];
+			}
+
+			result.sum += p;
+			result.max_radius_sq = std::max(result.max_radius_sq, glm::dot(p, p));
+			result.bounds_min = glm::min(result.bounds_min, p);
+			result.bounds_max = glm::max(result.bounds_max, p);
+		}
+
+		return result;
+	}
+
+	// copies every stride-th pixel of every stride-th row into a dense grid, in parallel row tiles
+	template<typename T>
+	void gather_strided(const T* source, size_t source_row_pixels, int grid_width, int grid_height, int stride, T* out)
+	{
+		const size_t tile_count = (grid_height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+		ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+			const size_t row_begin = tile * POINTCLOUD_TILE_ROWS;
+			const size_t row_end = std::min<size_t>(row_begin + POINTCLOUD_TILE_ROWS, grid_height);
+			for (size_t y = row_begin; y < row_end; y++) {
+				const T* source_row = source + y * stride * source_row_pixels;
+				T* out_row = out + y * grid_width;
+				for (int x = 0; x < grid_width; x++) {
+					out_row[x] = source_row[x * stride];
+				}
+			}
+		});
+	}
+}
+
+PointcloudBuildResult PointcloudBuilder::build(const k4a::image& depth_image, const k4a::image& color_image, const k4a::calibration& calibration, PointBuffer& points, const glm::vec4* plane_prior, std::vector<uint32_t>* triangles)
+{
+	PointcloudBuildResult result;
+	points.clear();
+
+	const uint16_t* depth_data = filter_depth(depth_image, calibration, true, result);
+	if (!depth_data) {
+		return result;
+	}
+
+	depth_data = transform_color(depth_image, depth_data, color_image);
+	generate(depth_data, points, plane_prior, result, triangles);
+	return result;
+}
+
+const uint16_t* PointcloudBuilder::filter_depth(const k4a::image& depth_image, const k4a::calibration& calibration, bool apply_filters, PointcloudBuildResult& result)
+{
+	m_current = nullptr;
+
+	if (!depth_image) {
+		Logger::log("Tried to capture empty depth image.", LoggingSeverity::Error);
+		return nullptr;
+	}
+
+	Resources& res = resources_for(calibration);
+	m_current = &res;
+	m_current_width = depth_image.get_width_pixels();
+	m_current_height = depth_image.get_height_pixels();
+
+	const int width = m_current_width;
+	const int height = m_current_height;
+
+	const uint16_t* depth_data = (const uint16_t*)depth_image.get_buffer();
+	if (!apply_filters) {
+		return depth_data;
+	}
+
+	if (m_reject_flying_pixels) {
+		// rejected pixels are zeroed in a copy, the kernels below skip zero depth
+		res.filtered_depth.resize((size_t)width * height);
+		result.flying_pixels = PointcloudKernels::reject_flying_pixels_parallel(depth_data, width, height, res.filtered_depth.data());
+		depth_data = res.filtered_depth.data();
+	}
+
+	if (m_clip_settings.enabled) {
+		const size_t pixel_count = (size_t)width * height;
+		if (res.clip_min_depth.size() != pixel_count || !(res.clip_settings == m_clip_settings)) {
+			res.clip_min_depth.resize(pixel_count);
+			res.clip_max_depth.resize(pixel_count);
+			PointcloudKernels::build_clip_ranges(m_clip_settings, res.xy_table->data(), width, height, res.clip_min_depth.data(), res.clip_max_depth.data());
+			res.clip_settings = m_clip_settings;
+		}
+
+		// clipped pixels are zeroed as well, in place if the flying pixel pass already made a copy
+		res.filtered_depth.resize(pixel_count);
+		result.clipped_pixels = PointcloudKernels::clip_depth_parallel(depth_data, res.clip_min_depth.data(), res.clip_max_depth.data(), width, height, res.filtered_depth.data());
+		depth_data = res.filtered_depth.data();
+	}
+
+	if (m_component_selection != ComponentSelection::Off) {
+		const size_t pixel_count = (size_t)width * height;
+		res.component_parents.resize(pixel_count);
+		res.component_labels.resize(pixel_count);
+		PointcloudKernels::label_components(depth_data, width, height, res.component_parents.data(), res.component_labels.data());
+
+		// without a seed the largest component is kept
+		const glm::ivec2 seed = m_component_selection == ComponentSelection::Seed ? m_component_seed : glm::ivec2(-1);
+		res.filtered_depth.resize(pixel_count);
+		result.component_pixels = PointcloudKernels::select_component(depth_data, res.component_labels.data(), width, height, seed, res.filtered_depth.data());
+		depth_data = res.filtered_depth.data();
+	}
+
+	return depth_data;
+}
+
+const uint16_t* PointcloudBuilder::transform_color(const k4a::image& depth_image, const uint16_t* depth_data, const k4a::image& color_image)
+{
+	if (!m_current || !depth_data)
+		return nullptr;
+
+	Resources& res = *m_current;
+	if (m_generation_space == GenerationSpace::Depth) {
+		res.transformation.color_image_to_depth_camera(depth_image, color_image, &res.transformed_color_image);
+		m_current_xy_table = res.xy_table->data();
+		m_current_color = res.transformed_color_image.get_buffer();
+		return depth_data;
+	}
+
+	if (!color_image || color_image.get_format() != K4A_IMAGE_FORMAT_COLOR_BGRA32) {
+		Logger::log("Color space generation needs a BGRA color image.", LoggingSeverity::Error);
+		m_current = nullptr;
+		return nullptr;
+	}
+
+	const int color_width = color_image.get_width_pixels();
+	const int color_height = color_image.get_height_pixels();
+	if (!res.transformed_depth_image || res.transformed_depth_image.get_width_pixels() != color_width || res.transformed_depth_image.get_height_pixels() != color_height) {
+		res.transformed_depth_image = k4a::image::create(K4A_IMAGE_FORMAT_DEPTH16, color_width, color_height, color_width * (int)sizeof(uint16_t));
+	}
+
+	// the filters write into a plain buffer, the transformation needs it wrapped as an image
+	k4a::image source_depth = depth_image;
+	if (depth_data != (const uint16_t*)depth_image.get_buffer()) {
+		const int width = depth_image.get_width_pixels();
+		const int height = depth_image.get_height_pixels();
+		source_depth = k4a::image::create_from_buffer(K4A_IMAGE_FORMAT_DEPTH16, width, height, width * (int)sizeof(uint16_t),
+			(uint8_t*)depth_data, (size_t)width * height * sizeof(uint16_t), nullptr, nullptr);
+	}
+	res.transformation.depth_image_to_color_camera(source_depth, &res.transformed_depth_image);
+
+	const int stride = m_color_stride >= 4 ? 4 : (m_color_stride >= 2 ? 2 : 1);
+	if (!res.color_xy_table || res.color_xy_stride != stride) {
+		res.color_xy_table = XYTableCache::get(res.calibration, K4A_CALIBRATION_TYPE_COLOR, stride);
+		res.color_xy_stride = stride;
+	}
+
+	m_current_width = XYTableCache::table_size(color_width, stride);
+	m_current_height = XYTableCache::table_size(color_height, stride);
+	m_current_xy_table = res.color_xy_table->data();
+
+	const uint16_t* transformed_depth = (const uint16_t*)res.transformed_depth_image.get_buffer();
+	const uint32_t* color = (const uint32_t*)color_image.get_buffer();
+	const size_t color_row_pixels = color_image.get_stride_bytes() / sizeof(uint32_t);
+
+	// the full resolution is read in place unless the color rows are padded
+	if (stride == 1 && color_row_pixels == (size_t)color_width) {
+		m_current_color = color_image.get_buffer();
+		return transformed_depth;
+	}
+
+	const size_t grid_pixels = (size_t)m_current_width * m_current_height;
+	res.strided_depth.resize(grid_pixels);
+	res.strided_color.resize(grid_pixels);
+	gather_strided(transformed_depth, color_width, m_current_width, m_current_height, stride, res.strided_depth.data());
+	gather_strided(color, color_row_pixels, m_current_width, m_current_height, stride, res.strided_color.data());
+
+	m_current_color = (const uint8_t*)res.strided_color.data();
+	return res.strided_depth.data();
+}
+
+void PointcloudBuilder::generate(const uint16_t* depth_data, PointBuffer& points, const glm::vec4* plane_prior, PointcloudBuildResult& result, std::vector<uint32_t>* triangles)
+{
+	points.clear();
+	if (triangles)
+		triangles->clear();
+	if (!m_current || !depth_data)
+		return;
+
+	Resources& res = *m_current;
+	const int width = m_current_width;
+	const int height = m_current_height;
+
+	static float scale = 1.f / 100.f;
+
+	// color space grids can be larger than the depth image
+	if (res.scratch_points.size() < (size_t)width * height) {
+		res.scratch_points.resize((size_t)width * height);
+	}
+	res.scratch_points.set_has_normals(m_estimate_normals);
+	points.set_has_normals(m_estimate_normals);
+
+	// single fused pass over row tiles in parallel: validate, unproject, color and compact into scratch
+	PointcloudKernelResult kernel_result = PointcloudKernels::generate_points_parallel(depth_data, m_current_xy_table, m_current_color, width, height, scale, res.scratch_points.streams());
+	if (kernel_result.count == 0) {
+		return;
+	}
+
+	// the compaction keeps the pixel order, so every pixel's point index is a prefix count
+	const bool triangulate = m_triangulate && triangles;
+	if (triangulate) {
+		res.point_indices.resize((size_t)width * height);
+		PointcloudKernels::index_grid_points(depth_data, m_current_xy_table, m_current_color, width, height, res.point_indices.data());
+	}
+
+	if (m_plane_mode != PlaneSegmentationMode::Off) {
+		// meters -> point units
+		const float threshold = m_plane_threshold * 1000.f * scale;
+		const auto scratch_positions = res.scratch_points.positions().first(kernel_result.count);
+		result.has_plane = PointcloudFilters::fit_plane_ransac(scratch_positions, threshold, plane_prior, result.plane) > 0;
+
+		if (result.has_plane && m_plane_mode != PlaneSegmentationMode::Detect) {
+			const size_t count_before = kernel_result.count;
+			if (triangulate) {
+				res.plane_remap.resize(count_before);
+			}
+			kernel_result = remove_plane_points(res.scratch_points, count_before, result.plane, threshold, m_plane_mode == PlaneSegmentationMode::KeepAbove, triangulate ? res.plane_remap.data() : nullptr);
+			result.plane_points = count_before - kernel_result.count;
+			if (kernel_result.count == 0) {
+				return;
+			}
+
+			if (triangulate) {
+				for (uint32_t& index : res.point_indices) {
+					if (index != UINT32_MAX)
+						index = res.plane_remap[index];
+				}
+			}
+		}
+	}
+
+	result.count = kernel_result.count;
+	result.centroid = kernel_result.sum / static_cast<float>(kernel_result.count);
+	result.bounds_min = kernel_result.bounds_min - result.centroid;
+	result.bounds_max = kernel_result.bounds_max - result.centroid;
+	result.furthest_point = std::sqrt(kernel_result.max_radius_sq);
+
+	// the cloud only keeps the survivors, centered around their centroid
+	points.resize(kernel_result.count);
+	const auto scratch_positions = res.scratch_points.positions();
+	const auto positions = points.positions();
+	for (size_t i = 0; i < kernel_result.count; i++) {
+		positions[i] = scratch_positions[i] - result.centroid;
+	}
+	std::memcpy(points.colors().data(), res.scratch_points.colors().data(), kernel_result.count * sizeof(RgbaPixel));
+	if (m_estimate_normals) {
+		std::memcpy(points.normals().data(), res.scratch_points.normals().data(), kernel_result.count * sizeof(glm::vec3));
+	}
+
+	if (triangulate) {
+		PointcloudKernels::triangulate_grid(depth_data, res.point_indices.data(), width, height, *triangles);
+		result.triangles = triangles->size() / 3;
+	}
+}
+
+void PointcloudBuilder::copy_settings(const PointcloudBuilder& other)
+{
+	m_estimate_normals = other.m_estimate_normals;
+	m_triangulate = other.m_triangulate;
+	m_reject_flying_pixels = other.m_reject_flying_pixels;
+	m_clip_settings = other.m_clip_settings;
+	m_generation_space = other.m_generation_space;
+	m_color_stride = other.m_color_stride;
+	m_component_selection = other.m_component_selection;
+	m_component_seed = other.m_component_seed;
+	m_plane_mode = other.m_plane_mode;
+	m_plane_threshold = other.m_plane_threshold;
+}
+
+void PointcloudBuilder::clear()
+{
+	m_resources.clear();
+	m_current = nullptr;
+}
+
+PointcloudBuilder::Resources& PointcloudBuilder::resources_for(const k4a::calibration& calibration)
+{
+	// the transformation also depends on the color camera and the depth -> color extrinsics
+	const auto& color = calibration.color_camera_calibration;
+	const auto& extrinsics = calibration.extrinsics[K4A_CALIBRATION_TYPE_DEPTH][K4A_CALIBRATION_TYPE_COLOR];
+	uint64_t hash = XYTableCache::calibration_hash(calibration);
+	hash = Helper::hash_bytes(color.intrinsics.parameters.v, sizeof(color.intrinsics.parameters.v), hash);
+	hash = Helper::hash_bytes(&color.resolution_width, sizeof(color.resolution_width), hash);
+	hash = Helper::hash_bytes(&color.resolution_height, sizeof(color.resolution_height), hash);
+	hash = Helper::hash_bytes(&extrinsics, sizeof(extrinsics), hash);
+
+	auto it = m_resources.find(hash);
+	if (it != m_resources.end()) {
+		return it->second;
+	}
+
+	const int width = calibration.depth_camera_calibration.resolution_width;
+	const int height = calibration.depth_camera_calibration.resolution_height;
+
+	Resources& res = m_resources[hash];
+	res.calibration = calibration;
+	res.transformation = k4a::transformation(calibration);
+	res.transformed_color_image = k4a::image::create(K4A_IMAGE_FORMAT_COLOR_BGRA32, width, height, width * 4);
+	res.xy_table = XYTableCache::get(calibration);
+	res.scratch_points.resize((size_t)width * height);
+
+	Logger::log(std::format("Created point cloud builder resources ({}x{})", width, height));
+
+	return res;
+}
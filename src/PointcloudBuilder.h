@@ -0,0 +1,197 @@
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <k4a/k4a.hpp>
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+#include "XYTableCache.h"
+#include "PointBuffer.h"
+
+#pragma once
+
+struct PointcloudBuildResult {
+	size_t count = 0;
+	glm::vec3 centroid = glm::vec3(0.f);
+	glm::vec3 bounds_min = glm::vec3(0.f);
+	glm::vec3 bounds_max = glm::vec3(0.f);
+	float furthest_point = 0.f;
+	size_t flying_pixels = 0;
+	size_t clipped_pixels = 0;
+	size_t component_pixels = 0; // outside the selected component
+
+	// dominant plane in camera space (before centering), normalized with the camera on its positive side
+	bool has_plane = false;
+	glm::vec4 plane = glm::vec4(0.f);
+	size_t plane_points = 0; // removed by the plane stage
+
+	size_t triangles = 0;
+};
+
+// Long-lived helper that turns depth + color captures into centered point clouds.
+// Keeps one k4a transformation handle and one set of full-frame scratch buffers per
+// calibration, so repeated captures and reloads do no per-capture setup.
+// Not thread-safe, use one builder per thread.
+class PointcloudBuilder {
+public:
+	// `plane_prior` is scored as an extra RANSAC hypothesis, e.g. the plane of the previous capture.
+	// `triangles` receives the grid mesh over `points` if triangulation is on.
+	PointcloudBuildResult build(const k4a::image& depth_image, const k4a::image& color_image, const k4a::calibration& calibration, PointBuffer& points, const glm::vec4* plane_prior = nullptr, std::vector<uint32_t>* triangles = nullptr);
+	void clear();
+
+	// the stages of build() for callers that run them one by one (see PointcloudPipeline). they have to
+	// be called in this order on the same builder. filter_depth returns the filtered depth image, and
+	// transform_color the depth grid generate reads (the same one in depth space), or nullptr if there
+	// is none. both stay valid until the next filter_depth call.
+	const uint16_t* filter_depth(const k4a::image& depth_image, const k4a::calibration& calibration, bool apply_filters, PointcloudBuildResult& result);
+	const uint16_t* transform_color(const k4a::image& depth_image, const uint16_t* depth_data, const k4a::image& color_image);
+	void generate(const uint16_t* depth_data, PointBuffer& points, const glm::vec4* plane_prior, PointcloudBuildResult& result, std::vector<uint32_t>* triangles = nullptr);
+
+	// size of the depth grid of the current frame, the depth image or the strided color image
+	inline glm::ivec2 grid_size() const {
+		return { m_current_width, m_current_height };
+	}
+
+	// takes over every setting of `other` but keeps the own resources, for per-thread builders
+	void copy_settings(const PointcloudBuilder& other);
+
+	// normals from the depth grid, stored as the optional normal stream of the output
+	inline void set_estimate_normals(bool estimate_normals) {
+		m_estimate_normals = estimate_normals;
+	}
+
+	inline bool estimate_normals() const {
+		return m_estimate_normals;
+	}
+
+	// in color space the depth is transformed into the color camera and every `color_stride`-th
+	// color pixel (1, 2 or 4) becomes a point, so the colors are not resampled
+	inline void set_generation_space(GenerationSpace generation_space) {
+		m_generation_space = generation_space;
+	}
+
+	inline GenerationSpace generation_space() const {
+		return m_generation_space;
+	}
+
+	inline void set_color_stride(int color_stride) {
+		m_color_stride = color_stride;
+	}
+
+	inline int color_stride() const {
+		return m_color_stride;
+	}
+
+	// indexed mesh from the depth grid that shares its vertices with the points
+	inline void set_triangulate(bool triangulate) {
+		m_triangulate = triangulate;
+	}
+
+	inline bool triangulate() const {
+		return m_triangulate;
+	}
+
+	// drops depth pixels along silhouettes before unprojecting
+	inline void set_reject_flying_pixels(bool reject_flying_pixels) {
+		m_reject_flying_pixels = reject_flying_pixels;
+	}
+
+	inline bool reject_flying_pixels() const {
+		return m_reject_flying_pixels;
+	}
+
+	// depth range / roi / crop box, applied to the raw depth before unprojecting
+	inline void set_clip_settings(const DepthClipSettings& clip_settings) {
+		m_clip_settings = clip_settings;
+	}
+
+	inline const DepthClipSettings& clip_settings() const {
+		return m_clip_settings;
+	}
+
+	// keeps one connected component of the depth grid, the largest or the one under the seed pixel
+	inline void set_component_selection(ComponentSelection component_selection) {
+		m_component_selection = component_selection;
+	}
+
+	inline ComponentSelection component_selection() const {
+		return m_component_selection;
+	}
+
+	// in depth image pixels
+	inline void set_component_seed(glm::ivec2 component_seed) {
+		m_component_seed = component_seed;
+	}
+
+	inline glm::ivec2 component_seed() const {
+		return m_component_seed;
+	}
+
+	// RANSAC support plane (floor / table) after generation, optionally removed from the points
+	inline void set_plane_mode(PlaneSegmentationMode plane_mode) {
+		m_plane_mode = plane_mode;
+	}
+
+	inline PlaneSegmentationMode plane_mode() const {
+		return m_plane_mode;
+	}
+
+	// inlier distance in meters
+	inline void set_plane_threshold(float plane_threshold) {
+		m_plane_threshold = plane_threshold;
+	}
+
+	inline float plane_threshold() const {
+		return m_plane_threshold;
+	}
+
+private:
+	struct Resources {
+		k4a::calibration calibration;
+		k4a::transformation transformation = nullptr;
+		k4a::image transformed_color_image = nullptr;
+		std::shared_ptr<const XYTable> xy_table;
+		PointBuffer scratch_points;
+		std::vector<uint16_t> filtered_depth;
+
+		// per-pixel depth ranges for m_clip_settings, rebuilt when the settings change
+		DepthClipSettings clip_settings;
+		std::vector<uint16_t> clip_min_depth;
+		std::vector<uint16_t> clip_max_depth;
+
+		std::vector<uint32_t> component_parents;
+		std::vector<uint32_t> component_labels;
+
+		// grid pixel -> point, and the plane stage's old -> new point index
+		std::vector<uint32_t> point_indices;
+		std::vector<uint32_t> plane_remap;
+
+		// color space generation, allocated on first use
+		k4a::image transformed_depth_image = nullptr;
+		std::shared_ptr<const XYTable> color_xy_table;
+		int color_xy_stride = 0;
+		std::vector<uint16_t> strided_depth;
+		std::vector<uint32_t> strided_color; // bgra
+	};
+
+	Resources& resources_for(const k4a::calibration& calibration);
+
+	std::unordered_map<uint64_t, Resources> m_resources;
+	Resources* m_current = nullptr; // of the frame between filter_depth and generate
+	int m_current_width = 0;
+	int m_current_height = 0;
+	const k4a_float2_t* m_current_xy_table = nullptr;
+	const uint8_t* m_current_color = nullptr;
+
+	GenerationSpace m_generation_space = GenerationSpace::Depth;
+	int m_color_stride = POINTCLOUD_COLOR_SPACE_STRIDE;
+	bool m_estimate_normals = POINTCLOUD_ESTIMATE_NORMALS;
+	bool m_triangulate = POINTCLOUD_TRIANGULATE;
+	bool m_reject_flying_pixels = POINTCLOUD_REJECT_FLYING_PIXELS;
+	DepthClipSettings m_clip_settings;
+	ComponentSelection m_component_selection = ComponentSelection::Off;
+	glm::ivec2 m_component_seed = glm::ivec2(-1);
+	PlaneSegmentationMode m_plane_mode = PlaneSegmentationMode::Off;
+	float m_plane_threshold = POINTCLOUD_PLANE_DISTANCE_THRESHOLD;
+};
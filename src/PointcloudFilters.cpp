@@ -0,0 +1,653 @@
+#include "PointcloudFilters.h"
+
+#include "ThreadPool.h"
+#include "PointcloudKernels.h"
+#include "Helpers.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+	constexpr uint64_t EMPTY_KEY = ~0ull;
+	constexpr int VOXEL_KEY_BITS = 21;
+	constexpr int VOXEL_SHARD_BITS = std::countr_zero((unsigned)POINTCLOUD_VOXEL_SHARDS);
+	static_assert(std::has_single_bit((unsigned)POINTCLOUD_VOXEL_SHARDS));
+
+	struct VoxelAccumulator {
+		glm::vec3 position = glm::vec3(0.f);
+		glm::vec3 normal = glm::vec3(0.f);
+		uint32_t r = 0, g = 0, b = 0;
+		uint32_t count = 0;
+	};
+
+	// 21 bits per axis, centered around the origin. Cells outside that range would alias the border
+	// cells, they get EMPTY_KEY instead.
+	inline uint64_t voxel_key(const glm::vec3& position, float inv_leaf_size)
+	{
+		const glm::vec3 cell = glm::floor(position * inv_leaf_size) + (float)(1 << (VOXEL_KEY_BITS - 1));
+		const float max_cell = (float)((1 << VOXEL_KEY_BITS) - 1);
+		if (!(cell.x >= 0.f && cell.y >= 0.f && cell.z >= 0.f && cell.x <= max_cell && cell.y <= max_cell && cell.z <= max_cell))
+			return EMPTY_KEY;
+		return (uint64_t)cell.x | ((uint64_t)cell.y << VOXEL_KEY_BITS) | ((uint64_t)cell.z << (2 * VOXEL_KEY_BITS));
+	}
+
+	// splitmix64 finalizer, the high bits select the shard and the low bits the table slot
+	inline uint64_t mix(uint64_t key)
+	{
+		key ^= key >> 30;
+		key *= 0xbf58476d1ce4e5b9ull;
+		key ^= key >> 27;
+		key *= 0x94d049bb133111ebull;
+		key ^= key >> 31;
+		return key;
+	}
+
+	inline size_t shard_of(uint64_t key)
+	{
+		return (size_t)(mix(key) >> (64 - VOXEL_SHARD_BITS));
+	}
+}
+
+size_t PointcloudFilters::voxel_downsample(const PointBuffer& in, float leaf_size, PointBuffer& out)
+{
+	if (leaf_size <= 0.f || in.empty()) {
+		out = in;
+		return out.size();
+	}
+
+	const float inv_leaf_size = 1.f / leaf_size;
+	const size_t count = in.size();
+	const size_t chunk_count = (count + POINTCLOUD_VOXEL_CHUNK_SIZE - 1) / POINTCLOUD_VOXEL_CHUNK_SIZE;
+	const auto positions = in.positions();
+	const auto colors = in.colors();
+	const auto normals = in.normals();
+	const bool has_normals = in.has_normals();
+
+	ThreadPool& pool = ThreadPool::global();
+
+	// voxel key per point and a shard histogram per chunk
+	std::vector<uint64_t> keys(count);
+	std::vector<uint32_t> histograms(chunk_count * POINTCLOUD_VOXEL_SHARDS, 0);
+	std::vector<size_t> chunk_outside(chunk_count, 0);
+	pool.parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_VOXEL_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_VOXEL_CHUNK_SIZE, count);
+		uint32_t* histogram = histograms.data() + chunk * POINTCLOUD_VOXEL_SHARDS;
+
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3& p = positions[i];
+			if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) {
+				keys[i] = EMPTY_KEY;
+				continue;
+			}
+
+			keys[i] = voxel_key(p, inv_leaf_size);
+			if (keys[i] == EMPTY_KEY) {
+				chunk_outside[chunk]++;
+				continue;
+			}
+			histogram[shard_of(keys[i])]++;
+		}
+	});
+
+	size_t outside = 0;
+	for (size_t chunk_outside_count : chunk_outside) {
+		outside += chunk_outside_count;
+	}
+	if (outside > 0) {
+		Logger::log(std::format("Voxel grid dropped {} points outside its range of +-{} units at leaf size {}", outside, (float)(1 << (VOXEL_KEY_BITS - 1)) * leaf_size, leaf_size), LoggingSeverity::Warning);
+	}
+
+	// stable scatter of the point indices, grouped by shard
+	std::vector<uint32_t> offsets(chunk_count * POINTCLOUD_VOXEL_SHARDS);
+	std::vector<uint32_t> shard_begin(POINTCLOUD_VOXEL_SHARDS + 1);
+	uint32_t total = 0;
+	for (size_t shard = 0; shard < POINTCLOUD_VOXEL_SHARDS; shard++) {
+		shard_begin[shard] = total;
+		for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+			offsets[chunk * POINTCLOUD_VOXEL_SHARDS + shard] = total;
+			total += histograms[chunk * POINTCLOUD_VOXEL_SHARDS + shard];
+		}
+	}
+	shard_begin[POINTCLOUD_VOXEL_SHARDS] = total;
+
+	std::vector<uint32_t> order(total);
+	pool.parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_VOXEL_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_VOXEL_CHUNK_SIZE, count);
+		uint32_t* offset = offsets.data() + chunk * POINTCLOUD_VOXEL_SHARDS;
+
+		for (size_t i = begin; i < end; i++) {
+			if (keys[i] != EMPTY_KEY) {
+				order[offset[shard_of(keys[i])]++] = (uint32_t)i;
+			}
+		}
+	});
+
+	// accumulate each shard in its own linear probing table, voxels keep first-seen order
+	std::vector<std::vector<VoxelAccumulator>> shard_voxels(POINTCLOUD_VOXEL_SHARDS);
+	pool.parallel_for(POINTCLOUD_VOXEL_SHARDS, [&](size_t shard) {
+		const uint32_t begin = shard_begin[shard];
+		const uint32_t end = shard_begin[shard + 1];
+		if (begin == end)
+			return;
+
+		const size_t capacity = std::bit_ceil((size_t)(end - begin) * 2);
+		const size_t mask = capacity - 1;
+
+		thread_local std::vector<uint64_t> table_keys;
+		thread_local std::vector<uint32_t> table_values;
+		table_keys.assign(capacity, EMPTY_KEY);
+		table_values.resize(capacity);
+
+		auto& voxels = shard_voxels[shard];
+		for (uint32_t j = begin; j < end; j++) {
+			const uint32_t i = order[j];
+			const uint64_t key = keys[i];
+
+			size_t slot = mix(key) & mask;
+			while (table_keys[slot] != EMPTY_KEY && table_keys[slot] != key) {
+				slot = (slot + 1) & mask;
+			}
+
+			if (table_keys[slot] == EMPTY_KEY) {
+				table_keys[slot] = key;
+				table_values[slot] = (uint32_t)voxels.size();
+				voxels.emplace_back();
+			}
+
+			VoxelAccumulator& voxel = voxels[table_values[slot]];
+			voxel.position += positions[i];
+			voxel.r += colors[i].r;
+			voxel.g += colors[i].g;
+			voxel.b += colors[i].b;
+			if (has_normals) {
+				voxel.normal += normals[i];
+			}
+			voxel.count++;
+		}
+	});
+
+	// write the averages in shard order
+	std::vector<size_t> out_begin(POINTCLOUD_VOXEL_SHARDS + 1, 0);
+	for (size_t shard = 0; shard < POINTCLOUD_VOXEL_SHARDS; shard++) {
+		out_begin[shard + 1] = out_begin[shard] + shard_voxels[shard].size();
+	}
+
+	out.clear();
+	out.set_has_normals(has_normals);
+	out.resize(out_begin[POINTCLOUD_VOXEL_SHARDS]);
+	const auto out_positions = out.positions();
+	const auto out_colors = out.colors();
+	const auto out_normals = out.normals();
+
+	pool.parallel_for(POINTCLOUD_VOXEL_SHARDS, [&](size_t shard) {
+		size_t index = out_begin[shard];
+		for (const auto& voxel : shard_voxels[shard]) {
+			const uint32_t half = voxel.count / 2;
+			out_positions[index] = voxel.position / (float)voxel.count;
+			out_colors[index] = {
+				(uint8_t)((voxel.r + half) / voxel.count),
+				(uint8_t)((voxel.g + half) / voxel.count),
+				(uint8_t)((voxel.b + half) / voxel.count),
+				255
+			};
+			if (has_normals) {
+				const float length = glm::length(voxel.normal);
+				out_normals[index] = length > 0.f ? voxel.normal / length : glm::vec3(0.f);
+			}
+			index++;
+		}
+	});
+
+	return out.size();
+}
+
+VoxelMap::VoxelMap(float leaf_size)
+	: m_leaf_size(leaf_size)
+{
+}
+
+size_t VoxelMap::insert(const PointBuffer& points, const glm::mat4& pose)
+{
+	const size_t count = points.size();
+	m_transformed.resize(count);
+	PointcloudKernels::transform_points(points.positions().data(), count, pose, m_transformed.data());
+	const auto colors = points.colors();
+
+	const float inv_leaf_size = 1.f / m_leaf_size;
+	size_t outside = 0;
+	for (size_t i = 0; i < count; i++) {
+		const glm::vec3& p = m_transformed[i];
+		if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+			continue;
+
+		const uint64_t key = voxel_key(p, inv_leaf_size);
+		if (key == EMPTY_KEY) {
+			outside++;
+			continue;
+		}
+
+		if ((m_cells.size() + 1) * 2 > m_table_keys.size()) {
+			grow();
+		}
+
+		const size_t mask = m_table_keys.size() - 1;
+		size_t slot = mix(key) & mask;
+		while (m_table_keys[slot] != EMPTY_KEY && m_table_keys[slot] != key) {
+			slot = (slot + 1) & mask;
+		}
+
+		if (m_table_keys[slot] == EMPTY_KEY) {
+			m_table_keys[slot] = key;
+			m_table_values[slot] = (uint32_t)m_cells.size();
+			m_cells.emplace_back();
+		}
+
+		Cell& cell = m_cells[m_table_values[slot]];
+		cell.position += p;
+		cell.r += colors[i].r;
+		cell.g += colors[i].g;
+		cell.b += colors[i].b;
+		cell.count++;
+	}
+
+	if (outside > 0) {
+		Logger::log(std::format("Voxel map dropped {} points outside its range of +-{} units at leaf size {}", outside, (float)(1 << (VOXEL_KEY_BITS - 1)) * m_leaf_size, m_leaf_size), LoggingSeverity::Warning);
+	}
+	return m_cells.size();
+}
+
+void VoxelMap::extract(PointBuffer& out) const
+{
+	out.clear();
+	out.set_has_normals(false);
+	out.resize(m_cells.size());
+	const auto out_positions = out.positions();
+	const auto out_colors = out.colors();
+
+	const size_t chunk_count = (m_cells.size() + POINTCLOUD_VOXEL_CHUNK_SIZE - 1) / POINTCLOUD_VOXEL_CHUNK_SIZE;
+	ThreadPool::global().parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_VOXEL_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_VOXEL_CHUNK_SIZE, m_cells.size());
+		for (size_t i = begin; i < end; i++) {
+			const Cell& cell = m_cells[i];
+			const uint32_t half = cell.count / 2;
+			out_positions[i] = cell.position / (float)cell.count;
+			out_colors[i] = {
+				(uint8_t)((cell.r + half) / cell.count),
+				(uint8_t)((cell.g + half) / cell.count),
+				(uint8_t)((cell.b + half) / cell.count),
+				255
+			};
+		}
+	});
+}
+
+void VoxelMap::grow()
+{
+	const size_t capacity = std::max<size_t>(m_table_keys.size() * 2, 1024);
+	const size_t mask = capacity - 1;
+	std::vector<uint64_t> keys(capacity, EMPTY_KEY);
+	std::vector<uint32_t> values(capacity);
+
+	for (size_t slot = 0; slot < m_table_keys.size(); slot++) {
+		if (m_table_keys[slot] == EMPTY_KEY)
+			continue;
+
+		size_t target = mix(m_table_keys[slot]) & mask;
+		while (keys[target] != EMPTY_KEY) {
+			target = (target + 1) & mask;
+		}
+		keys[target] = m_table_keys[slot];
+		values[target] = m_table_values[slot];
+	}
+
+	m_table_keys = std::move(keys);
+	m_table_values = std::move(values);
+}
+
+size_t PointcloudFilters::remove_statistical_outliers(const PointBuffer& in, const KdTree& index, int neighbors, float stddev_mul, PointBuffer& out, uint32_t* remap)
+{
+	const size_t count = in.size();
+	const size_t k = (size_t)std::max(neighbors, 1);
+	if (index.size() <= k) {
+		out = in;
+		if (remap) {
+			for (size_t i = 0; i < count; i++) {
+				remap[i] = (uint32_t)i;
+			}
+		}
+		return 0;
+	}
+
+	ThreadPool& pool = ThreadPool::global();
+
+	// mean neighbor distance per point, queried in tree order so consecutive queries share cache lines.
+	// points missing from the index stay NaN and are dropped.
+	std::vector<float> mean_distances(count, std::numeric_limits<float>::quiet_NaN());
+	const size_t query_chunks = (index.size() + POINTCLOUD_OUTLIER_CHUNK_SIZE - 1) / POINTCLOUD_OUTLIER_CHUNK_SIZE;
+	std::vector<double> chunk_sum(query_chunks, 0.0);
+	std::vector<double> chunk_sum_sq(query_chunks, 0.0);
+
+	pool.parallel_for(query_chunks, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_OUTLIER_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_OUTLIER_CHUNK_SIZE, index.size());
+
+		// one extra neighbor for the point itself
+		thread_local std::vector<uint32_t> indices;
+		thread_local std::vector<float> distances_sq;
+		indices.resize(k + 1);
+		distances_sq.resize(k + 1);
+
+		double sum = 0.0;
+		double sum_sq = 0.0;
+		for (size_t j = begin; j < end; j++) {
+			const uint32_t i = index.index_at(j);
+			const size_t found = index.knn(index.position_at(j), k + 1, indices.data(), distances_sq.data());
+
+			// skip the point itself, or the furthest neighbor if duplicates pushed it out
+			float distance = 0.f;
+			bool skipped = false;
+			for (size_t n = 0; n < found; n++) {
+				if (!skipped && (indices[n] == i || n + 1 == found)) {
+					skipped = true;
+					continue;
+				}
+				distance += std::sqrt(distances_sq[n]);
+			}
+
+			const float mean_distance = distance / (float)(found - 1);
+			mean_distances[i] = mean_distance;
+			sum += mean_distance;
+			sum_sq += (double)mean_distance * mean_distance;
+		}
+
+		chunk_sum[chunk] = sum;
+		chunk_sum_sq[chunk] = sum_sq;
+	});
+
+	// reduced in chunk order, independent of the thread count
+	double sum = 0.0;
+	double sum_sq = 0.0;
+	for (size_t chunk = 0; chunk < query_chunks; chunk++) {
+		sum += chunk_sum[chunk];
+		sum_sq += chunk_sum_sq[chunk];
+	}
+	const double mean = sum / index.size();
+	const double variance = std::max(sum_sq / index.size() - mean * mean, 0.0);
+	const float threshold = (float)(mean + stddev_mul * std::sqrt(variance));
+
+	// compact the survivors in input order
+	const size_t chunk_count = (count + POINTCLOUD_OUTLIER_CHUNK_SIZE - 1) / POINTCLOUD_OUTLIER_CHUNK_SIZE;
+	std::vector<size_t> chunk_offsets(chunk_count + 1, 0);
+	pool.parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_OUTLIER_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_OUTLIER_CHUNK_SIZE, count);
+
+		size_t kept = 0;
+		for (size_t i = begin; i < end; i++) {
+			kept += mean_distances[i] <= threshold;
+		}
+		chunk_offsets[chunk + 1] = kept;
+	});
+
+	for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+		chunk_offsets[chunk + 1] += chunk_offsets[chunk];
+	}
+
+	const bool has_normals = in.has_normals();
+	out.clear();
+	out.set_has_normals(has_normals);
+	out.resize(chunk_offsets[chunk_count]);
+
+	const auto positions = in.positions();
+	const auto colors = in.colors();
+	const auto normals = in.normals();
+	const auto out_positions = out.positions();
+	const auto out_colors = out.colors();
+	const auto out_normals = out.normals();
+
+	pool.parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_OUTLIER_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_OUTLIER_CHUNK_SIZE, count);
+
+		size_t o = chunk_offsets[chunk];
+		for (size_t i = begin; i < end; i++) {
+			if (!(mean_distances[i] <= threshold)) {
+				if (remap)
+					remap[i] = UINT32_MAX;
+				continue;
+			}
+
+			if (remap)
+				remap[i] = (uint32_t)o;
+			out_positions[o] = positions[i];
+			out_colors[o] = colors[i];
+			if (has_normals) {
+				out_normals[o] = normals[i];
+			}
+			o++;
+		}
+	});
+
+	return count - out.size();
+}
+
+void PointcloudFilters::estimate_surfaces(std::span<const glm::vec3> positions, const KdTree& index, int neighbors, glm::vec3* normals, glm::mat3* covariances)
+{
+	// points missing from the index keep the defaults
+	for (size_t i = 0; i < positions.size(); i++) {
+		if (normals)
+			normals[i] = glm::vec3(0.f);
+		if (covariances)
+			covariances[i] = glm::mat3(1.f);
+	}
+
+	const size_t k = (size_t)std::max(neighbors, 3);
+	const size_t chunk_count = (index.size() + POINTCLOUD_OUTLIER_CHUNK_SIZE - 1) / POINTCLOUD_OUTLIER_CHUNK_SIZE;
+
+	ThreadPool::global().parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_OUTLIER_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_OUTLIER_CHUNK_SIZE, index.size());
+
+		thread_local std::vector<uint32_t> indices;
+		thread_local std::vector<float> distances_sq;
+		indices.resize(k);
+		distances_sq.resize(k);
+
+		for (size_t j = begin; j < end; j++) {
+			const uint32_t i = index.index_at(j);
+			const size_t found = index.knn(index.position_at(j), k, indices.data(), distances_sq.data());
+			if (found < 3)
+				continue;
+
+			Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+			for (size_t n = 0; n < found; n++) {
+				const glm::vec3& p = positions[indices[n]];
+				mean += Eigen::Vector3d(p.x, p.y, p.z);
+			}
+			mean /= (double)found;
+
+			Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+			for (size_t n = 0; n < found; n++) {
+				const glm::vec3& p = positions[indices[n]];
+				const Eigen::Vector3d d = Eigen::Vector3d(p.x, p.y, p.z) - mean;
+				covariance += d * d.transpose();
+			}
+
+			// eigenvalues in increasing order, the first axis is the normal
+			Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+			solver.computeDirect(covariance);
+			if (solver.info() != Eigen::Success || solver.eigenvalues()(2) <= 0.)
+				continue;
+
+			const Eigen::Matrix3d axes = solver.eigenvectors();
+			if (normals) {
+				normals[i] = glm::vec3((float)axes(0, 0), (float)axes(1, 0), (float)axes(2, 0));
+			}
+			if (covariances) {
+				const Eigen::Matrix3d plane = axes * Eigen::Vector3d(POINTCLOUD_GICP_EPSILON, 1., 1.).asDiagonal() * axes.transpose();
+				for (int row = 0; row < 3; row++) {
+					for (int col = 0; col < 3; col++) {
+						covariances[i][col][row] = (float)plane(row, col);
+					}
+				}
+			}
+		}
+	});
+}
+
+size_t PointcloudFilters::fit_plane_ransac(std::span<const glm::vec3> positions, float threshold, const glm::vec4* prior, glm::vec4& plane)
+{
+	ThreadPool& pool = ThreadPool::global();
+
+	// hashed subsample in x / y / z streams for the SIMD inlier count. a fixed stride could alias
+	// with the row structure of the depth image.
+	const bool subsample = positions.size() > POINTCLOUD_PLANE_SAMPLE_COUNT;
+	const size_t sample_target = subsample ? POINTCLOUD_PLANE_SAMPLE_COUNT : positions.size();
+	std::vector<float> xs, ys, zs;
+	xs.reserve(sample_target);
+	ys.reserve(sample_target);
+	zs.reserve(sample_target);
+	for (size_t j = 0; j < sample_target; j++) {
+		const glm::vec3& p = positions[subsample ? mix(j) % positions.size() : j];
+		if (std::isfinite(p.x) && std::isfinite(p.y) && std::isfinite(p.z)) {
+			xs.push_back(p.x);
+			ys.push_back(p.y);
+			zs.push_back(p.z);
+		}
+	}
+
+	const size_t sample_count = xs.size();
+	if (sample_count < 3)
+		return 0;
+
+	// hypothesis 0 is the prior, the others are seeded by their index so the result does not depend on the threads
+	std::vector<glm::vec4> hypotheses(POINTCLOUD_PLANE_HYPOTHESES + 1, glm::vec4(0.f));
+	std::vector<size_t> scores(POINTCLOUD_PLANE_HYPOTHESES + 1, 0);
+	if (prior) {
+		hypotheses[0] = *prior;
+		scores[0] = PointcloudKernels::count_plane_inliers(xs.data(), ys.data(), zs.data(), sample_count, *prior, threshold);
+	}
+
+	pool.parallel_for(POINTCLOUD_PLANE_HYPOTHESES, [&](size_t h) {
+		uint64_t state = mix(~(uint64_t)h);
+		auto sample = [&]() {
+			state = mix(state);
+			const size_t i = (size_t)(state % sample_count);
+			return glm::vec3(xs[i], ys[i], zs[i]);
+		};
+
+		const glm::vec3 a = sample();
+		const glm::vec3 b = sample();
+		const glm::vec3 c = sample();
+		const glm::vec3 normal = glm::cross(b - a, c - a);
+		const float length = glm::length(normal);
+		if (!(length > 1e-12f))
+			return;
+
+		const glm::vec4 hypothesis = glm::vec4(normal / length, -glm::dot(normal / length, a));
+		hypotheses[h + 1] = hypothesis;
+		scores[h + 1] = PointcloudKernels::count_plane_inliers(xs.data(), ys.data(), zs.data(), sample_count, hypothesis, threshold);
+	});
+
+	const size_t best = std::max_element(scores.begin(), scores.end()) - scores.begin();
+	if (scores[best] < POINTCLOUD_PLANE_MIN_INLIER_FRACTION * sample_count)
+		return 0;
+
+	// least squares refit over all inliers of the best hypothesis
+	const glm::vec4 best_plane = hypotheses[best];
+	const size_t count = positions.size();
+	const size_t chunk_count = (count + POINTCLOUD_VOXEL_CHUNK_SIZE - 1) / POINTCLOUD_VOXEL_CHUNK_SIZE;
+
+	struct Moments {
+		size_t count = 0;
+		glm::dvec3 sum = glm::dvec3(0.0);
+		double xx = 0.0, xy = 0.0, xz = 0.0, yy = 0.0, yz = 0.0, zz = 0.0;
+	};
+	std::vector<Moments> chunk_moments(chunk_count);
+
+	pool.parallel_for(chunk_count, [&](size_t chunk) {
+		const size_t begin = chunk * POINTCLOUD_VOXEL_CHUNK_SIZE;
+		const size_t end = std::min(begin + POINTCLOUD_VOXEL_CHUNK_SIZE, count);
+
+		Moments m;
+		for (size_t i = begin; i < end; i++) {
+			const glm::vec3& p = positions[i];
+			if (!(std::abs(glm::dot(glm::vec3(best_plane), p) + best_plane.w) <= threshold))
+				continue;
+
+			const glm::dvec3 q = p;
+			m.count++;
+			m.sum += q;
+			m.xx += q.x * q.x;
+			m.xy += q.x * q.y;
+			m.xz += q.x * q.z;
+			m.yy += q.y * q.y;
+			m.yz += q.y * q.z;
+			m.zz += q.z * q.z;
+		}
+		chunk_moments[chunk] = m;
+	});
+
+	Moments total;
+	for (const Moments& m : chunk_moments) {
+		total.count += m.count;
+		total.sum += m.sum;
+		total.xx += m.xx;
+		total.xy += m.xy;
+		total.xz += m.xz;
+		total.yy += m.yy;
+		total.yz += m.yz;
+		total.zz += m.zz;
+	}
+
+	if (total.count < 3)
+		return 0;
+
+	// covariance around the centroid, the normal is taken along the axis with the best conditioned
+	// 2x2 system, which avoids a full eigen decomposition
+	const double n = (double)total.count;
+	const glm::dvec3 centroid = total.sum / n;
+	const double xx = total.xx / n - centroid.x * centroid.x;
+	const double xy = total.xy / n - centroid.x * centroid.y;
+	const double xz = total.xz / n - centroid.x * centroid.z;
+	const double yy = total.yy / n - centroid.y * centroid.y;
+	const double yz = total.yz / n - centroid.y * centroid.z;
+	const double zz = total.zz / n - centroid.z * centroid.z;
+
+	const double det_x = yy * zz - yz * yz;
+	const double det_y = xx * zz - xz * xz;
+	const double det_z = xx * yy - xy * xy;
+	const double det_max = std::max({ det_x, det_y, det_z });
+
+	glm::dvec3 normal;
+	if (det_max <= 0.0) {
+		normal = glm::dvec3(best_plane);
+	}
+	else if (det_max == det_x) {
+		normal = glm::dvec3(det_x, xz * yz - xy * zz, xy * yz - xz * yy);
+	}
+	else if (det_max == det_y) {
+		normal = glm::dvec3(xz * yz - xy * zz, det_y, xy * xz - yz * xx);
+	}
+	else {
+		normal = glm::dvec3(xy * yz - xz * yy, xy * xz - yz * xx, det_z);
+	}
+	normal = glm::normalize(normal);
+
+	double d = -glm::dot(normal, centroid);
+	if (d < 0.0) {
+		normal = -normal;
+		d = -d;
+	}
+
+	plane = glm::vec4(glm::vec3(normal), (float)d);
+	return total.count;
+}
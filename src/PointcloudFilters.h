@@ -0,0 +1,81 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+#include "PointBuffer.h"
+#include "KdTree.h"
+
+#pragma once
+
+namespace PointcloudFilters {
+	// Replaces all points inside the same cubic voxel of `leaf_size` by their average
+	// position, color and normal. Voxels are collected in flat open-addressing hash tables,
+	// one per key shard, so the shards run in parallel on the global thread pool. The output
+	// order only depends on the input, not on the number of threads.
+	// Non-finite points and points beyond 2^20 voxels from the origin (the 21 bit key range) are dropped
+	// with a warning, `leaf_size` <= 0 copies the input. `in` and `out` must differ.
+	size_t voxel_downsample(const PointBuffer& in, float leaf_size, PointBuffer& out);
+
+	// Statistical outlier removal: drops every point whose mean distance to its `neighbors` nearest
+	// neighbors is above mean + stddev_mul * stddev of that distance over the whole cloud. `index`
+	// must be built over `in.positions()` and is only read, the queries run in tree order on the
+	// global thread pool. Keeps the input order, non-finite points are dropped. `in` and `out` must
+	// differ. `remap` (if set, room for in.size()) receives the output index of every input point,
+	// UINT32_MAX for removed ones. Returns the number of removed points.
+	size_t remove_statistical_outliers(const PointBuffer& in, const KdTree& index, int neighbors, float stddev_mul, PointBuffer& out, uint32_t* remap = nullptr);
+
+	// Local surface of every point from the PCA of its `neighbors` nearest neighbors: the normal (axis of the
+	// smallest variance) and the plane covariance R diag(1, 1, POINTCLOUD_GICP_EPSILON) R^T used by GICP,
+	// with R the principal axes. `index` must be built over `positions`, the queries run in tree order on
+	// the global thread pool. Points without a usable neighborhood get a zero normal and an identity
+	// covariance. Either output may be nullptr.
+	void estimate_surfaces(std::span<const glm::vec3> positions, const KdTree& index, int neighbors, glm::vec3* normals, glm::mat3* covariances);
+
+	// Fits the dominant plane with RANSAC. Hypotheses from random point triples are scored on a
+	// subsample of POINTCLOUD_PLANE_SAMPLE_COUNT points picked by hashing the sample index (a fixed
+	// stride could alias with the image rows) in parallel, `prior` (if set) is
+	// scored as one more hypothesis. The winner is refit by least squares to all its inliers within
+	// `threshold`. The plane is normalized with the origin on its positive side. Returns the number
+	// of points used for the refit, 0 if no plane has enough support.
+	size_t fit_plane_ransac(std::span<const glm::vec3> positions, float threshold, const glm::vec4* prior, glm::vec4& plane);
+}
+
+// Voxel grid that clouds are added to one after another. Every cell keeps the sums of the positions and
+// colors inside it, so adding a cloud only hashes its own points and the grid never has to be rebuilt.
+// Uses the cells and the key range of voxel_downsample, the cells are kept in the order they were first
+// hit. Normals are not kept.
+class VoxelMap {
+public:
+	explicit VoxelMap(float leaf_size);
+
+	// adds `points` placed at `pose`. Non-finite points and points out of the key range are dropped
+	// with a warning, returns the number of cells
+	size_t insert(const PointBuffer& points, const glm::mat4& pose);
+
+	// the average of every cell, in cell order
+	void extract(PointBuffer& out) const;
+
+	inline size_t size() const {
+		return m_cells.size();
+	}
+
+private:
+	struct Cell {
+		glm::vec3 position = glm::vec3(0.f);
+		uint32_t r = 0, g = 0, b = 0;
+		uint32_t count = 0;
+	};
+
+	void grow();
+
+	float m_leaf_size;
+	// linear probing table from the cell key to its index in m_cells, kept at most half full
+	std::vector<uint64_t> m_table_keys;
+	std::vector<uint32_t> m_table_values;
+	std::vector<Cell> m_cells;
+	std::vector<glm::vec3> m_transformed;
+};
@@ -0,0 +1,1229 @@
+#include "PointcloudKernels.h"
+
+#include "ThreadPool.h"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__AVX2__)
+#define POINTCLOUD_KERNELS_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POINTCLOUD_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	inline void write_point(const PointStreams& out, size_t index, float x, float y, float z, const uint8_t* bgra)
+	{
+		out.positions[index] = glm::vec3(x, y, z);
+		out.colors[index] = { bgra[2], bgra[1], bgra[0], 255 };
+	}
+
+	inline glm::vec3 unproject(uint16_t depth, const k4a_float2_t& xy, float scale)
+	{
+		const float d = (float)depth;
+		return glm::vec3(-(xy.xy.x * d) * scale, (xy.xy.y * d) * scale, d * scale);
+	}
+
+	inline bool is_valid(uint16_t depth, const k4a_float2_t& xy)
+	{
+		return depth != 0 && !std::isnan(xy.xy.x) && !std::isnan(xy.xy.y);
+	}
+
+	// the full test of generate_points, pixels without color are skipped as well
+	inline bool becomes_point(uint16_t depth, const k4a_float2_t& xy, const uint8_t* bgra)
+	{
+		return is_valid(depth, xy) && (bgra[0] != 0 || bgra[1] != 0 || bgra[2] != 0);
+	}
+
+	// appends the triangle if all corners have a point and lie on the same surface
+	inline void add_grid_triangle(const uint16_t* depth_data, const uint32_t* point_indices, size_t a, size_t b, size_t c, std::vector<uint32_t>& out)
+	{
+		if (point_indices[a] == UINT32_MAX || point_indices[b] == UINT32_MAX || point_indices[c] == UINT32_MAX)
+			return;
+
+		const int min_depth = std::min({ depth_data[a], depth_data[b], depth_data[c] });
+		const int max_depth = std::max({ depth_data[a], depth_data[b], depth_data[c] });
+		const int threshold = POINTCLOUD_MESH_EDGE_BASE_MM + (int)(((uint32_t)min_depth * POINTCLOUD_MESH_EDGE_JUMP_Q16) >> 16);
+		if (max_depth - min_depth > threshold)
+			return;
+
+		out.push_back(point_indices[a]);
+		out.push_back(point_indices[b]);
+		out.push_back(point_indices[c]);
+	}
+
+	// depth with the pixel removed if it jumps away from one of its valid 4-neighbors
+	inline uint16_t reject_flying_pixel(uint16_t depth, uint16_t left, uint16_t right, uint16_t up, uint16_t down, size_t& rejected)
+	{
+		const int threshold = std::min(65535, POINTCLOUD_FLYING_PIXEL_BASE_MM + (int)(((uint32_t)depth * POINTCLOUD_FLYING_PIXEL_JUMP_Q16) >> 16));
+		auto jumps = [&](uint16_t neighbor) {
+			return neighbor != 0 && std::abs((int)neighbor - (int)depth) > threshold;
+		};
+
+		if (depth != 0 && (jumps(left) || jumps(right) || jumps(up) || jumps(down))) {
+			rejected++;
+			return 0;
+		}
+		return depth;
+	}
+
+	// vectorized part of a row, returns the first column it did not process
+	size_t reject_flying_pixels_row(const uint16_t* up, const uint16_t* center, const uint16_t* down, size_t begin, size_t end, uint16_t* out, size_t& rejected);
+
+	inline bool same_component(uint16_t a, uint16_t b)
+	{
+		if (a == 0 || b == 0)
+			return false;
+
+		const int threshold = POINTCLOUD_COMPONENT_BASE_MM + (int)(((uint32_t)std::min(a, b) * POINTCLOUD_COMPONENT_JUMP_Q16) >> 16);
+		return std::abs((int)a - (int)b) <= threshold;
+	}
+
+	// roots are always the smallest index of their set, so chains never leave the tile they were built in
+	inline uint32_t find_root(uint32_t* parents, uint32_t i)
+	{
+		while (parents[i] != i) {
+			parents[i] = parents[parents[i]];
+			i = parents[i];
+		}
+		return i;
+	}
+
+	inline void unite(uint32_t* parents, uint32_t a, uint32_t b)
+	{
+		a = find_root(parents, a);
+		b = find_root(parents, b);
+		if (a < b) {
+			parents[b] = a;
+		}
+		else if (b < a) {
+			parents[a] = b;
+		}
+	}
+
+	// vectorized part of a clip range, returns the first index it did not process
+	size_t clip_depth_range(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, size_t begin, size_t end, uint16_t* out, size_t& clipped);
+
+	// narrows the depth range [lo, hi] to the depths where `ray * depth` lies in [bound_min, bound_max]
+	inline void clip_ray(float ray, float bound_min, float bound_max, double& lo, double& hi)
+	{
+		if (std::abs(ray) < 1e-6f) {
+			if (bound_min > 0.f || bound_max < 0.f) {
+				hi = -1.0;
+			}
+			return;
+		}
+
+		const double a = bound_min / (double)ray;
+		const double b = bound_max / (double)ray;
+		lo = std::max(lo, std::min(a, b));
+		hi = std::min(hi, std::max(a, b));
+	}
+
+	// tangent along one grid axis through `center`, from the neighbors that are on the same surface.
+	// invalid grid positions have z == 0.
+	inline bool grid_tangent(const glm::vec3& center, const glm::vec3* prev, const glm::vec3* next, float max_jump, glm::vec3& tangent)
+	{
+		const bool has_prev = prev && prev->z != 0.f && std::abs(prev->z - center.z) <= max_jump;
+		const bool has_next = next && next->z != 0.f && std::abs(next->z - center.z) <= max_jump;
+
+		if (has_prev && has_next) {
+			tangent = *next - *prev;
+		}
+		else if (has_next) {
+			tangent = *next - center;
+		}
+		else if (has_prev) {
+			tangent = center - *prev;
+		}
+		else {
+			return false;
+		}
+
+		return true;
+	}
+}
+
+PointcloudKernelResult PointcloudKernels::generate_points_scalar(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, const glm::vec3* pixel_normals, size_t pixel_count, float scale, const PointStreams& out)
+{
+	PointcloudKernelResult result;
+
+	for (size_t i = 0; i < pixel_count; i++) {
+		const uint16_t depth = depth_data[i];
+		const k4a_float2_t xy = xy_table_data[i];
+		const uint8_t* bgra = color_data + i * 4;
+
+		if (depth == 0 || std::isnan(xy.xy.x) || std::isnan(xy.xy.y))
+			continue;
+
+		// skip points, we don't have a color for
+		// (fov of depth image is wider that the color image)
+		if (bgra[0] == 0 && bgra[1] == 0 && bgra[2] == 0)
+			continue;
+
+		const float d = (float)depth;
+		const float x = -(xy.xy.x * d) * scale;
+		const float y = (xy.xy.y * d) * scale;
+		const float z = d * scale;
+
+		write_point(out, result.count, x, y, z, bgra);
+		if (pixel_normals)
+			out.normals[result.count] = pixel_normals[i];
+		result.count++;
+
+		result.sum += glm::vec3(x, y, z);
+		result.max_radius_sq = std::max(result.max_radius_sq, x * x + y * y + z * z);
+		result.bounds_min = glm::min(result.bounds_min, glm::vec3(x, y, z));
+		result.bounds_max = glm::max(result.bounds_max, glm::vec3(x, y, z));
+	}
+
+	return result;
+}
+
+PointcloudKernelResult PointcloudKernels::generate_points_parallel(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, int width, int height, float scale, const PointStreams& out)
+{
+	const int tile_count = (height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<PointcloudKernelResult> tile_results(tile_count);
+
+	// each tile compacts into its own pixel range of `out`, which always has enough room
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t row_begin = tile * POINTCLOUD_TILE_ROWS;
+		const size_t row_end = std::min<size_t>(row_begin + POINTCLOUD_TILE_ROWS, height);
+		const size_t pixel_begin = row_begin * width;
+		const size_t pixel_count = (row_end - row_begin) * width;
+
+		// the per-pixel normals are estimated into the tile's normal range and compacted in place
+		const glm::vec3* pixel_normals = nullptr;
+		if (out.normals) {
+			estimate_normals(depth_data, xy_table_data, width, height, row_begin, row_end, scale, out.normals);
+			pixel_normals = out.normals + pixel_begin;
+		}
+
+		tile_results[tile] = generate_points(depth_data + pixel_begin, xy_table_data + pixel_begin, color_data + pixel_begin * 4, pixel_normals, pixel_count, scale, out.offset(pixel_begin));
+	});
+
+	// prefix sum of the tile counts gives the final offsets. tiles only move towards the front,
+	// so moving them in order never overwrites a tile that has not been moved yet.
+	PointcloudKernelResult result;
+	for (int tile = 0; tile < tile_count; tile++) {
+		const size_t pixel_begin = (size_t)tile * POINTCLOUD_TILE_ROWS * width;
+		if (result.count != pixel_begin && tile_results[tile].count > 0) {
+			std::memmove(out.positions + result.count, out.positions + pixel_begin, tile_results[tile].count * sizeof(glm::vec3));
+			std::memmove(out.colors + result.count, out.colors + pixel_begin, tile_results[tile].count * sizeof(RgbaPixel));
+			if (out.normals)
+				std::memmove(out.normals + result.count, out.normals + pixel_begin, tile_results[tile].count * sizeof(glm::vec3));
+		}
+		result.merge(tile_results[tile]);
+	}
+
+	return result;
+}
+
+void PointcloudKernels::estimate_normals(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, int width, int height, size_t row_begin, size_t row_end, float scale, glm::vec3* normals)
+{
+	// unproject every pixel once, including one halo row above and below the range
+	const size_t grid_begin = row_begin > 0 ? row_begin - 1 : 0;
+	const size_t grid_end = std::min<size_t>(row_end + 1, height);
+	thread_local std::vector<glm::vec3> grid;
+	grid.resize((grid_end - grid_begin) * width);
+
+	for (size_t i = grid_begin * width, j = 0; i < grid_end * width; i++, j++) {
+		grid[j] = is_valid(depth_data[i], xy_table_data[i]) ? unproject(depth_data[i], xy_table_data[i], scale) : glm::vec3(0.f);
+	}
+
+	for (size_t row = row_begin; row < row_end; row++) {
+		const glm::vec3* grid_row = grid.data() + (row - grid_begin) * width;
+		const bool has_up = row > 0;
+		const bool has_down = row + 1 < (size_t)height;
+
+		for (size_t col = 0; col < (size_t)width; col++) {
+			const glm::vec3& center = grid_row[col];
+			glm::vec3& normal = normals[row * width + col];
+			normal = glm::vec3(0.f);
+
+			if (center.z == 0.f)
+				continue;
+
+			const float max_jump = center.z * POINTCLOUD_NORMAL_MAX_DEPTH_JUMP;
+			glm::vec3 tangent_u, tangent_v;
+			if (!grid_tangent(center, col > 0 ? &center - 1 : nullptr, col + 1 < (size_t)width ? &center + 1 : nullptr, max_jump, tangent_u))
+				continue;
+			if (!grid_tangent(center, has_up ? &center - width : nullptr, has_down ? &center + width : nullptr, max_jump, tangent_v))
+				continue;
+
+			const glm::vec3 cross = glm::cross(tangent_u, tangent_v);
+			const float length_sq = glm::dot(cross, cross);
+			if (length_sq <= 0.f)
+				continue;
+
+			// the camera sits at the origin, normals face it
+			const float sign = glm::dot(cross, center) > 0.f ? -1.f : 1.f;
+			normal = cross * (sign / std::sqrt(length_sq));
+		}
+	}
+}
+
+void PointcloudKernels::quantize_points(const PointBuffer& points, glm::vec3 offset, glm::vec3 extent, CompactPointAttributes* out)
+{
+	// same clamp as Pointcloud::compute_quantization, 65535 / FLT_MIN would be inf and 0 * inf NaN
+	const glm::vec3 to_unorm = 65535.f / glm::max(extent, glm::vec3(POINTCLOUD_COMPACT_MIN_EXTENT));
+	const auto positions = points.positions();
+	const auto colors = points.colors();
+
+	for (size_t i = 0; i < points.size(); i++) {
+		const glm::vec3 q = glm::clamp((positions[i] - offset) * to_unorm + .5f, glm::vec3(0.f), glm::vec3(65535.f));
+		out[i].position[0] = static_cast<uint16_t>(q.x);
+		out[i].position[1] = static_cast<uint16_t>(q.y);
+		out[i].position[2] = static_cast<uint16_t>(q.z);
+		out[i].position[3] = 65535;
+
+		std::memcpy(out[i].color, &colors[i], sizeof(RgbaPixel));
+	}
+}
+
+void PointcloudKernels::dequantize_points(const CompactPointAttributes* in, size_t count, glm::vec3 offset, glm::vec3 extent, PointBuffer& out)
+{
+	const glm::vec3 from_unorm = extent / 65535.f;
+	out.resize(count);
+	const auto positions = out.positions();
+	const auto colors = out.colors();
+
+	for (size_t i = 0; i < count; i++) {
+		positions[i] = offset + glm::vec3(in[i].position[0], in[i].position[1], in[i].position[2]) * from_unorm;
+		std::memcpy(&colors[i], in[i].color, sizeof(RgbaPixel));
+	}
+}
+
+#if defined(POINTCLOUD_KERNELS_AVX2)
+
+PointcloudKernelResult PointcloudKernels::generate_points(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, const glm::vec3* pixel_normals, size_t pixel_count, float scale, const PointStreams& out)
+{
+	const __m256 scale_v = _mm256_set1_ps(scale);
+	const __m256 sign_v = _mm256_set1_ps(-0.f);
+	const __m256i rgb_mask_v = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i zero_v = _mm256_setzero_si256();
+
+	__m256 sum_x = _mm256_setzero_ps();
+	__m256 sum_y = _mm256_setzero_ps();
+	__m256 sum_z = _mm256_setzero_ps();
+	__m256 max_r2 = _mm256_setzero_ps();
+	const __m256 inf_v = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+	const __m256 neg_inf_v = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+	__m256 min_x = inf_v, min_y = inf_v, min_z = inf_v;
+	__m256 max_x = neg_inf_v, max_y = neg_inf_v, max_z = neg_inf_v;
+
+	alignas(32) float px[8], py[8], pz[8];
+
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 8 <= pixel_count; i += 8) {
+		const __m256i depth_i = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(depth_data + i)));
+		const __m256 depth_v = _mm256_cvtepi32_ps(depth_i);
+
+		// deinterleave 8 (x, y) table entries
+		const __m256 xy_lo = _mm256_loadu_ps(reinterpret_cast<const float*>(xy_table_data + i));
+		const __m256 xy_hi = _mm256_loadu_ps(reinterpret_cast<const float*>(xy_table_data + i + 4));
+		const __m256 table_x = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(xy_lo, xy_hi, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0)));
+		const __m256 table_y = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(_mm256_shuffle_ps(xy_lo, xy_hi, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0)));
+
+		const __m256i color_v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(color_data + i * 4));
+
+		// valid: depth != 0, table entry is not NaN, color is not black
+		const __m256i depth_valid = _mm256_cmpgt_epi32(depth_i, zero_v);
+		const __m256 table_valid = _mm256_cmp_ps(table_x, table_y, _CMP_ORD_Q);
+		const __m256i has_color = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(color_v, rgb_mask_v), zero_v), _mm256_set1_epi32(-1));
+		const __m256 valid = _mm256_and_ps(_mm256_and_ps(_mm256_castsi256_ps(depth_valid), table_valid), _mm256_castsi256_ps(has_color));
+
+		unsigned mask = (unsigned)_mm256_movemask_ps(valid);
+		if (mask == 0)
+			continue;
+
+		const __m256 x = _mm256_xor_ps(_mm256_mul_ps(_mm256_mul_ps(table_x, depth_v), scale_v), sign_v);
+		const __m256 y = _mm256_mul_ps(_mm256_mul_ps(table_y, depth_v), scale_v);
+		const __m256 z = _mm256_mul_ps(depth_v, scale_v);
+
+		const __m256 x_m = _mm256_and_ps(x, valid);
+		const __m256 y_m = _mm256_and_ps(y, valid);
+		const __m256 z_m = _mm256_and_ps(z, valid);
+		sum_x = _mm256_add_ps(sum_x, x_m);
+		sum_y = _mm256_add_ps(sum_y, y_m);
+		sum_z = _mm256_add_ps(sum_z, z_m);
+
+		const __m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x_m, x_m), _mm256_mul_ps(y_m, y_m)), _mm256_mul_ps(z_m, z_m));
+		max_r2 = _mm256_max_ps(max_r2, r2);
+
+		min_x = _mm256_min_ps(min_x, _mm256_blendv_ps(inf_v, x, valid));
+		min_y = _mm256_min_ps(min_y, _mm256_blendv_ps(inf_v, y, valid));
+		min_z = _mm256_min_ps(min_z, _mm256_blendv_ps(inf_v, z, valid));
+		max_x = _mm256_max_ps(max_x, _mm256_blendv_ps(neg_inf_v, x, valid));
+		max_y = _mm256_max_ps(max_y, _mm256_blendv_ps(neg_inf_v, y, valid));
+		max_z = _mm256_max_ps(max_z, _mm256_blendv_ps(neg_inf_v, z, valid));
+
+		_mm256_store_ps(px, x);
+		_mm256_store_ps(py, y);
+		_mm256_store_ps(pz, z);
+
+		while (mask) {
+			const int lane = std::countr_zero(mask);
+			write_point(out, count, px[lane], py[lane], pz[lane], color_data + (i + lane) * 4);
+			if (pixel_normals)
+				out.normals[count] = pixel_normals[i + lane];
+			count++;
+			mask &= mask - 1;
+		}
+	}
+
+	alignas(32) float sx[8], sy[8], sz[8], r2[8], lx[8], ly[8], lz[8], ux[8], uy[8], uz[8];
+	_mm256_store_ps(sx, sum_x);
+	_mm256_store_ps(sy, sum_y);
+	_mm256_store_ps(sz, sum_z);
+	_mm256_store_ps(r2, max_r2);
+	_mm256_store_ps(lx, min_x);
+	_mm256_store_ps(ly, min_y);
+	_mm256_store_ps(lz, min_z);
+	_mm256_store_ps(ux, max_x);
+	_mm256_store_ps(uy, max_y);
+	_mm256_store_ps(uz, max_z);
+
+	PointcloudKernelResult result = generate_points_scalar(depth_data + i, xy_table_data + i, color_data + i * 4, pixel_normals ? pixel_normals + i : nullptr, pixel_count - i, scale, out.offset(count));
+	result.count += count;
+	for (int lane = 0; lane < 8; lane++) {
+		result.sum += glm::vec3(sx[lane], sy[lane], sz[lane]);
+		result.max_radius_sq = std::max(result.max_radius_sq, r2[lane]);
+		result.bounds_min = glm::min(result.bounds_min, glm::vec3(lx[lane], ly[lane], lz[lane]));
+		result.bounds_max = glm::max(result.bounds_max, glm::vec3(ux[lane], uy[lane], uz[lane]));
+	}
+
+	return result;
+}
+
+const char* PointcloudKernels::instruction_set()
+{
+	return "AVX2";
+}
+
+size_t PointcloudKernels::count_plane_inliers(const float* x, const float* y, const float* z, size_t count, const glm::vec4& plane, float threshold)
+{
+	const __m256 a = _mm256_set1_ps(plane.x);
+	const __m256 b = _mm256_set1_ps(plane.y);
+	const __m256 c = _mm256_set1_ps(plane.z);
+	const __m256 d = _mm256_set1_ps(plane.w);
+	const __m256 t = _mm256_set1_ps(threshold);
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	size_t inliers = 0;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 distance = _mm256_add_ps(_mm256_mul_ps(a, _mm256_loadu_ps(x + i)), d);
+		distance = _mm256_add_ps(_mm256_mul_ps(b, _mm256_loadu_ps(y + i)), distance);
+		distance = _mm256_add_ps(_mm256_mul_ps(c, _mm256_loadu_ps(z + i)), distance);
+		const __m256 inside = _mm256_cmp_ps(_mm256_and_ps(distance, abs_mask), t, _CMP_LE_OQ);
+		inliers += std::popcount((unsigned)_mm256_movemask_ps(inside));
+	}
+
+	for (; i < count; i++) {
+		inliers += std::abs(plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w) <= threshold;
+	}
+
+	return inliers;
+}
+
+namespace {
+	size_t reject_flying_pixels_row(const uint16_t* up, const uint16_t* center, const uint16_t* down, size_t begin, size_t end, uint16_t* out, size_t& rejected)
+	{
+		const __m256i jump_v = _mm256_set1_epi16((short)POINTCLOUD_FLYING_PIXEL_JUMP_Q16);
+		const __m256i base_v = _mm256_set1_epi16((short)POINTCLOUD_FLYING_PIXEL_BASE_MM);
+		const __m256i zero_v = _mm256_setzero_si256();
+
+		// unsigned |a - b| > t  <=>  saturate(|a - b| - t) != 0, zero neighbors never jump
+		auto jumps = [&](__m256i depth, __m256i neighbor, __m256i threshold) {
+			const __m256i diff = _mm256_or_si256(_mm256_subs_epu16(depth, neighbor), _mm256_subs_epu16(neighbor, depth));
+			const __m256i exceeds = _mm256_xor_si256(_mm256_cmpeq_epi16(_mm256_subs_epu16(diff, threshold), zero_v), _mm256_set1_epi16(-1));
+			return _mm256_andnot_si256(_mm256_cmpeq_epi16(neighbor, zero_v), exceeds);
+		};
+
+		size_t x = begin;
+		for (; x + 16 <= end; x += 16) {
+			const __m256i depth = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center + x));
+			const __m256i threshold = _mm256_adds_epu16(_mm256_mulhi_epu16(depth, jump_v), base_v);
+
+			__m256i reject = jumps(depth, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center + x - 1)), threshold);
+			reject = _mm256_or_si256(reject, jumps(depth, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center + x + 1)), threshold));
+			reject = _mm256_or_si256(reject, jumps(depth, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(up + x)), threshold));
+			reject = _mm256_or_si256(reject, jumps(depth, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(down + x)), threshold));
+			reject = _mm256_andnot_si256(_mm256_cmpeq_epi16(depth, zero_v), reject);
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_andnot_si256(reject, depth));
+			rejected += std::popcount((unsigned)_mm256_movemask_epi8(reject)) / 2;
+		}
+
+		return x;
+	}
+
+	size_t clip_depth_range(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, size_t begin, size_t end, uint16_t* out, size_t& clipped)
+	{
+		const __m256i zero_v = _mm256_setzero_si256();
+
+		size_t i = begin;
+		for (; i + 16 <= end; i += 16) {
+			const __m256i depth = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(depth_data + i));
+			const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(min_depth + i));
+			const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(max_depth + i));
+
+			// unsigned lo <= d <= hi  <=>  saturate(lo - d) == 0 and saturate(d - hi) == 0
+			const __m256i outside = _mm256_or_si256(_mm256_subs_epu16(lo, depth), _mm256_subs_epu16(depth, hi));
+			const __m256i keep = _mm256_cmpeq_epi16(outside, zero_v);
+			const __m256i clip = _mm256_andnot_si256(_mm256_or_si256(keep, _mm256_cmpeq_epi16(depth, zero_v)), _mm256_set1_epi16(-1));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_and_si256(keep, depth));
+			clipped += std::popcount((unsigned)_mm256_movemask_epi8(clip)) / 2;
+		}
+
+		return i;
+	}
+
+	// 8 points in two 128 bit lanes, every lane is shuffled like the SSE2 path
+	inline __m256 load_lanes(const float* lo, const float* hi)
+	{
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1);
+	}
+
+	inline void store_lanes(float* lo, float* hi, __m256 v)
+	{
+		_mm_storeu_ps(lo, _mm256_castps256_ps128(v));
+		_mm_storeu_ps(hi, _mm256_extractf128_ps(v, 1));
+	}
+
+	// 3x4 affine, row major
+	inline void load_affine(const glm::mat4& transform, __m256* m)
+	{
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 4; col++) {
+				m[row * 4 + col] = _mm256_set1_ps(transform[col][row]);
+			}
+		}
+	}
+
+	inline void apply_affine(const __m256* m, __m256 x, __m256 y, __m256 z, __m256& out_x, __m256& out_y, __m256& out_z)
+	{
+		out_x = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x), m[3]), _mm256_mul_ps(m[1], y)), _mm256_mul_ps(m[2], z));
+		out_y = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], x), m[7]), _mm256_mul_ps(m[5], y)), _mm256_mul_ps(m[6], z));
+		out_z = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], x), m[11]), _mm256_mul_ps(m[9], y)), _mm256_mul_ps(m[10], z));
+	}
+
+	// [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] -> [x0 x1 x2 x3] [y0 ..] [z0 ..] per lane
+	inline void deinterleave(__m256 a, __m256 b, __m256 c, __m256& x, __m256& y, __m256& z)
+	{
+		x = _mm256_shuffle_ps(a, _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+	}
+
+	inline void interleave(__m256 x, __m256 y, __m256 z, __m256& a, __m256& b, __m256& c)
+	{
+		a = _mm256_shuffle_ps(_mm256_unpacklo_ps(x, y), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+		b = _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 2, 0));
+		c = _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	size_t transform_packed_range(const glm::vec3* in, size_t begin, size_t end, const glm::mat4& transform, glm::vec3* out)
+	{
+		__m256 m[12];
+		load_affine(transform, m);
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			const float* src = reinterpret_cast<const float*>(in + i);
+			float* dst = reinterpret_cast<float*>(out + i);
+
+			__m256 x, y, z, a, b, c;
+			deinterleave(load_lanes(src, src + 12), load_lanes(src + 4, src + 16), load_lanes(src + 8, src + 20), x, y, z);
+			apply_affine(m, x, y, z, x, y, z);
+			interleave(x, y, z, a, b, c);
+
+			store_lanes(dst, dst + 12, a);
+			store_lanes(dst + 4, dst + 16, b);
+			store_lanes(dst + 8, dst + 20, c);
+		}
+
+		return i;
+	}
+}
+
+#elif defined(POINTCLOUD_KERNELS_SSE2)
+
+PointcloudKernelResult PointcloudKernels::generate_points(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, const glm::vec3* pixel_normals, size_t pixel_count, float scale, const PointStreams& out)
+{
+	const __m128 scale_v = _mm_set1_ps(scale);
+	const __m128 sign_v = _mm_set1_ps(-0.f);
+	const __m128i rgb_mask_v = _mm_set1_epi32(0x00FFFFFF);
+	const __m128i zero_v = _mm_setzero_si128();
+
+	__m128 sum_x = _mm_setzero_ps();
+	__m128 sum_y = _mm_setzero_ps();
+	__m128 sum_z = _mm_setzero_ps();
+	__m128 max_r2 = _mm_setzero_ps();
+	const __m128 inf_v = _mm_set1_ps(std::numeric_limits<float>::infinity());
+	const __m128 neg_inf_v = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+	__m128 min_x = inf_v, min_y = inf_v, min_z = inf_v;
+	__m128 max_x = neg_inf_v, max_y = neg_inf_v, max_z = neg_inf_v;
+
+	// SSE2 has no blendv, select with and/andnot
+	auto select = [](__m128 mask, __m128 a, __m128 b) {
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	};
+
+	alignas(16) float px[4], py[4], pz[4];
+
+	size_t count = 0;
+	size_t i = 0;
+	for (; i + 4 <= pixel_count; i += 4) {
+		const __m128i depth_i = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(depth_data + i)), zero_v);
+		const __m128 depth_v = _mm_cvtepi32_ps(depth_i);
+
+		// deinterleave 4 (x, y) table entries
+		const __m128 xy_lo = _mm_loadu_ps(reinterpret_cast<const float*>(xy_table_data + i));
+		const __m128 xy_hi = _mm_loadu_ps(reinterpret_cast<const float*>(xy_table_data + i + 2));
+		const __m128 table_x = _mm_shuffle_ps(xy_lo, xy_hi, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 table_y = _mm_shuffle_ps(xy_lo, xy_hi, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m128i color_v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(color_data + i * 4));
+
+		// valid: depth != 0, table entry is not NaN, color is not black
+		const __m128i depth_valid = _mm_cmpgt_epi32(depth_i, zero_v);
+		const __m128 table_valid = _mm_cmpord_ps(table_x, table_y);
+		const __m128i has_color = _mm_xor_si128(_mm_cmpeq_epi32(_mm_and_si128(color_v, rgb_mask_v), zero_v), _mm_set1_epi32(-1));
+		const __m128 valid = _mm_and_ps(_mm_and_ps(_mm_castsi128_ps(depth_valid), table_valid), _mm_castsi128_ps(has_color));
+
+		unsigned mask = (unsigned)_mm_movemask_ps(valid);
+		if (mask == 0)
+			continue;
+
+		const __m128 x = _mm_xor_ps(_mm_mul_ps(_mm_mul_ps(table_x, depth_v), scale_v), sign_v);
+		const __m128 y = _mm_mul_ps(_mm_mul_ps(table_y, depth_v), scale_v);
+		const __m128 z = _mm_mul_ps(depth_v, scale_v);
+
+		const __m128 x_m = _mm_and_ps(x, valid);
+		const __m128 y_m = _mm_and_ps(y, valid);
+		const __m128 z_m = _mm_and_ps(z, valid);
+		sum_x = _mm_add_ps(sum_x, x_m);
+		sum_y = _mm_add_ps(sum_y, y_m);
+		sum_z = _mm_add_ps(sum_z, z_m);
+
+		const __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x_m, x_m), _mm_mul_ps(y_m, y_m)), _mm_mul_ps(z_m, z_m));
+		max_r2 = _mm_max_ps(max_r2, r2);
+
+		min_x = _mm_min_ps(min_x, select(valid, x, inf_v));
+		min_y = _mm_min_ps(min_y, select(valid, y, inf_v));
+		min_z = _mm_min_ps(min_z, select(valid, z, inf_v));
+		max_x = _mm_max_ps(max_x, select(valid, x, neg_inf_v));
+		max_y = _mm_max_ps(max_y, select(valid, y, neg_inf_v));
+		max_z = _mm_max_ps(max_z, select(valid, z, neg_inf_v));
+
+		_mm_store_ps(px, x);
+		_mm_store_ps(py, y);
+		_mm_store_ps(pz, z);
+
+		while (mask) {
+			const int lane = std::countr_zero(mask);
+			write_point(out, count, px[lane], py[lane], pz[lane], color_data + (i + lane) * 4);
+			if (pixel_normals)
+				out.normals[count] = pixel_normals[i + lane];
+			count++;
+			mask &= mask - 1;
+		}
+	}
+
+	alignas(16) float sx[4], sy[4], sz[4], r2[4], lx[4], ly[4], lz[4], ux[4], uy[4], uz[4];
+	_mm_store_ps(sx, sum_x);
+	_mm_store_ps(sy, sum_y);
+	_mm_store_ps(sz, sum_z);
+	_mm_store_ps(r2, max_r2);
+	_mm_store_ps(lx, min_x);
+	_mm_store_ps(ly, min_y);
+	_mm_store_ps(lz, min_z);
+	_mm_store_ps(ux, max_x);
+	_mm_store_ps(uy, max_y);
+	_mm_store_ps(uz, max_z);
+
+	PointcloudKernelResult result = generate_points_scalar(depth_data + i, xy_table_data + i, color_data + i * 4, pixel_normals ? pixel_normals + i : nullptr, pixel_count - i, scale, out.offset(count));
+	result.count += count;
+	for (int lane = 0; lane < 4; lane++) {
+		result.sum += glm::vec3(sx[lane], sy[lane], sz[lane]);
+		result.max_radius_sq = std::max(result.max_radius_sq, r2[lane]);
+		result.bounds_min = glm::min(result.bounds_min, glm::vec3(lx[lane], ly[lane], lz[lane]));
+		result.bounds_max = glm::max(result.bounds_max, glm::vec3(ux[lane], uy[lane], uz[lane]));
+	}
+
+	return result;
+}
+
+const char* PointcloudKernels::instruction_set()
+{
+	return "SSE2";
+}
+
+size_t PointcloudKernels::count_plane_inliers(const float* x, const float* y, const float* z, size_t count, const glm::vec4& plane, float threshold)
+{
+	const __m128 a = _mm_set1_ps(plane.x);
+	const __m128 b = _mm_set1_ps(plane.y);
+	const __m128 c = _mm_set1_ps(plane.z);
+	const __m128 d = _mm_set1_ps(plane.w);
+	const __m128 t = _mm_set1_ps(threshold);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	size_t inliers = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 distance = _mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + i)), d);
+		distance = _mm_add_ps(_mm_mul_ps(b, _mm_loadu_ps(y + i)), distance);
+		distance = _mm_add_ps(_mm_mul_ps(c, _mm_loadu_ps(z + i)), distance);
+		const __m128 inside = _mm_cmple_ps(_mm_and_ps(distance, abs_mask), t);
+		inliers += std::popcount((unsigned)_mm_movemask_ps(inside));
+	}
+
+	for (; i < count; i++) {
+		inliers += std::abs(plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w) <= threshold;
+	}
+
+	return inliers;
+}
+
+namespace {
+	size_t reject_flying_pixels_row(const uint16_t* up, const uint16_t* center, const uint16_t* down, size_t begin, size_t end, uint16_t* out, size_t& rejected)
+	{
+		const __m128i jump_v = _mm_set1_epi16((short)POINTCLOUD_FLYING_PIXEL_JUMP_Q16);
+		const __m128i base_v = _mm_set1_epi16((short)POINTCLOUD_FLYING_PIXEL_BASE_MM);
+		const __m128i zero_v = _mm_setzero_si128();
+
+		// unsigned |a - b| > t  <=>  saturate(|a - b| - t) != 0, zero neighbors never jump
+		auto jumps = [&](__m128i depth, __m128i neighbor, __m128i threshold) {
+			const __m128i diff = _mm_or_si128(_mm_subs_epu16(depth, neighbor), _mm_subs_epu16(neighbor, depth));
+			const __m128i exceeds = _mm_xor_si128(_mm_cmpeq_epi16(_mm_subs_epu16(diff, threshold), zero_v), _mm_set1_epi16(-1));
+			return _mm_andnot_si128(_mm_cmpeq_epi16(neighbor, zero_v), exceeds);
+		};
+
+		size_t x = begin;
+		for (; x + 8 <= end; x += 8) {
+			const __m128i depth = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x));
+			const __m128i threshold = _mm_adds_epu16(_mm_mulhi_epu16(depth, jump_v), base_v);
+
+			__m128i reject = jumps(depth, _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x - 1)), threshold);
+			reject = _mm_or_si128(reject, jumps(depth, _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + x + 1)), threshold));
+			reject = _mm_or_si128(reject, jumps(depth, _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + x)), threshold));
+			reject = _mm_or_si128(reject, jumps(depth, _mm_loadu_si128(reinterpret_cast<const __m128i*>(down + x)), threshold));
+			reject = _mm_andnot_si128(_mm_cmpeq_epi16(depth, zero_v), reject);
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), _mm_andnot_si128(reject, depth));
+			rejected += std::popcount((unsigned)_mm_movemask_epi8(reject)) / 2;
+		}
+
+		return x;
+	}
+
+	size_t clip_depth_range(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, size_t begin, size_t end, uint16_t* out, size_t& clipped)
+	{
+		const __m128i zero_v = _mm_setzero_si128();
+
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			const __m128i depth = _mm_loadu_si128(reinterpret_cast<const __m128i*>(depth_data + i));
+			const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(min_depth + i));
+			const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(max_depth + i));
+
+			// unsigned lo <= d <= hi  <=>  saturate(lo - d) == 0 and saturate(d - hi) == 0
+			const __m128i outside = _mm_or_si128(_mm_subs_epu16(lo, depth), _mm_subs_epu16(depth, hi));
+			const __m128i keep = _mm_cmpeq_epi16(outside, zero_v);
+			const __m128i clip = _mm_andnot_si128(_mm_or_si128(keep, _mm_cmpeq_epi16(depth, zero_v)), _mm_set1_epi16(-1));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_and_si128(keep, depth));
+			clipped += std::popcount((unsigned)_mm_movemask_epi8(clip)) / 2;
+		}
+
+		return i;
+	}
+
+	// 3x4 affine, row major
+	inline void load_affine(const glm::mat4& transform, __m128* m)
+	{
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 4; col++) {
+				m[row * 4 + col] = _mm_set1_ps(transform[col][row]);
+			}
+		}
+	}
+
+	inline void apply_affine(const __m128* m, __m128 x, __m128 y, __m128 z, __m128& out_x, __m128& out_y, __m128& out_z)
+	{
+		out_x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x), m[3]), _mm_mul_ps(m[1], y)), _mm_mul_ps(m[2], z));
+		out_y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], x), m[7]), _mm_mul_ps(m[5], y)), _mm_mul_ps(m[6], z));
+		out_z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], x), m[11]), _mm_mul_ps(m[9], y)), _mm_mul_ps(m[10], z));
+	}
+
+	// [x0 y0 z0 x1] [y1 z1 x2 y2] [z2 x3 y3 z3] -> [x0 x1 x2 x3] [y0 ..] [z0 ..]
+	inline void deinterleave(__m128 a, __m128 b, __m128 c, __m128& x, __m128& y, __m128& z)
+	{
+		x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+		y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+		z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+	}
+
+	inline void interleave(__m128 x, __m128 y, __m128 z, __m128& a, __m128& b, __m128& c)
+	{
+		a = _mm_shuffle_ps(_mm_unpacklo_ps(x, y), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 1, 0));
+		b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_unpackhi_ps(x, y), _MM_SHUFFLE(1, 0, 2, 0));
+		c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	size_t transform_packed_range(const glm::vec3* in, size_t begin, size_t end, const glm::mat4& transform, glm::vec3* out)
+	{
+		__m128 m[12];
+		load_affine(transform, m);
+
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4) {
+			const float* src = reinterpret_cast<const float*>(in + i);
+			float* dst = reinterpret_cast<float*>(out + i);
+
+			__m128 x, y, z, a, b, c;
+			deinterleave(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), x, y, z);
+			apply_affine(m, x, y, z, x, y, z);
+			interleave(x, y, z, a, b, c);
+
+			_mm_storeu_ps(dst, a);
+			_mm_storeu_ps(dst + 4, b);
+			_mm_storeu_ps(dst + 8, c);
+		}
+
+		return i;
+	}
+}
+
+#else
+
+PointcloudKernelResult PointcloudKernels::generate_points(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, const glm::vec3* pixel_normals, size_t pixel_count, float scale, const PointStreams& out)
+{
+	return generate_points_scalar(depth_data, xy_table_data, color_data, pixel_normals, pixel_count, scale, out);
+}
+
+const char* PointcloudKernels::instruction_set()
+{
+	return "scalar";
+}
+
+size_t PointcloudKernels::count_plane_inliers(const float* x, const float* y, const float* z, size_t count, const glm::vec4& plane, float threshold)
+{
+	size_t inliers = 0;
+	for (size_t i = 0; i < count; i++) {
+		inliers += std::abs(plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w) <= threshold;
+	}
+	return inliers;
+}
+
+namespace {
+	// no vector path, the caller does the whole row
+	size_t reject_flying_pixels_row(const uint16_t*, const uint16_t*, const uint16_t*, size_t begin, size_t, uint16_t*, size_t&)
+	{
+		return begin;
+	}
+
+	size_t clip_depth_range(const uint16_t*, const uint16_t*, const uint16_t*, size_t begin, size_t, uint16_t*, size_t&)
+	{
+		return begin;
+	}
+
+	size_t transform_packed_range(const glm::vec3*, size_t begin, size_t, const glm::mat4&, glm::vec3*)
+	{
+		return begin;
+	}
+}
+
+#endif
+
+size_t PointcloudKernels::reject_flying_pixels(const uint16_t* depth_data, int width, int height, size_t row_begin, size_t row_end, uint16_t* out)
+{
+	size_t rejected = 0;
+
+	for (size_t row = row_begin; row < row_end; row++) {
+		const uint16_t* center = depth_data + row * width;
+		// missing rows compare against the row itself, which never jumps
+		const uint16_t* up = row > 0 ? center - width : center;
+		const uint16_t* down = row + 1 < (size_t)height ? center + width : center;
+		uint16_t* out_row = out + row * width;
+
+		if (width < 3) {
+			for (size_t x = 0; x < (size_t)width; x++) {
+				out_row[x] = reject_flying_pixel(center[x], center[x > 0 ? x - 1 : x], center[x + 1 < (size_t)width ? x + 1 : x], up[x], down[x], rejected);
+			}
+			continue;
+		}
+
+		out_row[0] = reject_flying_pixel(center[0], center[0], center[1], up[0], down[0], rejected);
+
+		size_t x = reject_flying_pixels_row(up, center, down, 1, width - 1, out_row, rejected);
+		for (; x < (size_t)width - 1; x++) {
+			out_row[x] = reject_flying_pixel(center[x], center[x - 1], center[x + 1], up[x], down[x], rejected);
+		}
+
+		out_row[width - 1] = reject_flying_pixel(center[width - 1], center[width - 2], center[width - 1], up[width - 1], down[width - 1], rejected);
+	}
+
+	return rejected;
+}
+
+size_t PointcloudKernels::reject_flying_pixels_parallel(const uint16_t* depth_data, int width, int height, uint16_t* out)
+{
+	const int tile_count = (height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<size_t> tile_rejected(tile_count);
+
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t row_begin = tile * POINTCLOUD_TILE_ROWS;
+		const size_t row_end = std::min<size_t>(row_begin + POINTCLOUD_TILE_ROWS, height);
+		tile_rejected[tile] = reject_flying_pixels(depth_data, width, height, row_begin, row_end, out);
+	});
+
+	size_t rejected = 0;
+	for (size_t count : tile_rejected) {
+		rejected += count;
+	}
+	return rejected;
+}
+
+void PointcloudKernels::build_clip_ranges(const DepthClipSettings& settings, const k4a_float2_t* xy_table_data, int width, int height, uint16_t* min_depth, uint16_t* max_depth)
+{
+	const glm::ivec2 roi_min = settings.use_roi ? glm::max(settings.roi_min, glm::ivec2(0)) : glm::ivec2(0);
+	const glm::ivec2 roi_max = settings.use_roi ? glm::min(settings.roi_max, glm::ivec2(width, height)) : glm::ivec2(width, height);
+	const glm::vec3 crop_min = settings.crop_min * 1000.f;
+	const glm::vec3 crop_max = settings.crop_max * 1000.f;
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			const size_t i = (size_t)y * width + x;
+			const k4a_float2_t& xy = xy_table_data[i];
+
+			double lo = std::max(1.0, settings.min_distance * 1000.0);
+			double hi = std::min(65535.0, settings.max_distance * 1000.0);
+
+			if (x < roi_min.x || y < roi_min.y || x >= roi_max.x || y >= roi_max.y || std::isnan(xy.xy.x) || std::isnan(xy.xy.y)) {
+				hi = -1.0;
+			}
+			else if (settings.use_crop_box) {
+				clip_ray(xy.xy.x, crop_min.x, crop_max.x, lo, hi);
+				clip_ray(xy.xy.y, crop_min.y, crop_max.y, lo, hi);
+				clip_ray(1.f, crop_min.z, crop_max.z, lo, hi);
+			}
+
+			// the tolerance keeps float noise in the settings (.3f * 1000) from moving a bound by 1 mm
+			lo = std::ceil(lo - 1e-3);
+			hi = std::floor(hi + 1e-3);
+			if (lo > hi) {
+				min_depth[i] = 65535;
+				max_depth[i] = 0;
+			}
+			else {
+				min_depth[i] = (uint16_t)lo;
+				max_depth[i] = (uint16_t)hi;
+			}
+		}
+	}
+}
+
+size_t PointcloudKernels::clip_depth(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, size_t pixel_count, uint16_t* out)
+{
+	size_t clipped = 0;
+
+	size_t i = clip_depth_range(depth_data, min_depth, max_depth, 0, pixel_count, out, clipped);
+	for (; i < pixel_count; i++) {
+		const uint16_t depth = depth_data[i];
+		const bool keep = depth >= min_depth[i] && depth <= max_depth[i];
+		clipped += !keep && depth != 0;
+		out[i] = keep ? depth : 0;
+	}
+
+	return clipped;
+}
+
+size_t PointcloudKernels::clip_depth_parallel(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, int width, int height, uint16_t* out)
+{
+	const int tile_count = (height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<size_t> tile_clipped(tile_count);
+
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t begin = tile * POINTCLOUD_TILE_ROWS * width;
+		const size_t end = std::min<size_t>((tile + 1) * POINTCLOUD_TILE_ROWS, height) * width;
+		tile_clipped[tile] = clip_depth(depth_data + begin, min_depth + begin, max_depth + begin, end - begin, out + begin);
+	});
+
+	size_t clipped = 0;
+	for (size_t count : tile_clipped) {
+		clipped += count;
+	}
+	return clipped;
+}
+
+void PointcloudKernels::label_components(const uint16_t* depth_data, int width, int height, uint32_t* parents, uint32_t* labels)
+{
+	const size_t tile_count = (height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	ThreadPool& pool = ThreadPool::global();
+
+	// first pass, union-find inside each row tile
+	pool.parallel_for(tile_count, [&](size_t tile) {
+		const size_t row_begin = tile * POINTCLOUD_TILE_ROWS;
+		const size_t row_end = std::min<size_t>(row_begin + POINTCLOUD_TILE_ROWS, height);
+
+		for (size_t row = row_begin; row < row_end; row++) {
+			for (size_t x = 0; x < (size_t)width; x++) {
+				const uint32_t i = (uint32_t)(row * width + x);
+				const uint16_t depth = depth_data[i];
+				if (depth == 0) {
+					parents[i] = UINT32_MAX;
+					continue;
+				}
+
+				parents[i] = i;
+				if (x > 0 && same_component(depth, depth_data[i - 1])) {
+					unite(parents, i - 1, i);
+				}
+				if (row > row_begin && same_component(depth, depth_data[i - width])) {
+					unite(parents, i - width, i);
+				}
+			}
+		}
+	});
+
+	// join the tiles along their borders
+	for (size_t tile = 1; tile < tile_count; tile++) {
+		const size_t row = tile * POINTCLOUD_TILE_ROWS;
+		for (size_t x = 0; x < (size_t)width; x++) {
+			const uint32_t i = (uint32_t)(row * width + x);
+			if (same_component(depth_data[i], depth_data[i - width])) {
+				unite(parents, i - width, i);
+			}
+		}
+	}
+
+	// second pass, resolve the roots without writing to the shared parents
+	pool.parallel_for(tile_count, [&](size_t tile) {
+		const size_t begin = tile * POINTCLOUD_TILE_ROWS * width;
+		const size_t end = std::min<size_t>((tile + 1) * POINTCLOUD_TILE_ROWS, height) * width;
+
+		for (size_t i = begin; i < end; i++) {
+			uint32_t root = parents[i];
+			if (root != UINT32_MAX) {
+				while (parents[root] != root) {
+					root = parents[root];
+				}
+			}
+			labels[i] = root;
+		}
+	});
+}
+
+size_t PointcloudKernels::select_component(const uint16_t* depth_data, const uint32_t* labels, int width, int height, glm::ivec2 seed, uint16_t* out)
+{
+	const size_t pixel_count = (size_t)width * height;
+	uint32_t selected = UINT32_MAX;
+
+	// nearest labeled pixel around the seed, ring by ring
+	if (seed.x >= 0 && seed.y >= 0 && seed.x < width && seed.y < height) {
+		for (int radius = 0; radius <= POINTCLOUD_COMPONENT_SEED_RADIUS && selected == UINT32_MAX; radius++) {
+			for (int y = std::max(seed.y - radius, 0); y <= std::min(seed.y + radius, height - 1); y++) {
+				for (int x = std::max(seed.x - radius, 0); x <= std::min(seed.x + radius, width - 1); x++) {
+					const bool on_ring = std::abs(x - seed.x) == radius || std::abs(y - seed.y) == radius;
+					const uint32_t label = labels[(size_t)y * width + x];
+					if (on_ring && label != UINT32_MAX) {
+						selected = label;
+						break;
+					}
+				}
+				if (selected != UINT32_MAX)
+					break;
+			}
+		}
+	}
+
+	// otherwise the largest component, sizes are counted at the root pixel
+	if (selected == UINT32_MAX) {
+		thread_local std::vector<uint32_t> sizes;
+		sizes.assign(pixel_count, 0);
+
+		uint32_t largest = 0;
+		for (size_t i = 0; i < pixel_count; i++) {
+			const uint32_t label = labels[i];
+			if (label != UINT32_MAX && ++sizes[label] > largest) {
+				largest = sizes[label];
+				selected = label;
+			}
+		}
+	}
+
+	const size_t tile_count = (height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<size_t> tile_removed(tile_count, 0);
+
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t begin = tile * POINTCLOUD_TILE_ROWS * width;
+		const size_t end = std::min<size_t>((tile + 1) * POINTCLOUD_TILE_ROWS, height) * width;
+
+		size_t removed = 0;
+		for (size_t i = begin; i < end; i++) {
+			const uint16_t depth = depth_data[i];
+			const bool keep = labels[i] == selected;
+			removed += !keep && depth != 0;
+			out[i] = keep ? depth : 0;
+		}
+		tile_removed[tile] = removed;
+	});
+
+	size_t removed = 0;
+	for (size_t count : tile_removed) {
+		removed += count;
+	}
+	return removed;
+}
+
+size_t PointcloudKernels::index_grid_points(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, int width, int height, uint32_t* point_indices)
+{
+	const size_t tile_count = (height + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<size_t> tile_offsets(tile_count + 1, 0);
+
+	// indices relative to the tile first, then shifted by the points of the tiles before
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t begin = tile * POINTCLOUD_TILE_ROWS * width;
+		const size_t end = std::min<size_t>((tile + 1) * POINTCLOUD_TILE_ROWS, height) * width;
+
+		uint32_t count = 0;
+		for (size_t i = begin; i < end; i++) {
+			point_indices[i] = becomes_point(depth_data[i], xy_table_data[i], color_data + i * 4) ? count++ : UINT32_MAX;
+		}
+		tile_offsets[tile + 1] = count;
+	});
+
+	for (size_t tile = 0; tile < tile_count; tile++) {
+		tile_offsets[tile + 1] += tile_offsets[tile];
+	}
+
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const uint32_t offset = (uint32_t)tile_offsets[tile];
+		if (offset == 0)
+			return;
+
+		const size_t begin = tile * POINTCLOUD_TILE_ROWS * width;
+		const size_t end = std::min<size_t>((tile + 1) * POINTCLOUD_TILE_ROWS, height) * width;
+		for (size_t i = begin; i < end; i++) {
+			if (point_indices[i] != UINT32_MAX)
+				point_indices[i] += offset;
+		}
+	});
+
+	return tile_offsets[tile_count];
+}
+
+void PointcloudKernels::triangulate_grid(const uint16_t* depth_data, const uint32_t* point_indices, int width, int height, std::vector<uint32_t>& triangles)
+{
+	triangles.clear();
+	if (width < 2 || height < 2)
+		return;
+
+	// one quad row per pixel row except the last one
+	const size_t quad_rows = height - 1;
+	const size_t tile_count = (quad_rows + POINTCLOUD_TILE_ROWS - 1) / POINTCLOUD_TILE_ROWS;
+	std::vector<std::vector<uint32_t>> tile_triangles(tile_count);
+
+	ThreadPool::global().parallel_for(tile_count, [&](size_t tile) {
+		const size_t row_begin = tile * POINTCLOUD_TILE_ROWS;
+		const size_t row_end = std::min(row_begin + POINTCLOUD_TILE_ROWS, quad_rows);
+		std::vector<uint32_t>& out = tile_triangles[tile];
+
+		for (size_t row = row_begin; row < row_end; row++) {
+			for (size_t col = 0; col + 1 < (size_t)width; col++) {
+				// x is mirrored, so (top left, top right, bottom left) faces the camera
+				const size_t top_left = row * width + col;
+				const size_t bottom_left = top_left + width;
+				add_grid_triangle(depth_data, point_indices, top_left, top_left + 1, bottom_left, out);
+				add_grid_triangle(depth_data, point_indices, top_left + 1, bottom_left + 1, bottom_left, out);
+			}
+		}
+	});
+
+	size_t total = 0;
+	for (const auto& out : tile_triangles) {
+		total += out.size();
+	}
+
+	triangles.resize(total);
+	size_t offset = 0;
+	for (const auto& out : tile_triangles) {
+		std::memcpy(triangles.data() + offset, out.data(), out.size() * sizeof(uint32_t));
+		offset += out.size();
+	}
+}
+
+size_t PointcloudKernels::remap_triangles(std::vector<uint32_t>& triangles, const uint32_t* remap)
+{
+	size_t o = 0;
+	for (size_t t = 0; t + 3 <= triangles.size(); t += 3) {
+		const uint32_t a = remap[triangles[t]];
+		const uint32_t b = remap[triangles[t + 1]];
+		const uint32_t c = remap[triangles[t + 2]];
+		if (a == UINT32_MAX || b == UINT32_MAX || c == UINT32_MAX)
+			continue;
+
+		triangles[o++] = a;
+		triangles[o++] = b;
+		triangles[o++] = c;
+	}
+
+	const size_t dropped = (triangles.size() - o) / 3;
+	triangles.resize(o);
+	return dropped;
+}
+
+namespace {
+	// remainder of the SIMD paths, same operation order
+	inline glm::vec3 transform_affine(const glm::mat4& m, const glm::vec3& p)
+	{
+		return glm::vec3(
+			m[0][0] * p.x + m[3][0] + m[1][0] * p.y + m[2][0] * p.z,
+			m[0][1] * p.x + m[3][1] + m[1][1] * p.y + m[2][1] * p.z,
+			m[0][2] * p.x + m[3][2] + m[1][2] * p.y + m[2][2] * p.z
+		);
+	}
+
+	template<typename Fn>
+	void for_each_transform_chunk(size_t count, Fn&& fn)
+	{
+		const size_t chunks = (count + POINTCLOUD_TRANSFORM_CHUNK_SIZE - 1) / POINTCLOUD_TRANSFORM_CHUNK_SIZE;
+		if (chunks <= 1) {
+			fn(0, count);
+			return;
+		}
+
+		ThreadPool::global().parallel_for(chunks, [&](size_t chunk) {
+			const size_t begin = chunk * POINTCLOUD_TRANSFORM_CHUNK_SIZE;
+			fn(begin, std::min(count, begin + POINTCLOUD_TRANSFORM_CHUNK_SIZE));
+		});
+	}
+}
+
+void PointcloudKernels::transform_points(const glm::vec3* in, size_t count, const glm::mat4& transform, glm::vec3* out)
+{
+	for_each_transform_chunk(count, [&](size_t begin, size_t end) {
+		for (size_t i = transform_packed_range(in, begin, end, transform, out); i < end; i++) {
+			out[i] = transform_affine(transform, in[i]);
+		}
+	});
+}
+
+glm::mat4 PointcloudKernels::axis_remap(glm::ivec3 axes, glm::vec3 signs)
+{
+	glm::mat4 remap(0.f);
+	for (int i = 0; i < 3; i++) {
+		remap[axes[i]][i] = signs[i];
+	}
+	remap[3][3] = 1.f;
+	return remap;
+}
@@ -0,0 +1,122 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <k4a/k4a.hpp>
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+#include "PointBuffer.h"
+
+#pragma once
+
+struct PointcloudKernelResult {
+	size_t count = 0;
+	glm::vec3 sum = glm::vec3(0.f);
+	float max_radius_sq = 0.f;
+	glm::vec3 bounds_min = glm::vec3(std::numeric_limits<float>::infinity());
+	glm::vec3 bounds_max = glm::vec3(-std::numeric_limits<float>::infinity());
+
+	// combines the result of a following range into this one
+	inline void merge(const PointcloudKernelResult& other) {
+		count += other.count;
+		sum += other.sum;
+		max_radius_sq = std::max(max_radius_sq, other.max_radius_sq);
+		bounds_min = glm::min(bounds_min, other.bounds_min);
+		bounds_max = glm::max(bounds_max, other.bounds_max);
+	}
+};
+
+namespace PointcloudKernels {
+	// Unprojects `pixel_count` depth pixels with the xy table, rejects invalid depth/table
+	// entries and pixels without color, and compacts the survivors into `out` in a single pass.
+	// `out` must have room for `pixel_count` points. Positions are scaled by `scale` and
+	// x is mirrored, matching the renderer's coordinate system. If `pixel_normals` is set, the
+	// normals of the surviving pixels are compacted into `out.normals` (may alias, in place).
+	PointcloudKernelResult generate_points(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, const glm::vec3* pixel_normals, size_t pixel_count, float scale, const PointStreams& out);
+
+	// reference implementation, also used for the remainder of the SIMD paths
+	PointcloudKernelResult generate_points_scalar(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, const glm::vec3* pixel_normals, size_t pixel_count, float scale, const PointStreams& out);
+
+	// Same as generate_points, but splits the frame into POINTCLOUD_TILE_ROWS row tiles that run on the
+	// global thread pool. Tile results are compacted and reduced in tile order, so the output is
+	// byte-identical regardless of the number of threads. Normals are estimated if `out.normals` is set.
+	PointcloudKernelResult generate_points_parallel(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, int width, int height, float scale, const PointStreams& out);
+
+	// Flying pixel pre-pass over a raw DEPTH16 buffer: copies rows [row_begin, row_end) into `out`
+	// with every pixel set to 0 whose depth jumps by more than POINTCLOUD_FLYING_PIXEL_BASE_MM +
+	// depth * POINTCLOUD_FLYING_PIXEL_JUMP_Q16 / 65536 to one of its valid 4-neighbors. The zeroed
+	// pixels act as the validity mask for generate_points and estimate_normals, which already skip
+	// zero depth. `out` must not alias `depth_data`. Returns the number of rejected pixels.
+	size_t reject_flying_pixels(const uint16_t* depth_data, int width, int height, size_t row_begin, size_t row_end, uint16_t* out);
+	size_t reject_flying_pixels_parallel(const uint16_t* depth_data, int width, int height, uint16_t* out);
+
+	// Turns clip settings into one inclusive raw depth range per pixel, so the depth range, pixel roi
+	// and crop box reduce to two integer compares per frame. Pixels that can never pass get an empty
+	// range (min > max). Only needs to be rebuilt when the settings or the xy table change.
+	void build_clip_ranges(const DepthClipSettings& settings, const k4a_float2_t* xy_table_data, int width, int height, uint16_t* min_depth, uint16_t* max_depth);
+
+	// Sets every pixel outside its [min_depth, max_depth] range to 0 before unprojection, so
+	// generate_points skips the xy table lookup and color fetch for it. `out` may alias `depth_data`.
+	// Returns the number of non-zero pixels that were clipped.
+	size_t clip_depth(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, size_t pixel_count, uint16_t* out);
+	size_t clip_depth_parallel(const uint16_t* depth_data, const uint16_t* min_depth, const uint16_t* max_depth, int width, int height, uint16_t* out);
+
+	// Connected components of the organized depth grid. 4-neighbors are joined if their depth differs by at
+	// most POINTCLOUD_COMPONENT_BASE_MM + depth * POINTCLOUD_COMPONENT_JUMP_Q16 / 65536 (of the nearer one).
+	// Row tiles are joined with union-find in parallel, then the tile borders are merged and a second
+	// parallel pass resolves every pixel to its root. labels[i] is the smallest pixel index of the
+	// component, UINT32_MAX for zero depth. `parents` is scratch of the same size.
+	void label_components(const uint16_t* depth_data, int width, int height, uint32_t* parents, uint32_t* labels);
+
+	// Zeroes every pixel outside one component: the one at `seed` (or the nearest valid pixel within
+	// POINTCLOUD_COMPONENT_SEED_RADIUS) if seed.x >= 0, otherwise the largest one. `out` may alias
+	// `depth_data`. Returns the number of non-zero pixels that were removed.
+	size_t select_component(const uint16_t* depth_data, const uint32_t* labels, int width, int height, glm::ivec2 seed, uint16_t* out);
+
+	// Index of the point every pixel of the grid becomes in generate_points_parallel, UINT32_MAX for pixels
+	// that are rejected. Uses the same validity test as generate_points, in parallel row tiles.
+	// Returns the number of points.
+	size_t index_grid_points(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, const uint8_t* color_data, int width, int height, uint32_t* point_indices);
+
+	// Triangulates the organized grid in O(pixels): two triangles per 2x2 pixel quad, each one dropped if a
+	// corner has no point or its depth range exceeds POINTCLOUD_MESH_EDGE_BASE_MM + depth *
+	// POINTCLOUD_MESH_EDGE_JUMP_Q16 / 65536 (of its nearest corner). Row tiles run on the global thread pool
+	// and are appended in row order. Writes three point indices per triangle, wound to face the camera.
+	void triangulate_grid(const uint16_t* depth_data, const uint32_t* point_indices, int width, int height, std::vector<uint32_t>& triangles);
+
+	// Maps the triangle corners through `remap` (old point index -> new one, UINT32_MAX if the point was
+	// removed) and drops the triangles that lost a corner. Returns the number of dropped triangles.
+	size_t remap_triangles(std::vector<uint32_t>& triangles, const uint32_t* remap);
+
+	// Estimates per-pixel normals for the rows [row_begin, row_end) from the organized depth grid:
+	// cross product of the horizontal and vertical tangents, built from the neighbors that lie on
+	// the same surface (depth jump <= POINTCLOUD_NORMAL_MAX_DEPTH_JUMP). Pixels without a usable
+	// neighborhood get a zero normal. `normals` is indexed like the depth image.
+	void estimate_normals(const uint16_t* depth_data, const k4a_float2_t* xy_table_data, int width, int height, size_t row_begin, size_t row_end, float scale, glm::vec3* normals);
+
+	// Number of points with |dot(plane.xyz, p) + plane.w| <= threshold. The positions are split into
+	// x, y and z streams, so the SIMD paths test 4 (SSE2) or 8 (AVX2) points per step. NaN never counts.
+	size_t count_plane_inliers(const float* x, const float* y, const float* z, size_t count, const glm::vec4& plane, float threshold);
+
+	// Applies the affine part of `transform` (transform * vec4(p, 1), the last row is ignored) to
+	// packed xyz positions. The SIMD paths deinterleave 4 (SSE2) or 8 (AVX2) points per step and
+	// ranges above POINTCLOUD_TRANSFORM_CHUNK_SIZE are split over the global thread pool.
+	// `out` may alias `in`.
+	void transform_points(const glm::vec3* in, size_t count, const glm::mat4& transform, glm::vec3* out);
+
+	// Matrix that moves source axis `axes[i]` to axis i and multiplies it by `signs[i]`, used to fold
+	// the axis conventions of imported and exported files into the transform, e.g. (-x, z, -y) is
+	// axis_remap({ 0, 2, 1 }, { -1.f, 1.f, -1.f }).
+	glm::mat4 axis_remap(glm::ivec3 axes, glm::vec3 signs);
+
+	// Quantizes positions to unorm16 relative to the box `offset` .. `offset + extent` and colors
+	// to rgba8. dequantize_points is the inverse, up to half a quantization step. Extents below
+	// POINTCLOUD_COMPACT_MIN_EXTENT are raised to it, so a flat axis quantizes to 0.
+	void quantize_points(const PointBuffer& points, glm::vec3 offset, glm::vec3 extent, CompactPointAttributes* out);
+	void dequantize_points(const CompactPointAttributes* in, size_t count, glm::vec3 offset, glm::vec3 extent, PointBuffer& out);
+
+	const char* instruction_set();
+}
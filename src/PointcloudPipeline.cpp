@@ -0,0 +1,194 @@
+#include "PointcloudPipeline.h"
+
+#include "Pointcloud.h"
+#include "ThreadPool.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <format>
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	inline double milliseconds_since(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	inline size_t count_valid(const uint16_t* depth_data, size_t pixel_count)
+	{
+		return pixel_count - std::count(depth_data, depth_data + pixel_count, (uint16_t)0);
+	}
+
+	inline void record(PipelineStats& stats, PipelineStage stage, Clock::time_point start, size_t count_in, size_t count_out)
+	{
+		PipelineStageStats& s = stats[(size_t)stage];
+		s.milliseconds = milliseconds_since(start);
+		s.count_in = count_in;
+		s.count_out = count_out;
+		s.skipped = false;
+	}
+}
+
+void PointcloudPipeline::set_stage_enabled(PipelineStage stage, bool enabled)
+{
+	if (stage_optional(stage)) {
+		m_enabled[(size_t)stage] = enabled;
+	}
+}
+
+bool PointcloudPipeline::stage_enabled(PipelineStage stage) const
+{
+	return m_enabled[(size_t)stage];
+}
+
+bool PointcloudPipeline::stage_optional(PipelineStage stage)
+{
+	return stage == PipelineStage::DepthFilter || stage == PipelineStage::Downsample || stage == PipelineStage::OutlierRemoval;
+}
+
+const char* PointcloudPipeline::stage_name(PipelineStage stage)
+{
+	switch (stage) {
+		case PipelineStage::DepthFilter: return "Depth Filter";
+		case PipelineStage::Color: return "Color";
+		case PipelineStage::Unproject: return "Unproject";
+		case PipelineStage::Downsample: return "Downsample";
+		case PipelineStage::OutlierRemoval: return "Outlier Removal";
+		case PipelineStage::Upload: return "Upload";
+		default: return "";
+	}
+}
+
+void PointcloudPipeline::run(Pointcloud& pointcloud)
+{
+	Pointcloud* pointclouds[] = { &pointcloud };
+	run(pointclouds);
+}
+
+void PointcloudPipeline::run(std::span<Pointcloud* const> pointclouds)
+{
+	const auto start = Clock::now();
+	std::vector<PipelineStats> cloud_stats(pointclouds.size());
+
+	// one builder per worker, the settings can change between runs
+	const size_t worker_count = std::min<size_t>(pointclouds.size(), POINTCLOUD_PIPELINE_MAX_WORKERS);
+	while (m_builders.size() < worker_count) {
+		m_builders.push_back(std::make_unique<PointcloudBuilder>());
+	}
+	for (size_t i = 0; i < worker_count; i++) {
+		m_builders[i]->copy_settings(m_settings);
+	}
+
+	// workers pull the next cloud until none are left, so uneven clouds still balance
+	std::atomic<size_t> next_cloud = 0;
+	ThreadPool::global().parallel_for(worker_count, [&](size_t worker) {
+		size_t i;
+		while ((i = next_cloud.fetch_add(1)) < pointclouds.size()) {
+			process(*pointclouds[i], *m_builders[worker], cloud_stats[i]);
+		}
+	});
+
+	// the device and queue are only used from this thread
+	for (size_t i = 0; i < pointclouds.size(); i++) {
+		const auto upload_start = Clock::now();
+		pointclouds[i]->write_point_cloud_to_buffer();
+		record(cloud_stats[i], PipelineStage::Upload, upload_start, pointclouds[i]->pointcount(), pointclouds[i]->pointcount());
+	}
+
+	m_last_stats = {};
+	for (const PipelineStats& stats : cloud_stats) {
+		for (size_t s = 0; s < stats.size(); s++) {
+			if (stats[s].skipped)
+				continue;
+
+			m_last_stats[s].milliseconds += stats[s].milliseconds;
+			m_last_stats[s].count_in += stats[s].count_in;
+			m_last_stats[s].count_out += stats[s].count_out;
+			m_last_stats[s].skipped = false;
+		}
+	}
+	m_last_cloud_count = pointclouds.size();
+	m_last_run_milliseconds = milliseconds_since(start);
+
+	Logger::log(std::format("Pipeline: {} cloud(s) in {:.2f} ms", m_last_cloud_count, m_last_run_milliseconds));
+	for (size_t s = 0; s < m_last_stats.size(); s++) {
+		const PipelineStageStats& stats = m_last_stats[s];
+		if (stats.skipped)
+			continue;
+
+		Logger::log(std::format("  {}: {:.2f} ms, {} -> {}", stage_name((PipelineStage)s), stats.milliseconds, stats.count_in, stats.count_out));
+	}
+}
+
+void PointcloudPipeline::clear()
+{
+	m_builders.clear();
+}
+
+void PointcloudPipeline::process(Pointcloud& pointcloud, PointcloudBuilder& builder, PipelineStats& stats) const
+{
+	PointcloudBuildResult result;
+	// the early returns below leave the cloud empty, its index and snapshot must not outlive the points
+	pointcloud.m_points.clear();
+	pointcloud.m_triangles.clear();
+	pointcloud.invalidate_spatial_data();
+
+	const k4a::image& depth_image = pointcloud.m_depth_image;
+	if (!depth_image) {
+		Logger::log("Tried to build a point cloud without a depth image.", LoggingSeverity::Error);
+		return;
+	}
+
+	const size_t pixel_count = (size_t)depth_image.get_width_pixels() * depth_image.get_height_pixels();
+	const size_t raw_pixels = count_valid((const uint16_t*)depth_image.get_buffer(), pixel_count);
+
+	// the depth stage also selects the builder resources, so it runs even when the filters are off
+	auto start = Clock::now();
+	const uint16_t* depth_data = builder.filter_depth(depth_image, pointcloud.m_calibration, stage_enabled(PipelineStage::DepthFilter), result);
+	if (!depth_data) {
+		return;
+	}
+
+	size_t valid_pixels = raw_pixels;
+	if (stage_enabled(PipelineStage::DepthFilter)) {
+		valid_pixels = count_valid(depth_data, pixel_count);
+		record(stats, PipelineStage::DepthFilter, start, raw_pixels, valid_pixels);
+	}
+
+	// in color space this also moves the depth into the (strided) color grid
+	start = Clock::now();
+	const uint16_t* grid_depth = builder.transform_color(depth_image, depth_data, pointcloud.m_color_image);
+	if (!grid_depth) {
+		return;
+	}
+
+	size_t grid_pixels = valid_pixels;
+	if (grid_depth != depth_data) {
+		const glm::ivec2 grid_size = builder.grid_size();
+		grid_pixels = count_valid(grid_depth, (size_t)grid_size.x * grid_size.y);
+	}
+	record(stats, PipelineStage::Color, start, valid_pixels, grid_pixels);
+
+	start = Clock::now();
+	builder.generate(grid_depth, pointcloud.m_points, pointcloud.m_has_plane_prior ? &pointcloud.m_plane_prior : nullptr, result, &pointcloud.m_triangles);
+	record(stats, PipelineStage::Unproject, start, grid_pixels, pointcloud.m_points.size());
+	pointcloud.apply_build_result(result);
+
+	if (stage_enabled(PipelineStage::Downsample) && pointcloud.m_voxel_size > 0.f) {
+		const size_t count_in = pointcloud.m_points.size();
+		start = Clock::now();
+		pointcloud.downsample_points();
+		pointcloud.update_extent();
+		record(stats, PipelineStage::Downsample, start, count_in, pointcloud.m_points.size());
+	}
+
+	if (stage_enabled(PipelineStage::OutlierRemoval) && pointcloud.m_outlier_removal) {
+		const size_t count_in = pointcloud.m_points.size();
+		start = Clock::now();
+		pointcloud.filter_outliers();
+		record(stats, PipelineStage::OutlierRemoval, start, count_in, pointcloud.m_points.size());
+	}
+}
@@ -0,0 +1,82 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <array>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "Structs.h"
+#include "PointcloudBuilder.h"
+
+#pragma once
+
+class Pointcloud;
+
+enum class PipelineStage {
+	DepthFilter,
+	Color,
+	Unproject,
+	Downsample,
+	OutlierRemoval,
+	Upload,
+	Count
+};
+
+struct PipelineStageStats {
+	double milliseconds = 0.;
+	size_t count_in = 0; // depth pixels up to unproject, points after
+	size_t count_out = 0;
+	bool skipped = true;
+};
+
+using PipelineStats = std::array<PipelineStageStats, (size_t)PipelineStage::Count>;
+
+// Turns captures into uploaded point clouds in fixed stages: depth pre-filter, color transform,
+// unproject, downsample, outlier removal and upload. The optional stages can be turned off per
+// session. Independent clouds run concurrently on the global thread pool, each worker with its own
+// PointcloudBuilder that copies the session settings, and the gpu upload runs on the calling thread
+// once all of them are done. Every stage reports its wall time and point counts.
+class PointcloudPipeline {
+public:
+	// builder settings the workers copy at the start of every run
+	inline PointcloudBuilder& settings() {
+		return m_settings;
+	}
+
+	// depth filter, downsample and outlier removal can be turned off, the others always run
+	void set_stage_enabled(PipelineStage stage, bool enabled);
+	bool stage_enabled(PipelineStage stage) const;
+	static bool stage_optional(PipelineStage stage);
+	static const char* stage_name(PipelineStage stage);
+
+	// (re)builds the clouds from their stored capture images and blocks until all are uploaded
+	void run(std::span<Pointcloud* const> pointclouds);
+	void run(Pointcloud& pointcloud);
+
+	// stage stats of the last run, summed over its clouds
+	inline const PipelineStats& last_stats() const {
+		return m_last_stats;
+	}
+
+	inline size_t last_cloud_count() const {
+		return m_last_cloud_count;
+	}
+
+	inline double last_run_milliseconds() const {
+		return m_last_run_milliseconds;
+	}
+
+	// drops the per-worker scratch buffers
+	void clear();
+
+private:
+	void process(Pointcloud& pointcloud, PointcloudBuilder& builder, PipelineStats& stats) const;
+
+	PointcloudBuilder m_settings;
+	std::array<bool, (size_t)PipelineStage::Count> m_enabled = { true, true, true, true, true, true };
+	std::vector<std::unique_ptr<PointcloudBuilder>> m_builders;
+
+	PipelineStats m_last_stats;
+	size_t m_last_cloud_count = 0;
+	double m_last_run_milliseconds = 0.;
+};
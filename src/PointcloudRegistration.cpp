@@ -0,0 +1,405 @@
+#include "PointcloudRegistration.h"
+
+#include "ThreadPool.h"
+#include "PointcloudFilters.h"
+
+#include <Eigen/Dense>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace {
+	using Vector6d = Eigen::Matrix<double, 6, 1>;
+	using Matrix6d = Eigen::Matrix<double, 6, 6>;
+
+	struct CorrespondenceSums {
+		size_t count = 0;
+		glm::dvec3 source_sum = glm::dvec3(0.);
+		glm::dvec3 target_sum = glm::dvec3(0.);
+		glm::dmat3 cross = glm::dmat3(0.); // sum of source * target^T
+		double distance_sq = 0.;
+
+		inline void add(const glm::vec3& source, const glm::vec3& target) {
+			source_sum += glm::dvec3(source);
+			target_sum += glm::dvec3(target);
+			cross += glm::outerProduct(glm::dvec3(source), glm::dvec3(target));
+		}
+
+		inline void merge(const CorrespondenceSums& other) {
+			count += other.count;
+			source_sum += other.source_sum;
+			target_sum += other.target_sum;
+			cross += other.cross;
+			distance_sq += other.distance_sq;
+		}
+	};
+
+	// normal equations of the linearized error in the twist (rotation vector, translation)
+	struct NormalEquations {
+		size_t count = 0;
+		Matrix6d h = Matrix6d::Zero();
+		Vector6d b = Vector6d::Zero();
+		double distance_sq = 0.;
+
+		inline void merge(const NormalEquations& other) {
+			count += other.count;
+			h += other.h;
+			b += other.b;
+			distance_sq += other.distance_sq;
+		}
+	};
+
+	inline Eigen::Vector3d to_eigen(const glm::vec3& v)
+	{
+		return Eigen::Vector3d(v.x, v.y, v.z);
+	}
+
+	inline Eigen::Matrix3d to_eigen(const glm::mat3& m)
+	{
+		Eigen::Matrix3d result;
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				result(row, col) = m[col][row];
+			}
+		}
+		return result;
+	}
+
+	inline glm::mat4 to_transform(const Eigen::Matrix3d& rotation, const Eigen::Vector3d& translation)
+	{
+		glm::mat4 transform(1.f);
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				transform[col][row] = (float)rotation(row, col);
+			}
+			transform[3][row] = (float)translation(row);
+		}
+		return transform;
+	}
+
+	// [v]x, so that skew(v) * w = v x w
+	inline Eigen::Matrix3d skew(const Eigen::Vector3d& v)
+	{
+		Eigen::Matrix3d m;
+		m << 0., -v.z(), v.y(),
+			v.z(), 0., -v.x(),
+			-v.y(), v.x(), 0.;
+		return m;
+	}
+
+	// visits every source point that has a target neighbor within range, in chunks on the global thread
+	// pool. every chunk accumulates into its own sums, which are merged in chunk order.
+	template<typename Sums, typename Fn>
+	Sums gather(std::span<const glm::vec3> source, const glm::mat4& relative, const KdTree& index, float max_distance_sq, Fn&& accumulate)
+	{
+		const size_t chunk_count = (source.size() + POINTCLOUD_ICP_CHUNK_SIZE - 1) / POINTCLOUD_ICP_CHUNK_SIZE;
+		std::vector<Sums> chunk_sums(chunk_count);
+
+		ThreadPool::global().parallel_for(chunk_count, [&](size_t chunk) {
+			const size_t begin = chunk * POINTCLOUD_ICP_CHUNK_SIZE;
+			const size_t end = std::min(begin + POINTCLOUD_ICP_CHUNK_SIZE, source.size());
+
+			Sums& sums = chunk_sums[chunk];
+			for (size_t i = begin; i < end; i++) {
+				const glm::vec3 p = glm::vec3(relative * glm::vec4(source[i], 1.f));
+				uint32_t target_index;
+				float distance_sq;
+
+				// also rejects non-finite source points
+				if (index.knn(p, 1, &target_index, &distance_sq) == 0 || !(distance_sq <= max_distance_sq))
+					continue;
+
+				if (accumulate(sums, i, p, target_index)) {
+					sums.count++;
+					sums.distance_sq += distance_sq;
+				}
+			}
+		});
+
+		Sums sums;
+		for (const Sums& chunk : chunk_sums) {
+			sums.merge(chunk);
+		}
+		return sums;
+	}
+
+	// rigid transform that moves the source correspondences onto the target ones in the least squares
+	// sense (Kabsch), from the centered cross-covariance
+	glm::mat4 solve_rigid(const CorrespondenceSums& sums)
+	{
+		const double n = (double)sums.count;
+		const glm::dvec3 source_mean = sums.source_sum / n;
+		const glm::dvec3 target_mean = sums.target_sum / n;
+		const glm::dmat3 covariance = sums.cross - glm::outerProduct(source_mean, target_mean) * n;
+
+		Eigen::Matrix3d h;
+		for (int row = 0; row < 3; row++) {
+			for (int col = 0; col < 3; col++) {
+				h(row, col) = covariance[col][row];
+			}
+		}
+
+		const Eigen::JacobiSVD<Eigen::Matrix3d> svd(h, Eigen::ComputeFullU | Eigen::ComputeFullV);
+		Eigen::Matrix3d v = svd.matrixV();
+		if ((v * svd.matrixU().transpose()).determinant() < 0.) {
+			v.col(2) *= -1.;
+		}
+		const Eigen::Matrix3d rotation = v * svd.matrixU().transpose();
+		const Eigen::Vector3d translation = Eigen::Vector3d(target_mean.x, target_mean.y, target_mean.z) - rotation * Eigen::Vector3d(source_mean.x, source_mean.y, source_mean.z);
+		return to_transform(rotation, translation);
+	}
+
+	// minimizes the linearized error, false if the system is degenerate
+	bool solve_twist(NormalEquations& equations, glm::mat4& step)
+	{
+		// a little damping keeps directions the geometry does not constrain (e.g. sliding along a wall) in place
+		equations.h.diagonal().array() += 1e-6 * (equations.h.trace() / 6. + 1e-12);
+
+		const Vector6d x = equations.h.ldlt().solve(-equations.b);
+		if (!x.allFinite())
+			return false;
+
+		const Eigen::Vector3d omega = x.head<3>();
+		const double angle = omega.norm();
+		const Eigen::Matrix3d rotation = angle > 0. ? Eigen::AngleAxisd(angle, omega / angle).toRotationMatrix() : Eigen::Matrix3d::Identity();
+		step = to_transform(rotation, x.tail<3>());
+		return true;
+	}
+}
+
+void RegistrationLevel::build(const PointBuffer& points, float voxel_size)
+{
+	if (voxel_size > 0.f) {
+		PointcloudFilters::voxel_downsample(points, voxel_size, m_points);
+	}
+	else {
+		m_points = points;
+	}
+	m_built = true;
+	m_voxel_size = voxel_size;
+	m_index_valid = false;
+	m_surfaces_valid = false;
+}
+
+RegistrationCloud RegistrationLevel::cloud(RegistrationMethod method, bool target, const glm::mat4& pose)
+{
+	RegistrationCloud cloud;
+	cloud.positions = m_points.positions();
+	cloud.pose = pose;
+	if (target && !m_index_valid) {
+		m_index.build(m_points.positions());
+		m_index_valid = true;
+	}
+	if (target) {
+		cloud.index = &m_index;
+	}
+
+	if ((method == RegistrationMethod::PointToPlane && target) || method == RegistrationMethod::Generalized) {
+		update_surfaces();
+		if (method == RegistrationMethod::PointToPlane)
+			cloud.normals = m_normals;
+		else
+			cloud.covariances = m_covariances;
+	}
+	return cloud;
+}
+
+void RegistrationLevel::update_surfaces()
+{
+	if (m_surfaces_valid)
+		return;
+
+	// the source side of GICP needs covariances too, so the tree may be built here
+	if (!m_index_valid) {
+		m_index.build(m_points.positions());
+		m_index_valid = true;
+	}
+
+	// averaged voxel normals are blurred at edges, the grids get a fresh estimate. the full resolution
+	// keeps the cloud's own normals if it has them.
+	const bool own_normals = m_voxel_size <= 0.f && m_points.has_normals();
+	if (own_normals) {
+		m_normals.assign(m_points.normals().begin(), m_points.normals().end());
+	}
+	else {
+		m_normals.resize(m_points.size());
+	}
+	m_covariances.resize(m_points.size());
+	PointcloudFilters::estimate_surfaces(m_points.positions(), m_index, POINTCLOUD_SURFACE_NEIGHBORS, own_normals ? nullptr : m_normals.data(), m_covariances.data());
+	m_surfaces_valid = true;
+}
+
+size_t RegistrationLevel::memory_usage() const
+{
+	return m_points.memory_usage() + m_index.memory_usage() + m_normals.capacity() * sizeof(glm::vec3) + m_covariances.capacity() * sizeof(glm::mat3);
+}
+
+RegistrationPyramid::RegistrationPyramid(const PointBuffer& points)
+{
+	m_levels.back().build(points, 0.f);
+	m_memory_usage = m_levels.back().memory_usage();
+}
+
+RegistrationCloud RegistrationPyramid::cloud(int level, RegistrationMethod method, bool target, const glm::mat4& pose)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_levels[level].is_built()) {
+		m_levels[level].build(m_levels.back().points(), voxel_size(level));
+	}
+	RegistrationCloud cloud = m_levels[level].cloud(method, target, pose);
+
+	size_t bytes = 0;
+	for (const auto& built : m_levels) {
+		bytes += built.memory_usage();
+	}
+	m_memory_usage = bytes;
+	return cloud;
+}
+
+float RegistrationPyramid::voxel_size(int level)
+{
+	return level < POINTCLOUD_ICP_PYRAMID_LEVELS ? std::ldexp(POINTCLOUD_ICP_PYRAMID_VOXEL_SIZE, -level) : 0.f;
+}
+
+
+RegistrationResult PointcloudRegistration::align(const RegistrationCloud& source, const RegistrationCloud& target, const RegistrationSettings& settings, RegistrationProgress* progress)
+{
+	RegistrationResult result;
+	result.source_pose = source.pose;
+	if (source.positions.empty() || !target.index || target.index->empty())
+		return result;
+
+	const RegistrationMethod method = settings.method;
+	if (method == RegistrationMethod::PointToPlane && target.normals.size() != target.positions.size())
+		return result;
+	if (method == RegistrationMethod::Generalized && (source.covariances.size() != source.positions.size() || target.covariances.size() != target.positions.size()))
+		return result;
+
+	// distances are measured in the target frame, the scale of its pose maps them to world units
+	const float target_scale = glm::length(glm::vec3(target.pose[0]));
+	const float max_distance = settings.max_correspondence_distance / target_scale;
+	const float max_distance_sq = max_distance * max_distance;
+
+	// source local -> target local, the only thing that changes between iterations
+	glm::mat4 relative = glm::inverse(target.pose) * source.pose;
+	double previous_mse = std::numeric_limits<double>::infinity();
+
+	for (int iteration = 0; iteration < settings.max_iterations; iteration++) {
+		if (progress && progress->cancelled) {
+			result.converged = false;
+			result.cancelled = true;
+			break;
+		}
+
+		glm::mat4 step;
+		size_t count = 0;
+		double distance_sq = 0.;
+
+		if (method == RegistrationMethod::PointToPoint) {
+			const CorrespondenceSums sums = gather<CorrespondenceSums>(source.positions, relative, *target.index, max_distance_sq, [&](CorrespondenceSums& sums, size_t, const glm::vec3& p, uint32_t t) {
+				sums.add(p, target.positions[t]);
+				return true;
+			});
+
+			count = sums.count;
+			distance_sq = sums.distance_sq;
+			if (count >= 3) {
+				step = solve_rigid(sums);
+			}
+		}
+		else if (method == RegistrationMethod::PointToPlane) {
+			// r = n . (p - q), linearized in the twist: r + (p x n, n) . x
+			NormalEquations equations = gather<NormalEquations>(source.positions, relative, *target.index, max_distance_sq, [&](NormalEquations& sums, size_t, const glm::vec3& p, uint32_t t) {
+				const glm::vec3& n = target.normals[t];
+				if (n.x == 0.f && n.y == 0.f && n.z == 0.f)
+					return false;
+
+				const double r = glm::dot(n, p - target.positions[t]);
+				const glm::vec3 c = glm::cross(p, n);
+				Vector6d j;
+				j << c.x, c.y, c.z, n.x, n.y, n.z;
+				sums.h.selfadjointView<Eigen::Upper>().rankUpdate(j);
+				sums.b += j * r;
+				return true;
+			});
+
+			equations.h.triangularView<Eigen::StrictlyLower>() = equations.h.transpose();
+			count = equations.count;
+			distance_sq = equations.distance_sq;
+			if (count >= 3 && !solve_twist(equations, step)) {
+				count = 0;
+			}
+		}
+		else {
+			// d = q - p, linearized in the twist: d + ([p]x, -I) x, weighted by (C_q + R C_p R^T)^-1
+			Eigen::Matrix3d rotation = to_eigen(glm::mat3(relative));
+			rotation /= std::cbrt(rotation.determinant());
+
+			NormalEquations equations = gather<NormalEquations>(source.positions, relative, *target.index, max_distance_sq, [&](NormalEquations& sums, size_t s, const glm::vec3& p, uint32_t t) {
+				const Eigen::Matrix3d combined = to_eigen(target.covariances[t]) + rotation * to_eigen(source.covariances[s]) * rotation.transpose();
+				const Eigen::Matrix3d weight = combined.inverse();
+				const Eigen::Vector3d point = to_eigen(p);
+				const Eigen::Vector3d d = to_eigen(target.positions[t]) - point;
+
+				Eigen::Matrix<double, 3, 6> j;
+				j.leftCols<3>() = skew(point);
+				j.rightCols<3>() = -Eigen::Matrix3d::Identity();
+
+				const Eigen::Matrix<double, 6, 3> jt_weight = j.transpose() * weight;
+				sums.h += jt_weight * j;
+				sums.b += jt_weight * d;
+				return true;
+			});
+
+			count = equations.count;
+			distance_sq = equations.distance_sq;
+			if (count >= 3 && !solve_twist(equations, step)) {
+				count = 0;
+			}
+		}
+
+		if (count < 3) {
+			result.converged = false;
+			break;
+		}
+
+		relative = step * relative;
+
+		const double mse = distance_sq / (double)count;
+		result.converged = true;
+		result.iterations = iteration + 1;
+		result.correspondences = count;
+		result.fitness = (float)(mse * target_scale * target_scale);
+		if (progress) {
+			progress->iterations++;
+			progress->fitness = result.fitness;
+		}
+
+		// stop once a step barely moves the cloud or the error stops improving
+		const glm::vec3 translation = glm::vec3(step[3]);
+		const double rotation_cos = ((double)step[0][0] + step[1][1] + step[2][2] - 1.) * .5;
+		if (glm::dot(translation, translation) < POINTCLOUD_ICP_TRANSFORMATION_EPSILON && rotation_cos > 1. - POINTCLOUD_ICP_TRANSFORMATION_EPSILON)
+			break;
+		if (std::abs(previous_mse - mse) <= POINTCLOUD_ICP_FITNESS_EPSILON * mse)
+			break;
+
+		previous_mse = mse;
+	}
+
+	if (result.converged) {
+		result.source_pose = target.pose * relative;
+	}
+	return result;
+}
+
+const char* PointcloudRegistration::method_name(RegistrationMethod method)
+{
+	switch (method) {
+		case RegistrationMethod::PointToPoint: return "Point to Point";
+		case RegistrationMethod::PointToPlane: return "Point to Plane";
+		case RegistrationMethod::Generalized: return "Generalized";
+		default: return "";
+	}
+}
@@ -0,0 +1,143 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <span>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+#include "PointBuffer.h"
+#include "KdTree.h"
+
+#pragma once
+
+enum class RegistrationMethod {
+	PointToPoint,
+	PointToPlane, // needs target normals
+	Generalized // plane-to-plane GICP, needs source and target covariances
+};
+
+// one cloud in its local frame, placed in the world by `pose`. the spans are only read.
+struct RegistrationCloud {
+	std::span<const glm::vec3> positions;
+	glm::mat4 pose = glm::mat4(1.f);
+	const KdTree* index = nullptr; // over positions, target only
+	std::span<const glm::vec3> normals; // target, point-to-plane
+	std::span<const glm::mat3> covariances; // generalized
+};
+
+struct RegistrationSettings {
+	RegistrationMethod method = RegistrationMethod::PointToPlane;
+	int max_iterations = 50;
+	float max_correspondence_distance = 1.f; // world units
+	bool coarse_to_fine = true; // run the voxel pyramid before the full resolution
+};
+
+struct RegistrationResult {
+	bool converged = false;
+	int iterations = 0;
+	size_t correspondences = 0;
+	float fitness = 0.f; // mean squared correspondence distance in world units
+	bool cancelled = false;
+	glm::mat4 source_pose = glm::mat4(1.f);
+};
+
+// live state of a running alignment, written by the worker and read by the UI
+struct RegistrationProgress {
+	std::atomic<int> level = 0;
+	std::atomic<int> iterations = 0; // over all levels
+	std::atomic<float> fitness = 0.f;
+	std::atomic<bool> cancelled = false; // set by the UI, checked before every iteration
+};
+
+// one level of a registration pyramid. The index and surfaces are built on first use, so a level that
+// is only ever a source never gets a tree.
+class RegistrationLevel {
+public:
+	// voxel grid of `points`, `voxel_size` <= 0 keeps them as they are
+	void build(const PointBuffer& points, float voxel_size);
+
+	// the level placed at `pose`, with what `method` needs (the index only for the target)
+	RegistrationCloud cloud(RegistrationMethod method, bool target, const glm::mat4& pose);
+
+	inline bool is_built() const {
+		return m_built;
+	}
+
+	inline const PointBuffer& points() const {
+		return m_points;
+	}
+
+	inline float voxel_size() const {
+		return m_voxel_size;
+	}
+
+	inline size_t size() const {
+		return m_points.size();
+	}
+
+	size_t memory_usage() const;
+
+private:
+	void update_surfaces();
+
+	PointBuffer m_points;
+	bool m_built = false;
+	float m_voxel_size = 0.f;
+	KdTree m_index;
+	bool m_index_valid = false;
+	std::vector<glm::vec3> m_normals;
+	std::vector<glm::mat3> m_covariances;
+	bool m_surfaces_valid = false;
+};
+
+// immutable snapshot of one cloud for registration: levels 0 .. POINTCLOUD_ICP_PYRAMID_LEVELS - 1 are
+// voxel grids from the coarsest to the finest, POINTCLOUD_ICP_PYRAMID_LEVELS is a copy of the points.
+// Only the copy is made on construction, the grids, indices and surfaces are built on first use under
+// a lock, so several jobs on worker threads may share the snapshot while the cloud itself changes.
+class RegistrationPyramid {
+public:
+	static constexpr int level_count = POINTCLOUD_ICP_PYRAMID_LEVELS + 1;
+
+	explicit RegistrationPyramid(const PointBuffer& points);
+
+	// the spans stay valid as long as the pyramid
+	RegistrationCloud cloud(int level, RegistrationMethod method, bool target, const glm::mat4& pose);
+
+	// the snapshot itself, never changes
+	inline const PointBuffer& points() const {
+		return m_levels.back().points();
+	}
+
+	// 0 for the full resolution
+	static float voxel_size(int level);
+
+	// the copy and every level built so far, without waiting for a build in progress
+	inline size_t memory_usage() const {
+		return m_memory_usage;
+	}
+
+private:
+	std::mutex m_mutex;
+	std::atomic<size_t> m_memory_usage = 0;
+	std::array<RegistrationLevel, level_count> m_levels;
+};
+
+namespace PointcloudRegistration {
+	// ICP of the source against the target. Neither cloud is copied or transformed: every iteration maps
+	// the source points into the target's local frame on the fly and queries the cached target index, so
+	// repeated runs against the same target have no setup cost. Correspondences are gathered in
+	// POINTCLOUD_ICP_CHUNK_SIZE chunks on the global thread pool. Each chunk keeps its own partial sums
+	// (centroids and cross-covariance for point-to-point, the 6x6 normal equations of the linearized
+	// point-to-plane / GICP error otherwise), which are reduced in chunk order. The returned pose places
+	// the source on the target, the poses may contain a uniform scale. Fails (converged = false) if fewer
+	// than 3 correspondences are found or the method is missing its normals / covariances. With
+	// `progress` set, every iteration publishes its fitness there and a cancel request stops the run
+	// (converged = false, cancelled = true).
+	RegistrationResult align(const RegistrationCloud& source, const RegistrationCloud& target, const RegistrationSettings& settings, RegistrationProgress* progress = nullptr);
+
+	const char* method_name(RegistrationMethod method);
+}
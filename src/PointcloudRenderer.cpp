@@ -1,6 +1,7 @@
 #include "PointcloudRenderer.h"
 
 #include "ResourceManager.h"
+#include "PointcloudKernels.h"
 
 
 #include <GLFW/glfw3.h>
@@ -14,10 +15,6 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
-#include <pcl/point_types.h>
-#include <pcl/point_cloud.h>
-#include <pcl/registration/icp.h>
-#include <pcl/io/pcd_io.h>
 
 
 bool PointcloudRenderer::on_init(wgpu::Device device, wgpu::Queue queue, int width, int height)
@@ -50,6 +47,7 @@ bool PointcloudRenderer::on_init(wgpu::Device device, wgpu::Queue queue, int wid
 
 void PointcloudRenderer::on_terminate()
 {
+	drop_alignment(nullptr);
 	terminate_bindgroup();
 	terminate_uniforms();
 	terminate_renderpipeline();
@@ -78,6 +76,7 @@ Pointcloud* PointcloudRenderer::add_pointcloud(Pointcloud* pc) {
 
 void PointcloudRenderer::remove_pointcloud(Pointcloud* ptr_to_remove)
 {
+	drop_alignment(ptr_to_remove);
 	m_pointclouds.erase(
 		std::remove(m_pointclouds.begin(), m_pointclouds.end(), ptr_to_remove),
 		m_pointclouds.end()
@@ -86,6 +85,7 @@ void PointcloudRenderer::remove_pointcloud(Pointcloud* ptr_to_remove)
 
 void PointcloudRenderer::clear_pointclouds()
 {
+	drop_alignment(nullptr);
 	for (auto pc : m_pointclouds) {
 		delete pc;
 	}
@@ -106,6 +106,15 @@ int PointcloudRenderer::get_num_vertices()
 	return num;
 }
 
+size_t PointcloudRenderer::get_point_memory_usage()
+{
+	size_t bytes = 0;
+	for (auto pc : m_pointclouds) {
+		bytes += pc->points().memory_usage() + pc->registration_memory_usage();
+	}
+	return bytes;
+}
+
 float PointcloudRenderer::get_futhest_point()
 {
 	float value = 0.f;
@@ -125,94 +134,98 @@ void PointcloudRenderer::set_selected(Pointcloud* pc)
 	m_selected_pointcloud = pc;
 }
 
-std::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> PointcloudRenderer::vector_to_pointcloud(const std::vector<PointAttributes>& vec, const glm::mat4 trans_mat) {
-	auto cloud = std::make_shared<pcl::PointCloud<pcl::PointXYZRGB>>();
-	cloud->width = static_cast<uint32_t>(vec.size());
-	cloud->height = 1;
-	cloud->is_dense = false;
-	cloud->points.resize(vec.size());
-
-	for (size_t i = 0; i < vec.size(); i++) {
-		const auto& pt = vec[i];
-
-		glm::vec4 transformed_point = trans_mat * glm::vec4(
-			pt.position.x,
-			pt.position.y,
-			pt.position.z,
-			1.f);
-
-		pcl::PointXYZRGB p;
-
-		p.x = transformed_point.x;
-		p.y = transformed_point.y;
-		p.z = transformed_point.z;
-
-		p.r = static_cast<uint8_t>(pt.color.r * 255.f);
-		p.g = static_cast<uint8_t>(pt.color.g * 255.f);
-		p.b = static_cast<uint8_t>(pt.color.b * 255.f);
+bool PointcloudRenderer::start_alignment(const RegistrationSettings& settings, Pointcloud* source, Pointcloud* target)
+{
+	if (!source || !target || source == target)
+		return false;
 
-		cloud->points[i] = p;
+	if (is_aligning()) {
+		Logger::log("An alignment is already running", LoggingSeverity::Warning);
+		return false;
 	}
 
-	return cloud;
+	Logger::log(std::format("ICP ({}) started", PointcloudRegistration::method_name(settings.method)));
+	m_alignment_job = std::make_unique<RegistrationJob>(source, target, settings);
+	return true;
 }
 
-void PointcloudRenderer::align_pointclouds(int max_iter, float max_corr_dist, Pointcloud* source, Pointcloud* target)
+bool PointcloudRenderer::start_batch_alignment(const RegistrationSettings& settings, BatchAlignmentMode mode, const std::vector<Pointcloud*>& clouds, const std::vector<std::string>& names)
 {
-	if (!source || !target)
-		return;
-
-	static auto eigen_to_glm = [](const Eigen::Matrix4f& eigen_mat) {
-		glm::mat4 glm_mat;
-
-		for (int row = 0; row < 4; row++) {
-			for (int col = 0; col < 4; col++) {
-				glm_mat[col][row] = eigen_mat(row, col);
-			}
-		}
-
-		return glm_mat;
-	};
+	if (clouds.size() < 2 || names.size() != clouds.size())
+		return false;
 
-	if (m_pointclouds.size() < 2) {
-		return;
+	if (is_aligning()) {
+		Logger::log("An alignment is already running", LoggingSeverity::Warning);
+		return false;
 	}
 
-	Logger::log("ICP started");
-
-	auto source_cloud = vector_to_pointcloud(source->points(), *source->get_transform_ptr());
-	auto target_cloud = vector_to_pointcloud(target->points(), *target->get_transform_ptr());
+	Logger::log(std::format("Batch alignment ({}, {}) of {} clouds started", RegistrationBatch::mode_name(mode), PointcloudRegistration::method_name(settings.method), clouds.size()));
+	m_alignment_batch = std::make_unique<RegistrationBatch>(clouds, names, settings, mode);
+	return true;
+}
 
+void PointcloudRenderer::cancel_alignment()
+{
+	if (m_alignment_job) {
+		m_alignment_job->cancel();
+	}
+	if (m_alignment_batch) {
+		m_alignment_batch->cancel();
+	}
+}
 
-	pcl::IterativeClosestPoint<pcl::PointXYZRGB, pcl::PointXYZRGB> icp;
-	icp.setMaximumIterations(max_iter);
-	icp.setMaxCorrespondenceDistance(max_corr_dist);
-	icp.setTransformationEpsilon(1e-8);
-	icp.setEuclideanFitnessEpsilon(1);
+bool PointcloudRenderer::is_aligning() const
+{
+	return m_alignment_job || (m_alignment_batch && !m_alignment_batch->is_applied());
+}
 
-	icp.setInputSource(source_cloud);
-	icp.setInputTarget(target_cloud);
+void PointcloudRenderer::update_alignment()
+{
+	// a finished batch stays around for its summary
+	if (m_alignment_batch && !m_alignment_batch->is_applied() && m_alignment_batch->done()) {
+		m_alignment_batch->apply();
+	}
 
-	pcl::PointCloud<pcl::PointXYZRGB> aligned_cloud;
-	icp.align(aligned_cloud);
+	if (!m_alignment_job || !m_alignment_job->done())
+		return;
 
-	if (icp.hasConverged()) {
-		Logger::log(std::format("ICP converged. Fitness Score: {}", icp.getFitnessScore()));
+	std::unique_ptr<RegistrationJob> job = std::move(m_alignment_job);
+	RegistrationResult result = job->take_result();
 
-		// Transformation ausgeben
-		glm::mat4 transform_delta = eigen_to_glm(icp.getFinalTransformation());
-		glm::mat4 transform_old = *source->get_transform_ptr();
-		glm::mat4 transform_new = transform_delta * transform_old;
+	if (result.cancelled) {
+		Logger::log(std::format("ICP cancelled after {} iterations", result.iterations), LoggingSeverity::Warning);
+	}
+	else if (result.converged) {
+		Logger::log(std::format("ICP converged after {} iterations in {:.2f} ms. Fitness Score: {}", result.iterations, job->elapsed_ms(), result.fitness));
 
+		glm::mat4 transform_delta = result.source_pose * glm::inverse(job->initial_pose());
 		Logger::log(std::format("Transformationmatrix:\n{}", Helper::mat4_to_string(transform_delta)));
 
-		source->set_transform(transform_new);
+		// applied between two frames, so a frame never sees a half updated pose. The correction goes on top
+		// of the current pose, the cloud may have been moved while the job ran.
+		job->source()->set_transform(transform_delta * *job->source()->get_transform_ptr());
 	}
 	else {
 		Logger::log("ICP failed to converge.", LoggingSeverity::Warning);
 	}
 }
 
+void PointcloudRenderer::drop_alignment(Pointcloud* pc)
+{
+	if (m_alignment_job && (!pc || m_alignment_job->source() == pc || m_alignment_job->target() == pc)) {
+		// waits for the worker, which stops at its next iteration
+		m_alignment_job.reset();
+		Logger::log(pc ? "ICP cancelled, its point cloud was removed" : "ICP cancelled", LoggingSeverity::Warning);
+	}
+
+	if (m_alignment_batch && (!pc || (!m_alignment_batch->is_applied() && m_alignment_batch->involves(pc)))) {
+		if (!m_alignment_batch->is_applied()) {
+			Logger::log(pc ? "Batch alignment cancelled, one of its point clouds was removed" : "Batch alignment cancelled", LoggingSeverity::Warning);
+		}
+		m_alignment_batch.reset();
+	}
+}
+
 bool PointcloudRenderer::is_initialized()
 {
 	return m_initialized;
@@ -234,6 +247,19 @@ bool PointcloudRenderer::init_renderpipeline()
 
 	std::vector<wgpu::VertexAttribute> vertex_attribs(2);
 
+#if POINTCLOUD_COMPACT_FORMAT
+	// position attribute (dequantized in the shader)
+	vertex_attribs[0].shaderLocation = 0;
+	vertex_attribs[0].format = wgpu::VertexFormat::Unorm16x4;
+	vertex_attribs[0].offset = offsetof(CompactPointAttributes, position);
+
+	// color attribute
+	vertex_attribs[1].shaderLocation = 1;
+	vertex_attribs[1].format = wgpu::VertexFormat::Unorm8x4;
+	vertex_attribs[1].offset = offsetof(CompactPointAttributes, color);
+
+	const uint64_t point_stride = sizeof(CompactPointAttributes);
+#else
 	// position attribute
 	vertex_attribs[0].shaderLocation = 0;
 	vertex_attribs[0].format = wgpu::VertexFormat::Float32x3;
@@ -244,11 +270,14 @@ bool PointcloudRenderer::init_renderpipeline()
 	vertex_attribs[1].format = wgpu::VertexFormat::Float32x3;
 	vertex_attribs[1].offset = offsetof(PointAttributes, color);
 
+	const uint64_t point_stride = sizeof(PointAttributes);
+#endif
+
 
 	wgpu::VertexBufferLayout vertexbuffer_layout;
 	vertexbuffer_layout.attributeCount = vertex_attribs.size();
 	vertexbuffer_layout.attributes = vertex_attribs.data();
-	vertexbuffer_layout.arrayStride = sizeof(PointAttributes);
+	vertexbuffer_layout.arrayStride = point_stride;
 	vertexbuffer_layout.stepMode = wgpu::VertexStepMode::Instance;
 
 
@@ -395,23 +424,26 @@ bool PointcloudRenderer::init_uniforms()
 	
 	
 
-	wgpu::BufferDescriptor opacity_buffer_desc{};
-	opacity_buffer_desc.size = 64 * POINTCLOUD_MAX_NUM;
-	opacity_buffer_desc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
-	opacity_buffer_desc.mappedAtCreation = false;
-	m_opacity_buffer = m_device.createBuffer(opacity_buffer_desc);
-	if (!m_opacity_buffer) {
-		std::cerr << "Could not create opacity buffer!" << std::endl;
+	wgpu::BufferDescriptor clouduniform_buffer_desc{};
+	clouduniform_buffer_desc.size = 64 * POINTCLOUD_MAX_NUM;
+	clouduniform_buffer_desc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
+	clouduniform_buffer_desc.mappedAtCreation = false;
+	m_clouduniform_buffer = m_device.createBuffer(clouduniform_buffer_desc);
+	if (!m_clouduniform_buffer) {
+		std::cerr << "Could not create cloud uniform buffer!" << std::endl;
 	}
 
 	glm::mat4 default_transform(1.f);
-	float default_opacity = 1.f;
+	Uniforms::CloudUniforms default_clouduniforms{};
+	default_clouduniforms.opacity = 1.f;
+	default_clouduniforms.quant_offset = glm::vec4(0.f);
+	default_clouduniforms.quant_scale = glm::vec4(1.f);
 	for (int i = 0; i < POINTCLOUD_MAX_NUM; i++) {
 		uint32_t ubo_transform_offset = sizeof(glm::mat4) * i;
 		m_queue.writeBuffer(m_transform_buffer, ubo_transform_offset, &default_transform, sizeof(glm::mat4));
 
-		uint32_t ubo_opacity_offset = (((sizeof(float) + 64 - 1) / 64) * 64) * i;
-		m_queue.writeBuffer(m_opacity_buffer, ubo_opacity_offset, &default_opacity, sizeof(float));
+		uint32_t ubo_cloud_offset = 64 * i;
+		m_queue.writeBuffer(m_clouduniform_buffer, ubo_cloud_offset, &default_clouduniforms, sizeof(Uniforms::CloudUniforms));
 	}
 
 	return true;
@@ -437,7 +469,7 @@ bool PointcloudRenderer::init_bindgroup()
 	bindings[1].size = sizeof(glm::mat4);
 
 	bindings[2].binding = 2;
-	bindings[2].buffer = m_opacity_buffer;
+	bindings[2].buffer = m_clouduniform_buffer;
 	bindings[2].offset = 0;
 	bindings[2].size = 64;
 
@@ -589,28 +621,36 @@ void PointcloudRenderer::write_points3D(std::filesystem::path path)
 
 
 	int id = 1;
+	std::vector<glm::vec3> transformed;
 	for (const auto& pc : m_pointclouds) {
 		if (!pc->m_loaded)
 			continue;
 
 
-		for (const auto& p : pc->points()) {
-			if (!std::isfinite(p.position.x) ||
-				!std::isfinite(p.position.y) ||
-				!std::isfinite(p.position.z)) {
+		// colmap expects x mirrored
+		const glm::mat4 transform = PointcloudKernels::axis_remap({ 0, 1, 2 }, { -1.f, 1.f, 1.f }) * *pc->get_transform_ptr();
+		const auto colors = pc->points().colors();
+
+		// an affine transform keeps non-finite points non-finite, so they can be skipped afterwards
+		transformed.resize(pc->points().size());
+		PointcloudKernels::transform_points(pc->points().positions().data(), transformed.size(), transform, transformed.data());
+
+		for (size_t i = 0; i < transformed.size(); i++) {
+			const glm::vec3& p = transformed[i];
+			if (!std::isfinite(p.x) ||
+				!std::isfinite(p.y) ||
+				!std::isfinite(p.z)) {
 				continue;
 			}
 
-			glm::vec4 transformed = *pc->get_transform_ptr() * glm::vec4(p.position.x, p.position.y, p.position.z, 1.f);
-
 			// id
 			ofs << id++ << " ";
 			// pos
-			ofs << -transformed.x << " " << transformed.y << " " << transformed.z << " ";
+			ofs << p.x << " " << p.y << " " << p.z << " ";
 			//ofs << p.position.x << " " << p.position.y << " " << p.position.z << " ";
 			//ofs << p.position.x / 1000.f << " " << p.position.y / 1000.f << " " << p.position.z / 1000.f << " ";
 			// color
-			ofs << static_cast<int>(p.color.r * 255) << " " << static_cast<int>(p.color.g * 255) << " " << static_cast<int>(p.color.b * 255) << " ";
+			ofs << static_cast<int>(colors[i].r) << " " << static_cast<int>(colors[i].g) << " " << static_cast<int>(colors[i].b) << " ";
 			// error
 			ofs << "0.0 ";
 			// no track list
@@ -638,6 +678,8 @@ float& PointcloudRenderer::frustum_dist()
 
 void PointcloudRenderer::on_frame()
 {
+	update_alignment();
+
 	wgpu::TextureView next_texture = m_rendertarget_texture_view;
 	if (!next_texture) {
 		return;
@@ -706,19 +748,21 @@ void PointcloudRenderer::on_frame()
 
 		
 		uint32_t ubo_transform_offset = sizeof(glm::mat4) * i;
-		//uint32_t ubo_opacity_offset = sizeof(float) * i;
-		uint32_t ubo_opacity_offset = (((sizeof(float) + 64 - 1) / 64) * 64) * i;
-		uint32_t ubos[] = { ubo_transform_offset , ubo_opacity_offset };
+		uint32_t ubo_cloud_offset = 64 * i;
+		uint32_t ubos[] = { ubo_transform_offset , ubo_cloud_offset };
 
 		// not using leveled model matrix for now (issues)
 		//m_queue.writeBuffer(m_transform_buffer, ubo_offset, &leveled_model, sizeof(glm::mat4));
 		m_queue.writeBuffer(m_transform_buffer, ubo_transform_offset, &model, sizeof(glm::mat4));
 
-		float point_opacity = 1.f;
+		Uniforms::CloudUniforms clouduniforms{};
+		clouduniforms.opacity = 1.f;
 		if (m_selected_pointcloud != nullptr && m_selected_pointcloud != pc) {
-			point_opacity = .25f;
+			clouduniforms.opacity = .25f;
 		}
-		m_queue.writeBuffer(m_opacity_buffer, ubo_opacity_offset, &point_opacity, sizeof(float));
+		clouduniforms.quant_offset = glm::vec4(pc->quant_offset(), 0.f);
+		clouduniforms.quant_scale = glm::vec4(pc->quant_scale(), 1.f);
+		m_queue.writeBuffer(m_clouduniform_buffer, ubo_cloud_offset, &clouduniforms, sizeof(Uniforms::CloudUniforms));
 
 		passEncoder.setPipeline(m_renderpipeline);
 		passEncoder.setVertexBuffer(0, pc->pointbuffer(), 0, pc->pointbuffer().getSize());
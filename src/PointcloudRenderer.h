@@ -3,13 +3,13 @@
 
 #include "Structs.h"
 #include "Pointcloud.h"
+#include "PointcloudRegistration.h"
+#include "RegistrationJob.h"
+#include "RegistrationBatch.h"
 #include "Helpers.h"
 
 #include <imgui.h>
 
-#include <pcl/point_types.h>
-#include <pcl/point_cloud.h>
-
 
 #pragma once
 
@@ -29,10 +29,28 @@ public:
 	void clear_pointclouds();
 	size_t get_num_pointclouds();
 	int get_num_vertices();
+	size_t get_point_memory_usage();
 	float get_futhest_point();
 	
-	std::shared_ptr<pcl::PointCloud<pcl::PointXYZRGB>> vector_to_pointcloud(const std::vector<PointAttributes>& vec, const glm::mat4 trans_mat);
-	void align_pointclouds(int max_iter, float max_corr_dist, Pointcloud* source, Pointcloud* target);
+	// starts aligning `source` onto `target` in the background, false if an alignment is already running.
+	// the result is applied to the source transform by on_frame once the job is done.
+	bool start_alignment(const RegistrationSettings& settings, Pointcloud* source, Pointcloud* target);
+	// same for a whole sequence, the first cloud stays in place
+	bool start_batch_alignment(const RegistrationSettings& settings, BatchAlignmentMode mode, const std::vector<Pointcloud*>& clouds, const std::vector<std::string>& names);
+	// cancels the running job or batch
+	void cancel_alignment();
+	bool is_aligning() const;
+
+	// the running alignment, nullptr if there is none
+	inline const RegistrationJob* alignment_job() const {
+		return m_alignment_job.get();
+	}
+
+	// the running or last finished batch, kept for its summary
+	inline const RegistrationBatch* alignment_batch() const {
+		return m_alignment_batch.get();
+	}
+
 	void reload_renderpipeline();
 
 	void write_points3D(std::filesystem::path path);
@@ -64,6 +82,10 @@ private:
 	void update_viewmatrix();
 	void handle_pointcloud_mouse_events();
 
+	void update_alignment();
+	// cancels and drops the running job or batch if it involves `pc` (any alignment for nullptr)
+	void drop_alignment(Pointcloud* pc);
+
 	ImVec2 project(glm::vec3 p) {
 		auto screen_pos = Helper::project_point(m_renderuniforms.projection_mat, m_renderuniforms.view_mat, p, (float)m_width, (float)m_height);
 		return { GUI_MENU_WIDTH + screen_pos.x, screen_pos.y };
@@ -82,6 +104,8 @@ private:
 private:
 	std::vector<Pointcloud*> m_pointclouds;
 	Pointcloud* m_selected_pointcloud = nullptr;
+	std::unique_ptr<RegistrationJob> m_alignment_job;
+	std::unique_ptr<RegistrationBatch> m_alignment_batch;
 
 	bool m_initialized = false;
 	int m_width;
@@ -97,7 +121,7 @@ private:
 	Uniforms::RenderUniforms m_renderuniforms;
 	wgpu::Buffer m_renderuniform_buffer;
 	wgpu::Buffer m_transform_buffer;
-	wgpu::Buffer m_opacity_buffer;
+	wgpu::Buffer m_clouduniform_buffer;
 
 	// bind group
 	wgpu::BindGroup m_bindgroup = nullptr;
@@ -0,0 +1,220 @@
+#include "RegistrationBatch.h"
+
+#include "RegistrationJob.h"
+#include "PointcloudFilters.h"
+#include "ThreadPool.h"
+#include "Helpers.h"
+
+#include <algorithm>
+#include <format>
+
+namespace {
+	// pose of a cloud whose pair failed: it keeps its place relative to the predecessor
+	inline glm::mat4 follow_predecessor(const glm::mat4& predecessor_new, const glm::mat4& predecessor_old, const glm::mat4& pose)
+	{
+		return predecessor_new * glm::inverse(predecessor_old) * pose;
+	}
+}
+
+RegistrationBatch::RegistrationBatch(const std::vector<Pointcloud*>& clouds, const std::vector<std::string>& names, const RegistrationSettings& settings, BatchAlignmentMode mode)
+	: m_clouds(clouds), m_mode(mode)
+{
+	m_start = std::chrono::steady_clock::now();
+
+	// snapshots and poses are taken here on the owner's thread, the workers get copies only
+	std::vector<std::shared_ptr<RegistrationPyramid>> pyramids;
+	for (Pointcloud* pc : m_clouds) {
+		pyramids.push_back(pc->registration_pyramid());
+		m_initial_poses.push_back(*pc->get_transform_ptr());
+	}
+
+	for (size_t i = 1; i < m_clouds.size(); i++) {
+		auto pair = std::make_unique<RegistrationPair>();
+		pair->name = mode == BatchAlignmentMode::Model
+			? std::format("{} -> model", names[i])
+			: std::format("{} -> {}", names[i], names[i - 1]);
+		m_pairs.push_back(std::move(pair));
+	}
+
+	if (mode == BatchAlignmentMode::Predecessor) {
+		// the pairs only read their own two snapshots, so they are independent
+		for (size_t i = 1; i < m_clouds.size(); i++) {
+			m_tasks.push_back(ThreadPool::global().submit([source = pyramids[i], target = pyramids[i - 1], source_pose = m_initial_poses[i], target_pose = m_initial_poses[i - 1],
+				settings, pair = m_pairs[i - 1].get()]() {
+				pair->started = true;
+				auto start = std::chrono::steady_clock::now();
+				pair->result = RegistrationJob::run(source, target, source_pose, target_pose, settings, pair->progress);
+				pair->time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				pair->finished = true;
+			}));
+		}
+	}
+	else if (!m_pairs.empty()) {
+		std::vector<RegistrationPair*> pairs;
+		for (auto& pair : m_pairs) {
+			pairs.push_back(pair.get());
+		}
+		m_tasks.push_back(ThreadPool::global().submit([pyramids, poses = m_initial_poses, settings, pairs]() {
+			run_model(pyramids, poses, settings, pairs);
+		}));
+	}
+}
+
+RegistrationBatch::~RegistrationBatch()
+{
+	cancel();
+	for (auto& task : m_tasks) {
+		if (task.valid()) {
+			task.wait();
+		}
+	}
+}
+
+void RegistrationBatch::cancel()
+{
+	if (m_applied)
+		return;
+
+	m_cancelled = true;
+	for (auto& pair : m_pairs) {
+		pair->progress.cancelled = true;
+	}
+}
+
+bool RegistrationBatch::done() const
+{
+	for (const auto& task : m_tasks) {
+		if (task.valid() && task.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return false;
+	}
+	return true;
+}
+
+void RegistrationBatch::apply()
+{
+	if (m_applied)
+		return;
+
+	for (auto& task : m_tasks) {
+		task.get();
+	}
+	m_tasks.clear();
+	m_total_ms = elapsed_ms();
+	m_applied = true;
+
+	// predecessor results place a cloud on its predecessor as it was, so the corrections are chained in
+	// order. model results are already in the world.
+	std::vector<glm::mat4> poses = m_initial_poses;
+	for (size_t i = 1; i < m_clouds.size(); i++) {
+		const RegistrationPair& pair = *m_pairs[i - 1];
+		if (!pair.result.converged) {
+			poses[i] = follow_predecessor(poses[i - 1], m_initial_poses[i - 1], m_initial_poses[i]);
+		}
+		else if (m_mode == BatchAlignmentMode::Predecessor) {
+			poses[i] = follow_predecessor(poses[i - 1], m_initial_poses[i - 1], pair.result.source_pose);
+		}
+		else {
+			poses[i] = pair.result.source_pose;
+		}
+	}
+
+	size_t converged = 0;
+	for (const auto& pair : m_pairs) {
+		converged += pair->result.converged;
+	}
+
+	Logger::log(std::format("Batch alignment ({}) of {} clouds {} in {:.2f} ms, {}/{} pairs converged",
+		mode_name(m_mode), m_clouds.size(), m_cancelled ? "cancelled" : "finished", m_total_ms, converged, m_pairs.size()));
+	Logger::log(std::format("{:<40} {:>10} {:>10} {:>12} {:>10}", "Pair", "Status", "Iterations", "Fitness", "Time [ms]"));
+	for (const auto& pair : m_pairs) {
+		Logger::log(std::format("{:<40} {:>10} {:>10} {:>12.6f} {:>10.2f}", pair->name, pair_status(*pair), pair->result.iterations, pair->result.fitness, pair->time_ms));
+	}
+
+	if (m_cancelled)
+		return;
+
+	// the corrections go on top of the current poses, the clouds may have been moved while the batch ran
+	for (size_t i = 1; i < m_clouds.size(); i++) {
+		m_clouds[i]->set_transform(poses[i] * glm::inverse(m_initial_poses[i]) * *m_clouds[i]->get_transform_ptr());
+	}
+}
+
+bool RegistrationBatch::involves(const Pointcloud* pc) const
+{
+	return std::find(m_clouds.begin(), m_clouds.end(), pc) != m_clouds.end();
+}
+
+size_t RegistrationBatch::finished_pairs() const
+{
+	size_t count = 0;
+	for (const auto& pair : m_pairs) {
+		count += pair->finished;
+	}
+	return count;
+}
+
+double RegistrationBatch::elapsed_ms() const
+{
+	if (m_applied)
+		return m_total_ms;
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+const char* RegistrationBatch::pair_status(const RegistrationPair& pair)
+{
+	if (!pair.finished)
+		return pair.started ? "running" : "queued";
+	if (pair.result.cancelled)
+		return "cancelled";
+	return pair.result.converged ? "converged" : "failed";
+}
+
+const char* RegistrationBatch::mode_name(BatchAlignmentMode mode)
+{
+	switch (mode) {
+		case BatchAlignmentMode::Predecessor: return "Predecessor";
+		case BatchAlignmentMode::Model: return "Merged Model";
+		default: return "";
+	}
+}
+
+void RegistrationBatch::run_model(std::vector<std::shared_ptr<RegistrationPyramid>> clouds, std::vector<glm::mat4> poses, RegistrationSettings settings, std::vector<RegistrationPair*> pairs)
+{
+	const std::vector<glm::mat4> initial_poses = poses;
+
+	// the world space model only gets the cells of each new cloud added, its points are read out per step
+	VoxelMap model_map(POINTCLOUD_ICP_MODEL_VOXEL_SIZE);
+	model_map.insert(clouds[0]->points(), poses[0]);
+	PointBuffer model;
+
+	for (size_t i = 1; i < clouds.size(); i++) {
+		RegistrationPair& pair = *pairs[i - 1];
+		pair.started = true;
+		auto start = std::chrono::steady_clock::now();
+
+		// starts where the correction of the predecessor puts the cloud, which is also where a failed
+		// pair stays
+		poses[i] = follow_predecessor(poses[i - 1], initial_poses[i - 1], initial_poses[i]);
+
+		if (pair.progress.cancelled) {
+			pair.result.cancelled = true;
+		}
+		else {
+			// every step aligns against a fresh snapshot of the model. It already is a grid at the model
+			// voxel size, so only the coarser levels are built on first use.
+			model_map.extract(model);
+			auto target = std::make_shared<RegistrationPyramid>(model);
+			pair.result = RegistrationJob::run(clouds[i], target, poses[i], glm::mat4(1.f), settings, pair.progress, POINTCLOUD_ICP_MODEL_VOXEL_SIZE);
+			if (pair.result.converged) {
+				poses[i] = pair.result.source_pose;
+			}
+
+			if (!pair.result.cancelled && i + 1 < clouds.size()) {
+				model_map.insert(clouds[i]->points(), poses[i]);
+			}
+		}
+
+		pair.time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		pair.finished = true;
+	}
+}
@@ -0,0 +1,91 @@
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+#include "Pointcloud.h"
+#include "PointcloudRegistration.h"
+
+#pragma once
+
+enum class BatchAlignmentMode {
+	Predecessor, // every cloud onto the one before it, the pairs run in parallel
+	Model // every cloud onto the merged model of all before it, in order
+};
+
+// one row of the batch summary. The progress is live, result and time are only valid once finished.
+struct RegistrationPair {
+	std::string name;
+	RegistrationProgress progress;
+	std::atomic<bool> started = false;
+	std::atomic<bool> finished = false;
+	RegistrationResult result;
+	double time_ms = 0.;
+};
+
+// Aligns a whole sequence of clouds in the background, the first one stays in place. Like
+// RegistrationJob it only works on the registration snapshots and the poses taken at submission.
+// Predecessor mode submits every pair to the global thread pool at once, each aligning a cloud onto its
+// predecessor as it was. apply() then chains the relative corrections in order, so cloud i follows
+// whatever happened to cloud i - 1. Model mode runs on one pool task: every cloud is aligned onto the
+// world space model merged from the already aligned ones, a POINTCLOUD_ICP_MODEL_VOXEL_SIZE VoxelMap
+// that every aligned cloud is added to. A failed pair keeps its cloud's pose relative to the predecessor.
+class RegistrationBatch {
+public:
+	RegistrationBatch(const std::vector<Pointcloud*>& clouds, const std::vector<std::string>& names, const RegistrationSettings& settings, BatchAlignmentMode mode);
+	// cancels all pairs and waits for the workers
+	~RegistrationBatch();
+
+	RegistrationBatch(const RegistrationBatch&) = delete;
+	RegistrationBatch& operator=(const RegistrationBatch&) = delete;
+
+	void cancel();
+	bool done() const;
+
+	// applies the pose corrections to all clouds, once the batch is done
+	void apply();
+
+	inline bool is_applied() const {
+		return m_applied;
+	}
+
+	bool involves(const Pointcloud* pc) const;
+
+	// pair i aligns cloud i + 1
+	inline const std::vector<std::unique_ptr<RegistrationPair>>& pairs() const {
+		return m_pairs;
+	}
+
+	size_t finished_pairs() const;
+
+	inline BatchAlignmentMode mode() const {
+		return m_mode;
+	}
+
+	inline bool is_cancelled() const {
+		return m_cancelled;
+	}
+
+	// wall time, stops once applied
+	double elapsed_ms() const;
+
+	static const char* pair_status(const RegistrationPair& pair);
+	static const char* mode_name(BatchAlignmentMode mode);
+
+private:
+	static void run_model(std::vector<std::shared_ptr<RegistrationPyramid>> clouds, std::vector<glm::mat4> poses, RegistrationSettings settings, std::vector<RegistrationPair*> pairs);
+
+	std::vector<Pointcloud*> m_clouds;
+	std::vector<glm::mat4> m_initial_poses;
+	std::vector<std::unique_ptr<RegistrationPair>> m_pairs;
+	std::vector<std::future<void>> m_tasks;
+	BatchAlignmentMode m_mode;
+	bool m_cancelled = false;
+	bool m_applied = false;
+	std::chrono::steady_clock::time_point m_start;
+	double m_total_ms = 0.;
+};
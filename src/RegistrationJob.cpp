@@ -0,0 +1,97 @@
+#include "RegistrationJob.h"
+
+#include "ThreadPool.h"
+#include "Helpers.h"
+
+#include <cmath>
+#include <format>
+#include <string>
+
+RegistrationJob::RegistrationJob(Pointcloud* source, Pointcloud* target, const RegistrationSettings& settings)
+	: m_source(source), m_target(target), m_initial_pose(*source->get_transform_ptr()), m_settings(settings)
+{
+	m_start = std::chrono::steady_clock::now();
+	m_progress.level = settings.coarse_to_fine ? 0 : POINTCLOUD_ICP_PYRAMID_LEVELS;
+
+	// the snapshots and poses are taken here on the owner's thread, the worker gets copies only
+	m_result = ThreadPool::global().submit([source_pyramid = source->registration_pyramid(), target_pyramid = target->registration_pyramid(),
+		source_pose = m_initial_pose, target_pose = *target->get_transform_ptr(), settings, progress = &m_progress]() {
+		return run(source_pyramid, target_pyramid, source_pose, target_pose, settings, *progress);
+	});
+}
+
+RegistrationJob::~RegistrationJob()
+{
+	if (m_result.valid()) {
+		cancel();
+		m_result.wait();
+	}
+}
+
+bool RegistrationJob::done() const
+{
+	return !m_result.valid() || m_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+RegistrationResult RegistrationJob::take_result()
+{
+	return m_result.get();
+}
+
+double RegistrationJob::elapsed_ms() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+RegistrationResult RegistrationJob::run(std::shared_ptr<RegistrationPyramid> source, std::shared_ptr<RegistrationPyramid> target, glm::mat4 source_pose, glm::mat4 target_pose, RegistrationSettings settings, RegistrationProgress& progress, float target_voxel_size)
+{
+	// coarse to fine: every level starts from the pose of the previous one and halves the correspondence
+	// distance, so the coarse grids catch the large offset and the full cloud only refines
+	const int first_level = settings.coarse_to_fine ? 0 : POINTCLOUD_ICP_PYRAMID_LEVELS;
+	RegistrationSettings level_settings = settings;
+	glm::mat4 pose = source_pose;
+	RegistrationResult result;
+	bool converged = false;
+
+	for (int level = first_level; level <= POINTCLOUD_ICP_PYRAMID_LEVELS && !progress.cancelled; level++) {
+		// such a grid of the target would be about as large as its full resolution and only cost a rebuild
+		const float voxel_size = RegistrationPyramid::voxel_size(level);
+		if (voxel_size > 0.f && voxel_size <= target_voxel_size)
+			continue;
+
+		auto level_start = std::chrono::steady_clock::now();
+		progress.level = level;
+
+		level_settings.max_correspondence_distance = std::ldexp(settings.max_correspondence_distance, first_level - level);
+		RegistrationCloud source_cloud = source->cloud(level, settings.method, false, pose);
+		RegistrationCloud target_cloud = target->cloud(level, settings.method, true, target_pose);
+
+		RegistrationResult level_result = PointcloudRegistration::align(source_cloud, target_cloud, level_settings, &progress);
+
+		auto level_elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - level_start).count();
+		std::string level_name = voxel_size > 0.f ? std::format("{:.1f} cm", voxel_size * 10.f) : "full";
+		Logger::log(std::format("ICP level {} ({}, {} points): {} iterations in {:.2f} ms, fitness {}", level, level_name, source_cloud.positions.size(), level_result.iterations, level_elapsed, level_result.fitness));
+
+		// a level without enough overlap keeps the pose, the finer ones may still lock on. The result is
+		// the one of the finest level that converged, a failing fine level does not throw it away.
+		if (level_result.converged) {
+			pose = level_result.source_pose;
+			converged = true;
+			result = level_result;
+		}
+		else if (!converged) {
+			result = level_result;
+		}
+	}
+
+	if (converged) {
+		result.converged = true;
+		result.source_pose = pose;
+	}
+	result.iterations = progress.iterations;
+	result.cancelled = progress.cancelled;
+	if (result.cancelled) {
+		result.converged = false;
+	}
+	return result;
+}
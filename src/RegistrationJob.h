@@ -0,0 +1,76 @@
+#include <chrono>
+#include <future>
+#include <memory>
+
+#include <glm/glm.hpp>
+
+#include "Structs.h"
+#include "Pointcloud.h"
+#include "PointcloudRegistration.h"
+
+#pragma once
+
+// One alignment of a source cloud onto a target on the global thread pool. The worker only sees the
+// registration snapshots and the poses taken at submission, never the clouds, so they can be drawn and
+// edited meanwhile. Runs the voxel pyramid coarse to fine (or only the full resolution), every level
+// starting from the pose of the previous one with half the correspondence distance. Progress and
+// cancellation go through RegistrationProgress, the result is picked up once done() and applied by
+// the owner on its own thread.
+class RegistrationJob {
+public:
+	RegistrationJob(Pointcloud* source, Pointcloud* target, const RegistrationSettings& settings);
+	// cancels the run and waits for the worker
+	~RegistrationJob();
+
+	RegistrationJob(const RegistrationJob&) = delete;
+	RegistrationJob& operator=(const RegistrationJob&) = delete;
+
+	inline void cancel() {
+		m_progress.cancelled = true;
+	}
+
+	bool done() const;
+
+	// blocks until the worker is done, can only be taken once
+	RegistrationResult take_result();
+
+	inline Pointcloud* source() const {
+		return m_source;
+	}
+
+	inline Pointcloud* target() const {
+		return m_target;
+	}
+
+	inline const glm::mat4& initial_pose() const {
+		return m_initial_pose;
+	}
+
+	inline const RegistrationSettings& settings() const {
+		return m_settings;
+	}
+
+	inline const RegistrationProgress& progress() const {
+		return m_progress;
+	}
+
+	inline bool is_cancelled() const {
+		return m_progress.cancelled;
+	}
+
+	double elapsed_ms() const;
+
+	// the level schedule on the calling thread. The result is the one of the finest level that converged
+	// (converged if any did), the returned iterations are summed over all levels. A target that already is
+	// a voxel grid of `target_voxel_size` skips the grid levels that are not coarser than it.
+	static RegistrationResult run(std::shared_ptr<RegistrationPyramid> source, std::shared_ptr<RegistrationPyramid> target, glm::mat4 source_pose, glm::mat4 target_pose, RegistrationSettings settings, RegistrationProgress& progress, float target_voxel_size = 0.f);
+
+private:
+	Pointcloud* m_source;
+	Pointcloud* m_target;
+	glm::mat4 m_initial_pose;
+	RegistrationSettings m_settings;
+	RegistrationProgress m_progress;
+	std::chrono::steady_clock::time_point m_start;
+	std::future<RegistrationResult> m_result;
+};
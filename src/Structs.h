@@ -33,8 +33,68 @@
 
 #define VECTOR_UP glm::vec3(0.f, -1.f, 0.f)
 
-#define POINTCLOUD_COLOR_RESOLUTION K4A_COLOR_RESOLUTION_1080P
-#define POINTCLOUD_DEPTH_MODE K4A_DEPTH_MODE_WFOV_2X2BINNED
+#define POINTCLOUD_TILE_ROWS 32
+#define POINTCLOUD_ESTIMATE_NORMALS true
+#define POINTCLOUD_NORMAL_MAX_DEPTH_JUMP .05f // relative to the center depth
+#define POINTCLOUD_REJECT_FLYING_PIXELS true
+#define POINTCLOUD_FLYING_PIXEL_BASE_MM 20
+#define POINTCLOUD_FLYING_PIXEL_JUMP_Q16 3277 // ~5% of the depth, 16 bit fixed point
+#define POINTCLOUD_COMPONENT_BASE_MM 10
+#define POINTCLOUD_COMPONENT_JUMP_Q16 1966 // ~3% of the depth, 16 bit fixed point
+#define POINTCLOUD_COMPONENT_SEED_RADIUS 8 // pixels searched around the seed for valid depth
+#define POINTCLOUD_CLIP_MIN_DISTANCE .25f // meters
+#define POINTCLOUD_CLIP_MAX_DISTANCE 1.5f
+#define POINTCLOUD_COLOR_SPACE_STRIDE 2 // 1, 2 or 4
+#define POINTCLOUD_TRIANGULATE false
+#define POINTCLOUD_MESH_EDGE_BASE_MM 20
+#define POINTCLOUD_MESH_EDGE_JUMP_Q16 3277 // ~5% of the depth, 16 bit fixed point
+#define POINTCLOUD_DEFAULT_VOXEL_SIZE 0.f // 0 = keep every point
+#define POINTCLOUD_VOXEL_SHARDS 64
+#define POINTCLOUD_VOXEL_CHUNK_SIZE 16384
+#define POINTCLOUD_KDTREE_LEAF_SIZE 16
+#define POINTCLOUD_KDTREE_PARALLEL_BUILD_SIZE 32768
+#define POINTCLOUD_OUTLIER_REMOVAL true // applied after every capture
+#define POINTCLOUD_OUTLIER_NEIGHBORS 16
+#define POINTCLOUD_OUTLIER_STDDEV_MUL 2.f
+#define POINTCLOUD_OUTLIER_CHUNK_SIZE 4096
+#define POINTCLOUD_PLANE_DISTANCE_THRESHOLD .01f // meters
+#define POINTCLOUD_PLANE_HYPOTHESES 256
+#define POINTCLOUD_PLANE_SAMPLE_COUNT 8192
+#define POINTCLOUD_PLANE_MIN_INLIER_FRACTION .1f // of the subsample
+#define POINTCLOUD_TRANSFORM_CHUNK_SIZE 65536
+#define POINTCLOUD_ICP_CHUNK_SIZE 4096
+#define POINTCLOUD_ICP_PYRAMID_LEVELS 3 // voxel grid levels before the full resolution
+#define POINTCLOUD_ICP_PYRAMID_VOXEL_SIZE .4f // coarsest level (4 cm), halved per level
+#define POINTCLOUD_ICP_MODEL_VOXEL_SIZE .1f // merged model of the batch alignment (1 cm)
+#define POINTCLOUD_SURFACE_NEIGHBORS 20 // neighborhood of the estimated normals / GICP covariances
+#define POINTCLOUD_GICP_EPSILON 1e-3f // variance along the normal of a GICP plane covariance
+#define POINTCLOUD_ICP_TRANSFORMATION_EPSILON 1e-8 // squared translation and 1 - cos(rotation angle) of one step
+#define POINTCLOUD_ICP_FITNESS_EPSILON 1e-6 // relative change of the mean squared error
+#define POINTCLOUD_PIPELINE_MAX_WORKERS 4 // clouds built at once, each worker keeps its own full-frame scratch buffers
+
+// upload 12 byte quantized points (unorm16 position, rgba8 color) instead of 24 byte float points
+#define POINTCLOUD_COMPACT_FORMAT 1
+#define POINTCLOUD_COMPACT_FILE_MAGIC 0x5450434B // "KCPT"
+#define POINTCLOUD_COMPACT_FILE_VERSION 1
+#define POINTCLOUD_COMPACT_FILE_EXTENSION ".kcpoints"
+#define POINTCLOUD_COMPACT_MIN_EXTENT 1e-6f // quantization box of a flat axis or a single point
+
+#define IMAGE_POOL_ALIGNMENT 64
+#define IMAGE_POOL_MIN_BLOCK_SIZE (256 * 1024)
+#define IMAGE_POOL_GRANULARITY (64 * 1024)
+#define IMAGE_POOL_MAX_FREE_BLOCKS 8
+
+#define CAPTURE_TEMPORAL_DEFAULT_FRAMES 1 // 1 = single frame capture
+#define CAPTURE_TEMPORAL_MAX_FRAMES 60
+#define CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES 15 // the median keeps every frame, 15 WFOV frames are 30 MB
+#define CAPTURE_TEMPORAL_MIN_VALID_FRACTION .5f
+#define CAPTURE_TEMPORAL_MAX_STDDEV_MM 8.f
+#define CAPTURE_TEMPORAL_MAX_STDDEV_RELATIVE .01f // added on top, relative to the mean depth
+
+// sensor mode the camera starts with, can be changed at runtime
+#define CAMERA_DEFAULT_DEPTH_MODE K4A_DEPTH_MODE_WFOV_2X2BINNED
+#define CAMERA_DEFAULT_COLOR_RESOLUTION K4A_COLOR_RESOLUTION_1080P
+#define CAMERA_DEFAULT_FPS K4A_FRAMES_PER_SECOND_30
 
 #define CAMERA_IMU_CALIBRATION_SAMPLE_COUNT 100
 #define CAMERA_IMU_CALIBRATION_SAMPLE_DELAY_MS 10
@@ -51,10 +111,19 @@ enum class AppState {
 	Pointcloud
 };
 
+enum class DepthAccumulationMode {
+	Mean,
+	Median
+};
+
 struct BgraPixel {
 	uint8_t b, g, r, a;
 };
 
+struct RgbaPixel {
+	uint8_t r, g, b, a;
+};
+
 struct Depth16Pixel {
 	uint16_t distance;
 };
@@ -77,6 +146,15 @@ namespace Uniforms {
 		float pad[3];
 	};
 	static_assert(sizeof(RenderUniforms) % 16 == 0);
+
+	// per pointcloud, bound with a dynamic offset in 64 byte slots
+	struct CloudUniforms {
+		float opacity;
+		float pad[3];
+		glm::vec4 quant_offset;
+		glm::vec4 quant_scale;
+	};
+	static_assert(sizeof(CloudUniforms) <= 64);
 }
 
 struct PointAttributes {
@@ -84,6 +162,46 @@ struct PointAttributes {
 	glm::vec3 color;
 };
 
+struct CompactPointAttributes {
+	uint16_t position[4]; // unorm16 relative to the cloud's bounding box, w unused
+	uint8_t color[4]; // rgba8
+};
+static_assert(sizeof(CompactPointAttributes) == 12);
+
+enum class GenerationSpace {
+	Depth, // color sampled at the depth resolution
+	Color // depth transformed into the color camera, every stride-th color pixel
+};
+
+enum class ComponentSelection {
+	Off,
+	Largest,
+	Seed // the component under a clicked pixel
+};
+
+enum class PlaneSegmentationMode {
+	Off,
+	Detect, // only fit and store the plane
+	RemovePlane,
+	KeepAbove // drop the plane and everything behind it, seen from the camera
+};
+
+// per-session clipping of the depth image before unprojection. distances are in meters in the
+// depth camera frame (x right, y down, z forward), the roi is in depth pixels (max exclusive).
+struct DepthClipSettings {
+	bool enabled = false;
+	float min_distance = POINTCLOUD_CLIP_MIN_DISTANCE;
+	float max_distance = POINTCLOUD_CLIP_MAX_DISTANCE;
+	bool use_roi = false;
+	glm::ivec2 roi_min = glm::ivec2(0);
+	glm::ivec2 roi_max = glm::ivec2(0);
+	bool use_crop_box = false;
+	glm::vec3 crop_min = glm::vec3(-.5f, -.5f, 0.f);
+	glm::vec3 crop_max = glm::vec3(.5f, .5f, POINTCLOUD_CLIP_MAX_DISTANCE);
+
+	bool operator==(const DepthClipSettings& other) const = default;
+};
+
 struct CameraState {
 	glm::vec2 angles = { glm::radians(0.f), glm::radians(180.f)};
 	float zoom = -5.f;
@@ -0,0 +1,104 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	m_workers.reserve(thread_count);
+	for (size_t i = 0; i < thread_count; i++) {
+		m_workers.emplace_back([this]() { worker_loop(); });
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::global()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1 || m_workers.empty()) {
+		for (size_t i = 0; i < count; i++) {
+			fn(i);
+		}
+		return;
+	}
+
+	struct SharedState {
+		std::atomic<size_t> next = 0;
+		std::atomic<size_t> done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto state = std::make_shared<SharedState>();
+
+	// helpers may start after all items are taken, they then return immediately.
+	// only the item counter is waited on, so queued helpers never block the caller.
+	auto run = [state, &fn, count]() {
+		size_t i;
+		while ((i = state->next.fetch_add(1)) < count) {
+			fn(i);
+			if (state->done.fetch_add(1) + 1 == count) {
+				std::lock_guard<std::mutex> lock(state->mutex);
+				state->finished.notify_all();
+			}
+		}
+	};
+
+	const size_t helpers = std::min(count, m_workers.size() + 1) - 1;
+	for (size_t h = 0; h < helpers; h++) {
+		enqueue(run);
+	}
+
+	run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&]() { return state->done.load() == count; });
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push(std::move(task));
+	}
+	m_condition.notify_one();
+}
+
+void ThreadPool::worker_loop()
+{
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_stopping && m_tasks.empty())
+				return;
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop();
+		}
+		task();
+	}
+}
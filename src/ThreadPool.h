@@ -0,0 +1,50 @@
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+class ThreadPool {
+public:
+	explicit ThreadPool(size_t thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// shared pool sized to the number of hardware threads
+	static ThreadPool& global();
+
+	// runs fn(i) for i in [0, count) and blocks until all calls returned.
+	// the calling thread takes part, so it is safe to call from inside a pool task.
+	void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+	template<typename F>
+	auto submit(F&& fn) -> std::future<decltype(fn())> {
+		using R = decltype(fn());
+		auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+		std::future<R> future = task->get_future();
+		enqueue([task]() { (*task)(); });
+		return future;
+	}
+
+	inline size_t thread_count() const {
+		return m_workers.size();
+	}
+
+private:
+	void enqueue(std::function<void()> task);
+	void worker_loop();
+
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping = false;
+};
@@ -0,0 +1,180 @@
+#include "XYTableCache.h"
+
+#include "Helpers.h"
+
+#include <fstream>
+#include <format>
+#include <cmath>
+#include <cstring>
+
+// file header of cached tables, followed by width * height k4a_float2_t
+struct XYTableFileHeader {
+	char magic[4] = { 'K', 'C', 'X', 'Y' };
+	uint32_t version = 1;
+	uint64_t hash = 0;
+	int32_t width = 0;
+	int32_t height = 0;
+};
+
+std::shared_ptr<const XYTable> XYTableCache::get(const k4a::calibration& calibration, k4a_calibration_type_t camera, int stride)
+{
+	const uint64_t hash = calibration_hash(calibration, camera, stride);
+	const k4a_calibration_camera_t& camera_calib = camera_calibration(calibration, camera);
+	const int width = table_size(camera_calib.resolution_width, stride);
+	const int height = table_size(camera_calib.resolution_height, stride);
+
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	auto it = s_tables.find(hash);
+	if (it != s_tables.end()) {
+		s_hits++;
+		return it->second;
+	}
+
+	std::shared_ptr<XYTable> table = nullptr;
+	if (s_use_disk_cache) {
+		table = read_from_disk(hash, width, height);
+	}
+
+	if (table) {
+		s_disk_hits++;
+	}
+	else {
+		s_misses++;
+		table = create_table(calibration, camera, stride);
+		if (s_use_disk_cache) {
+			write_to_disk(hash, width, height, *table);
+		}
+	}
+
+	s_tables[hash] = table;
+	return table;
+}
+
+uint64_t XYTableCache::calibration_hash(const k4a::calibration& calibration, k4a_calibration_type_t camera, int stride)
+{
+	// everything convert_2d_to_3d depends on for the camera
+	const auto& calib = camera_calibration(calibration, camera);
+	uint64_t hash = Helper::hash_bytes(&calib.intrinsics.type, sizeof(calib.intrinsics.type));
+	hash = Helper::hash_bytes(&calib.intrinsics.parameter_count, sizeof(calib.intrinsics.parameter_count), hash);
+	hash = Helper::hash_bytes(calib.intrinsics.parameters.v, sizeof(calib.intrinsics.parameters.v), hash);
+	hash = Helper::hash_bytes(&calib.resolution_width, sizeof(calib.resolution_width), hash);
+	hash = Helper::hash_bytes(&calib.resolution_height, sizeof(calib.resolution_height), hash);
+	hash = Helper::hash_bytes(&calib.metric_radius, sizeof(calib.metric_radius), hash);
+
+	// full depth tables keep their hash, so existing cache files stay valid
+	if (camera != K4A_CALIBRATION_TYPE_DEPTH || stride != 1) {
+		hash = Helper::hash_bytes(&camera, sizeof(camera), hash);
+		hash = Helper::hash_bytes(&stride, sizeof(stride), hash);
+	}
+
+	return hash;
+}
+
+const k4a_calibration_camera_t& XYTableCache::camera_calibration(const k4a::calibration& calibration, k4a_calibration_type_t camera)
+{
+	return camera == K4A_CALIBRATION_TYPE_COLOR ? calibration.color_camera_calibration : calibration.depth_camera_calibration;
+}
+
+void XYTableCache::clear()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	s_tables.clear();
+}
+
+std::shared_ptr<XYTable> XYTableCache::create_table(const k4a::calibration& calibration, k4a_calibration_type_t camera, int stride)
+{
+	const k4a_calibration_camera_t& camera_calib = camera_calibration(calibration, camera);
+	const int width = table_size(camera_calib.resolution_width, stride);
+	const int height = table_size(camera_calib.resolution_height, stride);
+
+	auto table = std::make_shared<XYTable>(static_cast<size_t>(width) * height);
+	k4a_float2_t* table_data = table->data();
+
+	k4a_float2_t p;
+	k4a_float3_t ray;
+
+	for (int y = 0, idx = 0; y < height; y++) {
+		p.xy.y = (float)(y * stride);
+		for (int x = 0; x < width; x++, idx++) {
+			p.xy.x = (float)(x * stride);
+
+			if (calibration.convert_2d_to_3d(p, 1.f, camera, camera, &ray)) {
+				table_data[idx].xy.x = ray.xyz.x;
+				table_data[idx].xy.y = ray.xyz.y;
+			}
+			else {
+				table_data[idx].xy.x = nanf("");
+				table_data[idx].xy.y = nanf("");
+			}
+		}
+	}
+
+	Logger::log(std::format("Created xy table ({}x{})", width, height));
+
+	return table;
+}
+
+std::filesystem::path XYTableCache::cache_file_path(uint64_t hash)
+{
+	return std::format("{}/{:016x}.xytable", XYTABLE_CACHE_DIR, hash);
+}
+
+std::shared_ptr<XYTable> XYTableCache::read_from_disk(uint64_t hash, int width, int height)
+{
+	std::ifstream ifs(cache_file_path(hash), std::ios::binary);
+	if (!ifs) {
+		return nullptr;
+	}
+
+	XYTableFileHeader expected;
+	expected.hash = hash;
+	expected.width = width;
+	expected.height = height;
+
+	XYTableFileHeader header;
+	Helper::read_binary(ifs, header);
+	if (!ifs ||
+		std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+		header.version != expected.version ||
+		header.hash != hash ||
+		header.width != width ||
+		header.height != height) {
+		Logger::log("Ignoring invalid xy table cache file.", LoggingSeverity::Warning);
+		return nullptr;
+	}
+
+	auto table = std::make_shared<XYTable>(static_cast<size_t>(width) * height);
+	ifs.read(reinterpret_cast<char*>(table->data()), table->size() * sizeof(k4a_float2_t));
+	if (!ifs) {
+		Logger::log("Ignoring truncated xy table cache file.", LoggingSeverity::Warning);
+		return nullptr;
+	}
+
+	return table;
+}
+
+void XYTableCache::write_to_disk(uint64_t hash, int width, int height, const XYTable& table)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(XYTABLE_CACHE_DIR, ec);
+	if (ec) {
+		Logger::log(std::format("Could not create xy table cache directory: {}", ec.message()), LoggingSeverity::Warning);
+		return;
+	}
+
+	std::ofstream ofs(cache_file_path(hash), std::ios::binary);
+	if (!ofs) {
+		Logger::log("Could not write xy table cache file.", LoggingSeverity::Warning);
+		return;
+	}
+
+	XYTableFileHeader header;
+	header.hash = hash;
+	header.width = width;
+	header.height = height;
+	Helper::write_binary(ofs, header);
+	ofs.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(k4a_float2_t));
+
+	ofs.close();
+}
@@ -0,0 +1,56 @@
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <k4a/k4a.hpp>
+
+#pragma once
+
+using XYTable = std::vector<k4a_float2_t>;
+
+// process-wide cache of unprojection tables (pixel -> ray at z = 1) for the depth or color camera.
+// tables only depend on the intrinsics and resolution of that camera, so they are keyed
+// by a hash of those and optionally persisted to XYTABLE_CACHE_DIR.
+// a stride > 1 gives the table of every stride-th pixel in both directions.
+class XYTableCache {
+public:
+	static std::shared_ptr<const XYTable> get(const k4a::calibration& calibration, k4a_calibration_type_t camera = K4A_CALIBRATION_TYPE_DEPTH, int stride = 1);
+	static uint64_t calibration_hash(const k4a::calibration& calibration, k4a_calibration_type_t camera = K4A_CALIBRATION_TYPE_DEPTH, int stride = 1);
+
+	// size of the table for a camera resolution and stride
+	inline static int table_size(int resolution, int stride) {
+		return (resolution + stride - 1) / stride;
+	}
+	static void clear();
+
+	inline static uint64_t hits() {
+		return s_hits.load();
+	}
+
+	inline static uint64_t disk_hits() {
+		return s_disk_hits.load();
+	}
+
+	inline static uint64_t misses() {
+		return s_misses.load();
+	}
+
+	inline static bool s_use_disk_cache = true;
+
+private:
+	static const k4a_calibration_camera_t& camera_calibration(const k4a::calibration& calibration, k4a_calibration_type_t camera);
+	static std::shared_ptr<XYTable> create_table(const k4a::calibration& calibration, k4a_calibration_type_t camera, int stride);
+	static std::filesystem::path cache_file_path(uint64_t hash);
+	static std::shared_ptr<XYTable> read_from_disk(uint64_t hash, int width, int height);
+	static void write_to_disk(uint64_t hash, int width, int height, const XYTable& table);
+
+	inline static std::mutex s_mutex;
+	inline static std::unordered_map<uint64_t, std::shared_ptr<const XYTable>> s_tables;
+
+	inline static std::atomic<uint64_t> s_hits = 0;
+	inline static std::atomic<uint64_t> s_disk_hits = 0;
+	inline static std::atomic<uint64_t> s_misses = 0;
+};
@@ -0,0 +1,58 @@
+#include <stdint.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <k4a/k4a.hpp>
+
+#pragma once
+
+// The raw frame of a .capture file as written by CameraCaptureSequence::save_sequence, read into
+// plain buffers so the tests do not need the image allocator or a device.
+struct CaptureFrame {
+	std::string name;
+	int depth_width = 0;
+	int depth_height = 0;
+	std::vector<uint16_t> depth;
+	int color_width = 0;
+	int color_height = 0;
+	std::vector<uint8_t> color; // bgra
+	k4a_calibration_t calibration{};
+};
+
+inline bool read_capture(const std::filesystem::path& path, CaptureFrame& frame)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs)
+		return false;
+
+	uint32_t name_length = 0;
+	ifs.read(reinterpret_cast<char*>(&name_length), sizeof(name_length));
+	frame.name.resize(name_length);
+	ifs.read(frame.name.data(), name_length);
+
+	bool is_selected;
+	ifs.read(reinterpret_cast<char*>(&is_selected), sizeof(is_selected));
+
+	int depth_size = 0;
+	ifs.read(reinterpret_cast<char*>(&frame.depth_width), sizeof(int));
+	ifs.read(reinterpret_cast<char*>(&frame.depth_height), sizeof(int));
+	ifs.read(reinterpret_cast<char*>(&depth_size), sizeof(int));
+	if (!ifs || depth_size != frame.depth_width * frame.depth_height * (int)sizeof(uint16_t))
+		return false;
+	frame.depth.resize((size_t)frame.depth_width * frame.depth_height);
+	ifs.read(reinterpret_cast<char*>(frame.depth.data()), depth_size);
+
+	int color_size = 0;
+	ifs.read(reinterpret_cast<char*>(&frame.color_width), sizeof(int));
+	ifs.read(reinterpret_cast<char*>(&frame.color_height), sizeof(int));
+	ifs.read(reinterpret_cast<char*>(&color_size), sizeof(int));
+	if (!ifs || color_size != frame.color_width * frame.color_height * 4)
+		return false;
+	frame.color.resize(color_size);
+	ifs.read(reinterpret_cast<char*>(frame.color.data()), color_size);
+
+	ifs.read(reinterpret_cast<char*>(&frame.calibration), sizeof(frame.calibration));
+	return (bool)ifs;
+}
@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "DepthAccumulator.h"
+
+// Replays depth frames through DepthAccumulator and checks the mean and median result against a
+// plain per-pixel reference. Several recorded .capture files of the same size are replayed as they
+// are. A single recording (or a synthetic frame without one) is turned into a burst by adding
+// deterministic noise, dropouts and a few unstable pixels that the variance test has to reject.
+
+namespace {
+	struct Frames {
+		int width = 0;
+		int height = 0;
+		std::vector<std::vector<uint16_t>> depth;
+	};
+
+	uint32_t hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+	void make_burst(const std::vector<uint16_t>& base, int frame_count, Frames& frames)
+	{
+		for (int f = 0; f < frame_count; f++) {
+			std::vector<uint16_t> frame(base.size());
+			for (size_t i = 0; i < base.size(); i++) {
+				const uint32_t h = hash((uint32_t)i * 131 + f);
+				if (base[i] == 0 || h % 20 == 0) {
+					continue;
+				}
+
+				int depth = base[i] + (int)(h % 13) - 6;
+				// every 97th pixel jumps in one frame, like a flying pixel
+				if (hash((uint32_t)i) % 97 == 0 && f == 1) {
+					depth += 400;
+				}
+				frame[i] = (uint16_t)std::clamp(depth, 1, 65535);
+			}
+			frames.depth.push_back(std::move(frame));
+		}
+	}
+
+	// what the accumulator should produce, with the variance of the pixel for borderline cases
+	uint16_t reference_pixel(const Frames& frames, size_t i, DepthAccumulationMode mode, double& variance, double& max_variance)
+	{
+		std::vector<uint16_t> samples;
+		for (const auto& frame : frames.depth) {
+			if (frame[i] != 0) {
+				samples.push_back(frame[i]);
+			}
+		}
+
+		variance = 0.;
+		max_variance = 0.;
+		const int min_count = std::max(1, (int)std::ceil(frames.depth.size() * CAPTURE_TEMPORAL_MIN_VALID_FRACTION));
+		if ((int)samples.size() < min_count)
+			return 0;
+
+		double sum = 0., sum_sq = 0.;
+		for (uint16_t sample : samples) {
+			sum += sample;
+			sum_sq += (double)sample * sample;
+		}
+		const double mean = sum / samples.size();
+		variance = std::max(sum_sq / samples.size() - mean * mean, 0.);
+
+		const double max_stddev = CAPTURE_TEMPORAL_MAX_STDDEV_MM + CAPTURE_TEMPORAL_MAX_STDDEV_RELATIVE * mean;
+		max_variance = max_stddev * max_stddev;
+		if (variance > max_variance)
+			return 0;
+
+		if (mode == DepthAccumulationMode::Mean)
+			return (uint16_t)std::clamp<long>(std::lround(mean), 1, 65535);
+
+		std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+		return samples[samples.size() / 2];
+	}
+
+	int check(const Frames& frames, DepthAccumulationMode mode, const char* name)
+	{
+		DepthAccumulator accumulator;
+		accumulator.begin(frames.width, frames.height, (int)frames.depth.size(), mode);
+		for (const auto& frame : frames.depth) {
+			accumulator.add_frame(frame.data(), frames.width, frames.height);
+		}
+
+		if (!accumulator.is_complete()) {
+			std::cout << std::format("{}: accumulation did not complete", name) << std::endl;
+			return 1;
+		}
+
+		k4a::image result = accumulator.result();
+		const uint16_t* out = reinterpret_cast<const uint16_t*>(result.get_buffer());
+
+		size_t valid = 0, rejected = 0, mismatches = 0;
+		for (size_t i = 0; i < (size_t)frames.width * frames.height; i++) {
+			double variance, max_variance;
+			const uint16_t expected = reference_pixel(frames, i, mode, variance, max_variance);
+			valid += expected != 0;
+			rejected += expected == 0 && variance > max_variance;
+
+			// the accumulator sums in float relative to the first frame, so the rounding of the mean
+			// and a variance right at the limit may go either way
+			const bool borderline = max_variance > 0. && std::abs(variance - max_variance) <= .01 * max_variance;
+			const int tolerance = mode == DepthAccumulationMode::Mean ? 1 : 0;
+			if (!borderline && std::abs((int)out[i] - (int)expected) > tolerance) {
+				if (mismatches++ < 10) {
+					std::cout << std::format("{}: pixel {} is {}, expected {}", name, i, out[i], expected) << std::endl;
+				}
+			}
+		}
+
+		std::cout << std::format("{}: {} frames, {} valid pixels, {} rejected by variance, {} mismatches",
+			name, frames.depth.size(), valid, rejected, mismatches) << std::endl;
+		return mismatches > 0 ? 1 : 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Frames frames;
+	std::vector<uint16_t> base;
+
+	for (int arg = 1; arg < argc; arg++) {
+		CaptureFrame capture;
+		if (!read_capture(argv[arg], capture)) {
+			std::cout << std::format("could not read capture {}", argv[arg]) << std::endl;
+			return 1;
+		}
+		if (arg > 1 && (capture.depth_width != frames.width || capture.depth_height != frames.height)) {
+			std::cout << std::format("{} has a different depth size", argv[arg]) << std::endl;
+			return 1;
+		}
+
+		frames.width = capture.depth_width;
+		frames.height = capture.depth_height;
+		frames.depth.push_back(std::move(capture.depth));
+	}
+
+	if (frames.depth.size() == 1) {
+		base = std::move(frames.depth.front());
+		frames.depth.clear();
+	}
+	else if (frames.depth.empty()) {
+		// a tilted plane with a hole
+		frames.width = 320;
+		frames.height = 288;
+		base.resize((size_t)frames.width * frames.height);
+		for (int y = 0; y < frames.height; y++) {
+			for (int x = 0; x < frames.width; x++) {
+				const bool hole = std::abs(x - 160) < 20 && std::abs(y - 144) < 20;
+				base[(size_t)y * frames.width + x] = hole ? 0 : (uint16_t)(800 + 2 * x + y);
+			}
+		}
+	}
+
+	// both modes replay the same frames, so the burst fits the median window
+	if (frames.depth.size() > CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES) {
+		frames.depth.resize(CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES);
+	}
+
+	int failures = 0;
+	if (!base.empty()) {
+		make_burst(base, CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES, frames);
+	}
+	failures += check(frames, DepthAccumulationMode::Mean, "mean");
+	failures += check(frames, DepthAccumulationMode::Median, "median");
+
+	// the median window is capped, the mean is not
+	DepthAccumulator capped;
+	capped.begin(frames.width, frames.height, CAPTURE_TEMPORAL_MAX_FRAMES, DepthAccumulationMode::Median);
+	if (capped.frame_count() != std::min(CAPTURE_TEMPORAL_MAX_FRAMES, CAPTURE_TEMPORAL_MAX_MEDIAN_FRAMES)) {
+		std::cout << std::format("median window is {} frames", capped.frame_count()) << std::endl;
+		failures++;
+	}
+
+	return failures > 0 ? 1 : 0;
+}
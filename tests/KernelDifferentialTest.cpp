@@ -0,0 +1,253 @@
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "PointcloudKernels.h"
+#include "XYTableCache.h"
+
+// Runs the SIMD generate_points of this build and generate_points_scalar over the same frame and
+// compares both to a copy of the original two-pass Pointcloud::generate_point_cloud, so a change of
+// the invalid pixel handling, the xy table lookup or the color order shows up even if both new paths
+// agree. Takes a recorded .capture file as argument, without one it uses a random frame with the
+// same kinds of invalid pixels.
+
+namespace {
+	struct KernelInput {
+		int width = 0;
+		int height = 0;
+		std::vector<uint16_t> depth;
+		std::vector<k4a_float2_t> xy_table;
+		std::vector<uint8_t> color; // bgra, in depth camera space
+		std::vector<glm::vec3> normals;
+	};
+
+	bool load_recorded(const char* path, KernelInput& input)
+	{
+		CaptureFrame frame;
+		if (!read_capture(path, frame)) {
+			std::cout << std::format("could not read capture {}", path) << std::endl;
+			return false;
+		}
+
+		input.width = frame.depth_width;
+		input.height = frame.depth_height;
+		input.depth = frame.depth;
+
+		k4a::calibration calibration(frame.calibration);
+		XYTableCache::s_use_disk_cache = false;
+		input.xy_table = *XYTableCache::get(calibration);
+
+		k4a::image depth_image = k4a::image::create(K4A_IMAGE_FORMAT_DEPTH16, frame.depth_width, frame.depth_height, frame.depth_width * sizeof(uint16_t));
+		std::memcpy(depth_image.get_buffer(), frame.depth.data(), depth_image.get_size());
+		k4a::image color_image = k4a::image::create(K4A_IMAGE_FORMAT_COLOR_BGRA32, frame.color_width, frame.color_height, frame.color_width * 4);
+		std::memcpy(color_image.get_buffer(), frame.color.data(), color_image.get_size());
+
+		k4a::transformation transformation(calibration);
+		k4a::image transformed = transformation.color_image_to_depth_camera(depth_image, color_image);
+		input.color.assign(transformed.get_buffer(), transformed.get_buffer() + transformed.get_size());
+		return true;
+	}
+
+	void make_random(KernelInput& input)
+	{
+		input.width = 320;
+		input.height = 288;
+		const size_t pixel_count = (size_t)input.width * input.height;
+
+		std::mt19937 rng(42);
+		std::uniform_int_distribution<int> depth(0, 6000);
+		std::uniform_real_distribution<float> ray(-1.5f, 1.5f);
+		std::uniform_int_distribution<int> channel(0, 255);
+		std::uniform_int_distribution<int> invalid(0, 15);
+
+		input.depth.resize(pixel_count);
+		input.xy_table.resize(pixel_count);
+		input.color.resize(pixel_count * 4);
+		for (size_t i = 0; i < pixel_count; i++) {
+			input.depth[i] = invalid(rng) == 0 ? 0 : (uint16_t)depth(rng);
+			input.xy_table[i].xy.x = invalid(rng) == 0 ? NAN : ray(rng);
+			input.xy_table[i].xy.y = ray(rng);
+			for (int c = 0; c < 4; c++) {
+				input.color[i * 4 + c] = invalid(rng) == 0 && c < 3 ? 0 : (uint8_t)channel(rng);
+			}
+		}
+	}
+
+	struct BaselinePoint {
+		glm::vec3 position;
+		glm::vec3 color;
+	};
+
+	// Pointcloud::generate_point_cloud before the kernels, on plain buffers instead of k4a images.
+	// Returns the centroid, the points are left uncentered.
+	glm::vec3 generate_point_cloud_baseline(const KernelInput& input, std::vector<BaselinePoint>& points)
+	{
+		const int width = input.width;
+		const int height = input.height;
+
+		const uint16_t* depth_data = input.depth.data();
+		const uint8_t* color_data = input.color.data();
+		const k4a_float2_t* xy_table_data = input.xy_table.data();
+		std::vector<k4a_float3_t> point_cloud((size_t)width * height);
+		k4a_float3_t* point_cloud_data = point_cloud.data();
+
+		for (int i = 0; i < width * height; i++) {
+			if (depth_data[i] != 0 && !std::isnan(xy_table_data[i].xy.x) && !std::isnan(xy_table_data[i].xy.y)) {
+				point_cloud_data[i].xyz.x = xy_table_data[i].xy.x * (float)depth_data[i];
+				point_cloud_data[i].xyz.y = xy_table_data[i].xy.y * (float)depth_data[i];
+				point_cloud_data[i].xyz.z = (float)depth_data[i];
+			}
+			else {
+				point_cloud_data[i].xyz.x = nanf("");
+				point_cloud_data[i].xyz.y = nanf("");
+				point_cloud_data[i].xyz.z = nanf("");
+			}
+		}
+
+		points.clear();
+		glm::vec3 sum(0.f);
+		for (int i = 0; i < width * height; i++) {
+
+			if (std::isnan(point_cloud_data[i].xyz.x) ||
+				std::isnan(point_cloud_data[i].xyz.y) ||
+				std::isnan(point_cloud_data[i].xyz.z))
+				continue;
+
+			uint8_t b = color_data[i * 4 + 0];
+			uint8_t g = color_data[i * 4 + 1];
+			uint8_t r = color_data[i * 4 + 2];
+
+			// skip points, we don't have a color for
+			// (fov of depth image is wider that the color image)
+			if (r == 0 && g == 0 && b == 0)
+				continue;
+
+			BaselinePoint point;
+			static float scale = 1.f / 100.f;
+
+			point.position.x = (float)-point_cloud_data[i].xyz.x * scale;
+			point.position.y = (float)point_cloud_data[i].xyz.y * scale;
+			point.position.z = (float)point_cloud_data[i].xyz.z * scale;
+
+			point.color.r = r / 255.f;
+			point.color.g = g / 255.f;
+			point.color.b = b / 255.f;
+
+			sum += point.position;
+
+			points.push_back(point);
+		}
+
+		return sum / static_cast<float>(points.size());
+	}
+
+	bool close(float a, float b, float tolerance)
+	{
+		return std::abs(a - b) <= tolerance * std::max(1.f, std::max(std::abs(a), std::abs(b)));
+	}
+
+	bool close(const glm::vec3& a, const glm::vec3& b, float tolerance)
+	{
+		return close(a.x, b.x, tolerance) && close(a.y, b.y, tolerance) && close(a.z, b.z, tolerance);
+	}
+
+	// a kernel output against the baseline: same points in the same order, colors back in bytes
+	int compare_to_baseline(const char* name, const std::vector<BaselinePoint>& baseline, const glm::vec3& baseline_centroid,
+		const PointcloudKernelResult& result, const std::vector<glm::vec3>& positions, const std::vector<RgbaPixel>& colors)
+	{
+		if (result.count != baseline.size()) {
+			std::cout << std::format("{}: {} points, the baseline has {}", name, result.count, baseline.size()) << std::endl;
+			return 1;
+		}
+
+		int failures = 0;
+		for (size_t i = 0; i < result.count; i++) {
+			const glm::vec3 color = glm::round(baseline[i].color * 255.f);
+			bool equal = close(positions[i], baseline[i].position, 1e-6f)
+				&& colors[i].r == (uint8_t)color.r && colors[i].g == (uint8_t)color.g && colors[i].b == (uint8_t)color.b && colors[i].a == 255;
+			if (!equal && failures++ < 10) {
+				std::cout << std::format("{}: point {} differs from the baseline: ({}, {}, {}) vs ({}, {}, {})", name, i,
+					positions[i].x, positions[i].y, positions[i].z, baseline[i].position.x, baseline[i].position.y, baseline[i].position.z) << std::endl;
+			}
+		}
+
+		// the baseline sums sequentially in float
+		if (result.count > 0 && !close(result.sum / (float)result.count, baseline_centroid, 1e-3f)) {
+			std::cout << std::format("{}: centroid differs from the baseline", name) << std::endl;
+			failures++;
+		}
+		return failures;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	KernelInput input;
+	if (argc > 1) {
+		if (!load_recorded(argv[1], input))
+			return 1;
+	}
+	else {
+		make_random(input);
+	}
+
+	const size_t pixel_count = (size_t)input.width * input.height;
+	input.normals.resize(pixel_count);
+	for (size_t i = 0; i < pixel_count; i++) {
+		input.normals[i] = glm::vec3((float)i, 0.f, 1.f);
+	}
+
+	std::vector<glm::vec3> simd_positions(pixel_count), scalar_positions(pixel_count);
+	std::vector<RgbaPixel> simd_colors(pixel_count), scalar_colors(pixel_count);
+	std::vector<glm::vec3> simd_normals(pixel_count), scalar_normals(pixel_count);
+
+	// mm to units, like PointcloudBuilder
+	const float scale = 1.f / 100.f;
+	PointcloudKernelResult simd = PointcloudKernels::generate_points(input.depth.data(), input.xy_table.data(), input.color.data(), input.normals.data(),
+		pixel_count, scale, { simd_positions.data(), simd_colors.data(), simd_normals.data() });
+	PointcloudKernelResult scalar = PointcloudKernels::generate_points_scalar(input.depth.data(), input.xy_table.data(), input.color.data(), input.normals.data(),
+		pixel_count, scale, { scalar_positions.data(), scalar_colors.data(), scalar_normals.data() });
+
+	std::vector<BaselinePoint> baseline;
+	const glm::vec3 baseline_centroid = generate_point_cloud_baseline(input, baseline);
+
+	std::cout << std::format("{} ({}x{}): {} vs {} points, baseline {}", PointcloudKernels::instruction_set(), input.width, input.height, simd.count, scalar.count, baseline.size()) << std::endl;
+
+	int failures = 0;
+	failures += compare_to_baseline("scalar", baseline, baseline_centroid, scalar, scalar_positions, scalar_colors);
+	failures += compare_to_baseline(PointcloudKernels::instruction_set(), baseline, baseline_centroid, simd, simd_positions, simd_colors);
+	if (simd.count != scalar.count) {
+		std::cout << "point count differs" << std::endl;
+		return 1;
+	}
+
+	for (size_t i = 0; i < scalar.count; i++) {
+		// the scalar path does the same float operations, a fused multiply-add may differ in the last bit
+		bool equal = close(simd_positions[i], scalar_positions[i], 1e-6f)
+			&& std::memcmp(&simd_colors[i], &scalar_colors[i], sizeof(RgbaPixel)) == 0
+			&& simd_normals[i] == scalar_normals[i];
+		if (!equal && failures++ < 10) {
+			std::cout << std::format("point {} differs: ({}, {}, {}) vs ({}, {}, {})", i,
+				simd_positions[i].x, simd_positions[i].y, simd_positions[i].z, scalar_positions[i].x, scalar_positions[i].y, scalar_positions[i].z) << std::endl;
+		}
+	}
+
+	// the lanes sum in a different order
+	if (!close(simd.sum, scalar.sum, 1e-3f) || !close(simd.max_radius_sq, scalar.max_radius_sq, 1e-6f)
+		|| !close(simd.bounds_min, scalar.bounds_min, 1e-6f) || !close(simd.bounds_max, scalar.bounds_max, 1e-6f)) {
+		std::cout << "reductions differ" << std::endl;
+		failures++;
+	}
+
+	if (failures > 0) {
+		std::cout << std::format("{} mismatches", failures) << std::endl;
+		return 1;
+	}
+
+	std::cout << "outputs match" << std::endl;
+	return 0;
+}
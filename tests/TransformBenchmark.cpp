@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PointcloudKernels.h"
+#include "ThreadPool.h"
+
+// Checks transform_points against a plain glm loop for every tail length and in place, then times both
+// over 1M points (best of 20). The kernel splits ranges above POINTCLOUD_TRANSFORM_CHUNK_SIZE over the
+// global thread pool, so its time is also given for a single chunk per call.
+
+namespace {
+	glm::vec3 reference(const glm::mat4& transform, const glm::vec3& p)
+	{
+		return glm::vec3(transform * glm::vec4(p, 1.f));
+	}
+
+	bool close(const glm::vec3& a, const glm::vec3& b)
+	{
+		const glm::vec3 d = glm::abs(a - b);
+		return std::max(d.x, std::max(d.y, d.z)) <= 1e-5f * std::max(1.f, glm::length(b));
+	}
+
+	template<typename Fn>
+	double best_of(int runs, Fn&& fn)
+	{
+		double best = 1e30;
+		for (int run = 0; run < runs; run++) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+		}
+		return best;
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> coordinate(-10.f, 10.f);
+
+	glm::mat4 transform = glm::translate(glm::mat4(1.f), glm::vec3(1.f, -2.f, 3.f));
+	transform = glm::rotate(transform, .7f, glm::normalize(glm::vec3(1.f, 2.f, 3.f)));
+	transform = glm::scale(transform, glm::vec3(1.5f));
+
+	int failures = 0;
+	for (size_t count = 0; count <= 40; count++) {
+		std::vector<glm::vec3> in(count), out(count);
+		for (auto& p : in) {
+			p = glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng));
+		}
+
+		PointcloudKernels::transform_points(in.data(), count, transform, out.data());
+		std::vector<glm::vec3> in_place = in;
+		PointcloudKernels::transform_points(in_place.data(), count, transform, in_place.data());
+
+		for (size_t i = 0; i < count; i++) {
+			if (!close(out[i], reference(transform, in[i])) || !close(in_place[i], reference(transform, in[i]))) {
+				std::cout << std::format("point {} of {} differs", i, count) << std::endl;
+				failures++;
+			}
+		}
+	}
+
+	const size_t count = 1 << 20;
+	std::vector<glm::vec3> in(count), out(count);
+	for (auto& p : in) {
+		p = glm::vec3(coordinate(rng), coordinate(rng), coordinate(rng));
+	}
+
+	const double glm_ms = best_of(20, [&]() {
+		for (size_t i = 0; i < count; i++) {
+			out[i] = reference(transform, in[i]);
+		}
+	});
+	const double kernel_ms = best_of(20, [&]() {
+		PointcloudKernels::transform_points(in.data(), count, transform, out.data());
+	});
+	const double chunked_ms = best_of(20, [&]() {
+		for (size_t begin = 0; begin < count; begin += POINTCLOUD_TRANSFORM_CHUNK_SIZE) {
+			PointcloudKernels::transform_points(in.data() + begin, std::min<size_t>(POINTCLOUD_TRANSFORM_CHUNK_SIZE, count - begin), transform, out.data() + begin);
+		}
+	});
+
+	for (size_t i = 0; i < count; i++) {
+		if (!close(out[i], reference(transform, in[i]))) {
+			failures++;
+			break;
+		}
+	}
+
+	std::cout << std::format("{} points, {}: glm loop {:.2f} ms, kernel {:.2f} ms on {} threads, kernel {:.2f} ms on one thread",
+		count, PointcloudKernels::instruction_set(), glm_ms, kernel_ms, ThreadPool::global().thread_count(), chunked_ms) << std::endl;
+
+	return failures > 0 ? 1 : 0;
+}